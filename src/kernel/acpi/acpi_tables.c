@@ -1,75 +1,200 @@
 #include "acpi_tables.h"
 
+#include <stdbool.h>
 
-const struct RSDP* get_rsdp(const uint64_t mboot_header_phys_addr) {
-    uint64_t current_phys_ptr = mboot_header_phys_addr + 2*sizeof(multiboot_uint32_t);
+const struct RSDP* get_rsdp(const struct boot_info *const info) {
+    // an ACPI 1.0 RSDP stops before `Length`
+    if(info->rsdp_size < offsetof(struct RSDP, Length)) {
+        halt_and_die("RSDP not found.");
+    }
+    return (const struct RSDP*) info->rsdp;
+}
 
-    for(;;) {
-        const struct multiboot_tag *const current_virt_ptr = (struct multiboot_tag*) GENERAL_MEM_P2V(current_phys_ptr);
+// The registered tables live in an array in registration order, and the index is an open addressing hash table of
+//  `table index + 1` (0 = empty slot) that holds the first instance of every signature. Further instances are chained
+//  through `next_instance`, so looking up instance `n` only walks the `n` tables before it with the same signature.
+#define ACPI_HASH_SLOTS 256u // a power of two, and twice `MAX_ACPI_TABLES` so that probe sequences stay short
 
-        if(current_virt_ptr->type == MULTIBOOT_TAG_TYPE_END) break;
+struct acpi_table {
+    const struct SDT* header;
+    uint64_t phys_addr;
+    uint32_t signature;
+    uint32_t next_instance; // table index + 1, 0 = last instance
+};
 
-        if(current_virt_ptr->type == MULTIBOOT_TAG_TYPE_ACPI_NEW) {
-            const struct multiboot_tag_new_acpi *const acpi_tag = (struct multiboot_tag_new_acpi*) current_virt_ptr;
-            return (const struct RSDP*) acpi_tag->rsdp;
-        }
+static struct acpi_table acpi_tables[MAX_ACPI_TABLES];
+static uint32_t acpi_number_of_tables;
+static uint32_t acpi_hash_slots[ACPI_HASH_SLOTS];
+
+static uint32_t signature_of(const char *const signature) {
+    return ACPI_SIGNATURE(signature[0], signature[1], signature[2], signature[3]);
+}
+
+static bool checksum_is_valid(const void *const data, const uint64_t length) {
+    const uint8_t *const bytes = data;
+    uint8_t sum = 0u;
+    for(uint64_t i = 0u; i < length; ++i) {
+        sum += bytes[i];
+    }
+    return sum == 0u;
+}
+
+static uint32_t hash_slot_of(const uint32_t signature) {
+    // Fibonacci hashing, the top bits of the product are the best mixed
+    return (signature * 0x9E3779B1u) >> (32u - 8u);
+}
 
-        current_phys_ptr = (uint64_t)(current_phys_ptr  + round_up(current_virt_ptr->size, MULTIBOOT_TAG_ALIGN));
+// the slot with the first instance of `signature`, or the empty slot where it would go
+static uint32_t find_hash_slot(const uint32_t signature) {
+    uint32_t slot = hash_slot_of(signature);
+    while(acpi_hash_slots[slot] != 0u && acpi_tables[acpi_hash_slots[slot] - 1u].signature != signature) {
+        slot = (slot + 1u) & (ACPI_HASH_SLOTS - 1u);
     }
+    return slot;
+}
 
-    halt_and_die("RSDP not found.");
+static void warn_about_table(const char *const signature, const char *const problem) {
+    serial_writestring("ACPI table ");
+    serial_write(signature, 4);
+    serial_writestring(problem);
 }
 
-const struct XSDT* get_XSDT(const struct RSDP *const RSDP_virt_addr) {
+static void register_table(const uint64_t phys_addr) {
+    if(phys_addr == 0u) {
+        return;
+    }
+
+    const struct SDT *const header = (const struct SDT*) GENERAL_MEM_P2V(phys_addr);
+    if(header->Length < sizeof(struct SDT)) {
+        warn_about_table(header->Signature, " has an invalid Length, ignoring it.\n");
+        return;
+    }
+    if(!checksum_is_valid(header, header->Length)) {
+        warn_about_table(header->Signature, " has a bad checksum, ignoring it.\n");
+        return;
+    }
+    if(acpi_number_of_tables == MAX_ACPI_TABLES) {
+        warn_about_table(header->Signature, " does not fit in the registry, ignoring it.\n");
+        return;
+    }
+
+    const uint32_t signature = signature_of(header->Signature);
+    const uint32_t index = acpi_number_of_tables++;
+    acpi_tables[index] = (struct acpi_table) { header, phys_addr, signature, 0u };
+
+    const uint32_t slot = find_hash_slot(signature);
+    if(acpi_hash_slots[slot] == 0u) {
+        acpi_hash_slots[slot] = index + 1u;
+        return;
+    }
+    struct acpi_table* last = &acpi_tables[acpi_hash_slots[slot] - 1u];
+    while(last->next_instance != 0u) {
+        last = &acpi_tables[last->next_instance - 1u];
+    }
+    last->next_instance = index + 1u;
+}
+
+void acpi_tables_init(const struct RSDP *const RSDP_virt_addr) {
     kassert(RSDP_virt_addr != NULL, "RSDP is null.");
 
     if(strncmp(RSDP_virt_addr->Signature, "RSD PTR ", 8) != 0) {
         halt_and_die("Invalid RSDP.");
     }
-    if(RSDP_virt_addr->Revision != 2) {
-        halt_and_die("ACPI version is too old.");
+    // the ACPI 1.0 checksum only covers the fields up to `RsdtAddress`, the extended one covers the whole structure
+    if(!checksum_is_valid(RSDP_virt_addr, offsetof(struct RSDP, Length))) {
+        halt_and_die("RSDP has a bad checksum.");
+    }
+
+    const bool has_xsdt = RSDP_virt_addr->Revision >= 2u && RSDP_virt_addr->XsdtAddress != 0u;
+    if(has_xsdt) {
+        kassert(RSDP_virt_addr->Length >= sizeof(struct RSDP), "Invalid RSDP size.");
+        if(!checksum_is_valid(RSDP_virt_addr, sizeof(struct RSDP))) {
+            halt_and_die("RSDP has a bad extended checksum.");
+        }
+
+        const struct XSDT *const XSDT_virt_addr = (const struct XSDT*) GENERAL_MEM_P2V(RSDP_virt_addr->XsdtAddress);
+        if(XSDT_virt_addr->header.Length < sizeof(struct SDT) || !checksum_is_valid(XSDT_virt_addr, XSDT_virt_addr->header.Length)) {
+            halt_and_die("XSDT has a bad checksum.");
+        }
+        const uint64_t number_of_SDTs = (XSDT_virt_addr->header.Length - sizeof(struct SDT)) / sizeof(uint64_t);
+        for(uint64_t i = 0; i < number_of_SDTs; ++i) {
+            register_table(XSDT_virt_addr->ptrsToOtherSDTs[i]);
+        }
+    }
+    else {
+        const struct RSDT *const RSDT_virt_addr = (const struct RSDT*) GENERAL_MEM_P2V(RSDP_virt_addr->RsdtAddress);
+        if(RSDT_virt_addr->header.Length < sizeof(struct SDT) || !checksum_is_valid(RSDT_virt_addr, RSDT_virt_addr->header.Length)) {
+            halt_and_die("RSDT has a bad checksum.");
+        }
+        const uint64_t number_of_SDTs = (RSDT_virt_addr->header.Length - sizeof(struct SDT)) / sizeof(uint32_t);
+        for(uint64_t i = 0; i < number_of_SDTs; ++i) {
+            register_table(RSDT_virt_addr->ptrsToOtherSDTs[i]);
+        }
     }
-    kassert(RSDP_virt_addr->Length == sizeof(struct RSDP), "Invalid RSDP size.");
-    // TODO: Also calculate the checksum
 
-    return (const struct XSDT*) GENERAL_MEM_P2V(RSDP_virt_addr->XsdtAddress);
+    // NOTE: `X_DSDT` only exists in FADTs that are long enough for it, and takes precedence over `DSDT` when it is set.
+    const struct FADT *const FADT_virt_addr = (const struct FADT*) acpi_find_table(ACPI_SIGNATURE('F', 'A', 'C', 'P'), 0u);
+    if(FADT_virt_addr != NULL && acpi_table_count(ACPI_SIGNATURE('D', 'S', 'D', 'T')) == 0u) {
+        const bool has_x_dsdt = FADT_virt_addr->header.Length >= offsetof(struct FADT, X_DSDT) + sizeof(uint64_t) && FADT_virt_addr->X_DSDT != 0u;
+        register_table(has_x_dsdt ? FADT_virt_addr->X_DSDT : FADT_virt_addr->DSDT);
+    }
 }
 
-void enumerate_sdt_entries(const struct XSDT *const XSDT_virt_addr) {
-    const uint64_t number_of_SDTs = (XSDT_virt_addr->header.Length - sizeof(struct SDT)) / sizeof(uint64_t);
+const struct SDT* acpi_find_table(const uint32_t signature, uint32_t instance) {
+    uint32_t index_plus_one = acpi_hash_slots[find_hash_slot(signature)];
+    while(index_plus_one != 0u && instance > 0u) {
+        index_plus_one = acpi_tables[index_plus_one - 1u].next_instance;
+        --instance;
+    }
+    return (index_plus_one != 0u) ? acpi_tables[index_plus_one - 1u].header : NULL;
+}
+
+uint32_t acpi_table_count(const uint32_t signature) {
+    uint32_t count = 0u;
+    for(uint32_t index_plus_one = acpi_hash_slots[find_hash_slot(signature)]; index_plus_one != 0u; index_plus_one = acpi_tables[index_plus_one - 1u].next_instance) {
+        ++count;
+    }
+    return count;
+}
+
+void enumerate_sdt_entries(void) {
+    char str_buf[32];
 
     serial_writestring("SDT entries:\n");
-    for(uint64_t i = 0; i < number_of_SDTs; ++i) {
-        const struct SDT *const sdt_header = (const struct SDT*) GENERAL_MEM_P2V(XSDT_virt_addr->ptrsToOtherSDTs[i]);
-        serial_write(sdt_header->Signature, 4);
+    for(uint32_t i = 0; i < acpi_number_of_tables; ++i) {
+        serial_write(acpi_tables[i].header->Signature, 4);
+        serial_writestring(" at ");
+        serial_writestring(print_hex(acpi_tables[i].phys_addr, str_buf));
         serial_writestring("\n");
     }
 }
 
-const struct FADT* get_FADT(const struct XSDT *const XSDT_virt_addr) {
-    const uint64_t number_of_SDTs = (XSDT_virt_addr->header.Length - sizeof(struct SDT)) / sizeof(uint64_t);
-
-    for(uint64_t i = 0; i < number_of_SDTs; ++i) {
-        const struct SDT *const sdt_header = (const struct SDT*) GENERAL_MEM_P2V(XSDT_virt_addr->ptrsToOtherSDTs[i]);
-        if(strncmp(sdt_header->Signature, "FACP", 4) == 0) {
-            return (const struct FADT*) sdt_header;
-        }
+const struct FADT* get_FADT(void) {
+    const struct SDT *const table = acpi_find_table(ACPI_SIGNATURE('F', 'A', 'C', 'P'), 0u);
+    if(table == NULL) {
+        halt_and_die("No FADT found.");
     }
+    return (const struct FADT*) table;
+}
 
-    halt_and_die("No FADT found.");
+const struct MADT* get_MADT(void) {
+    const struct SDT *const table = acpi_find_table(ACPI_SIGNATURE('A', 'P', 'I', 'C'), 0u);
+    if(table == NULL) {
+        halt_and_die("No MADT found.");
+    }
+    return (const struct MADT*) table;
 }
 
-const struct MADT* get_MADT(const struct XSDT *const XSDT_virt_addr) {
-    const uint64_t number_of_SDTs = (XSDT_virt_addr->header.Length - sizeof(struct SDT)) / sizeof(uint64_t);
+const struct SRAT* get_SRAT(void) {
+    return (const struct SRAT*) acpi_find_table(ACPI_SIGNATURE('S', 'R', 'A', 'T'), 0u);
+}
 
-    for(uint64_t i = 0; i < number_of_SDTs; ++i) {
-        const struct SDT *const sdt_header = (const struct SDT*) GENERAL_MEM_P2V(XSDT_virt_addr->ptrsToOtherSDTs[i]);
-        if(strncmp(sdt_header->Signature, "APIC", 4) == 0) {
-            return (const struct MADT*) sdt_header;
-        }
-    }
+const struct SLIT* get_SLIT(void) {
+    return (const struct SLIT*) acpi_find_table(ACPI_SIGNATURE('S', 'L', 'I', 'T'), 0u);
+}
 
-    halt_and_die("No MADT found.");
+const struct HPET* get_HPET(void) {
+    return (const struct HPET*) acpi_find_table(ACPI_SIGNATURE('H', 'P', 'E', 'T'), 0u);
 }
 
 static const char* get_name_of_madt_interrupt_entry_type(const uint8_t type) {
@@ -1,8 +1,9 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
-#include <kernel/boot/multiboot.h>
+#include <kernel/boot/boot_info.h>
 
 #include <libc/required_libc_functions.h>
 
@@ -42,6 +43,12 @@ struct SDT {
     uint32_t CreatorRevision;
 } __attribute__ ((packed));
 
+// Root System Description Table, which ACPI 1.0 firmware has instead of the XSDT
+struct RSDT {
+    struct SDT header;
+    uint32_t ptrsToOtherSDTs[]; // len = (header.Length - sizeof(struct SDT)) / sizeof(uint32_t)
+} __attribute__ ((packed));
+
 // Extended System Description Table
 struct XSDT {
     struct SDT header;
@@ -117,6 +124,25 @@ struct FADT {
     uint64_t HypervisorVendorIdentity;
 } __attribute__ ((packed));
 
+enum GAS_AddressSpaceID {
+    GAS_SystemMemory = 0,
+    GAS_SystemIO = 1,
+};
+
+enum FADT_Flags {
+    TMR_VAL_EXT = 1 << 8, // the PM timer is 32 bits wide instead of 24
+};
+
+// High Precision Event Timer Description Table
+struct HPET {
+    struct SDT header;
+    uint32_t EventTimerBlockID;
+    struct GAS BaseAddress;
+    uint8_t HPETNumber;
+    uint16_t MinimumClockTick;
+    uint8_t PageProtection;
+} __attribute__ ((packed));
+
 struct InterruptEntryHeader {
     uint8_t Type; // support types [0-5] and [9-10]; all others are not relevant for x86_64 architecture
     uint8_t Length;
@@ -206,14 +232,85 @@ struct Localx2APIC_NMI_Structure {
     uint8_t Reserved[3];
 } __attribute__ ((packed));
 
+// System Resource Affinity Table
+struct SRAT {
+    struct SDT header;
+    uint32_t Reserved1; // must be 1 for backwards compatibility
+    uint64_t Reserved2;
+    struct InterruptEntryHeader StaticResourceAllocationStructure[]; // same Type/Length layout as the MADT entries
+} __attribute__ ((packed));
+
+enum SRAT_AffinityFlags {
+    AffinityEnabled = 1,
+    AffinityHotPluggable = 1 << 1,
+    AffinityNonVolatile = 1 << 2,
+};
+
+// SRAT type 0
+struct ProcessorLocal_APIC_AffinityStructure {
+    struct InterruptEntryHeader header;
+    uint8_t ProximityDomain_7_0;
+    uint8_t APIC_ID;
+    uint32_t Flags;
+    uint8_t LocalSAPIC_EID;
+    uint8_t ProximityDomain_31_8[3];
+    uint32_t ClockDomain;
+} __attribute__ ((packed));
+
+// SRAT type 1
+struct MemoryAffinityStructure {
+    struct InterruptEntryHeader header;
+    uint32_t ProximityDomain;
+    uint16_t Reserved1;
+    uint64_t BaseAddress;
+    uint64_t Length;
+    uint32_t Reserved2;
+    uint32_t Flags;
+    uint64_t Reserved3;
+} __attribute__ ((packed));
+
+// SRAT type 2
+struct ProcessorLocalx2APIC_AffinityStructure {
+    struct InterruptEntryHeader header;
+    uint16_t Reserved1;
+    uint32_t ProximityDomain;
+    uint32_t X2APIC_ID;
+    uint32_t Flags;
+    uint32_t ClockDomain;
+    uint32_t Reserved2;
+} __attribute__ ((packed));
+
+// System Locality Information Table
+struct SLIT {
+    struct SDT header;
+    uint64_t NumberOfSystemLocalities;
+    uint8_t Entry[]; // NumberOfSystemLocalities x NumberOfSystemLocalities matrix of relative distances, where the distance to itself is 10
+} __attribute__ ((packed));
+
+
+
+// A table signature as the little-endian 32-bit value of its 4 characters, so that lookups compare one integer instead of a string.
+#define ACPI_SIGNATURE(a, b, c, d) ((uint32_t)(uint8_t)(a) | ((uint32_t)(uint8_t)(b) << 8) | ((uint32_t)(uint8_t)(c) << 16) | ((uint32_t)(uint8_t)(d) << 24))
 
+#define MAX_ACPI_TABLES 128u
 
+const struct RSDP* get_rsdp(const struct boot_info* info);
 
+// Builds the table registry from the XSDT, or from the RSDT when the firmware only has ACPI 1.0 (or no XSDT).
+//  The RSDP and the root table must have valid checksums, the other tables are left out (with a warning) if theirs is wrong.
+//  The DSDT is only referenced from the FADT, so it gets registered from there.
+//  Must be called after `setup_linear_mapping()`, since the tables are read through the linear map.
+void acpi_tables_init(const struct RSDP* RSDP_virt_addr);
 
+// Returns instance `instance` (in root table order) of the tables with `signature`, or NULL if there are fewer. This is O(1) in the number of tables.
+const struct SDT* acpi_find_table(uint32_t signature, uint32_t instance);
+uint32_t acpi_table_count(uint32_t signature);
 
-const struct RSDP* get_rsdp(const uint64_t mboot_header_phys_addr);
-const struct XSDT* get_XSDT(const struct RSDP *const RSDP_virt_addr);
-void enumerate_sdt_entries(const struct XSDT *const XSDT_virt_addr);
-const struct FADT* get_FADT(const struct XSDT *const XSDT_virt_addr);
-const struct MADT* get_MADT(const struct XSDT *const XSDT_virt_addr);
+void enumerate_sdt_entries(void);
+const struct FADT* get_FADT(void);
+const struct MADT* get_MADT(void);
 void enumerate_madt_interrupt_entries(const struct MADT *const MADT_virt_addr);
+// These tables are optional, so NULL is returned if they are not present.
+const struct SRAT* get_SRAT(void);
+const struct SLIT* get_SLIT(void);
+const struct HPET* get_HPET(void);
@@ -0,0 +1,13 @@
+#include "bench.h"
+
+void bench_report(const char *const name, const uint64_t total_ticks, const uint64_t iterations) {
+    char str_buf[32];
+
+    serial_writestring("bench: ");
+    serial_writestring(name);
+    serial_writestring(": ");
+    serial_writestring(print_digits(iterations != 0u ? total_ticks/iterations : 0u, str_buf));
+    serial_writestring(" ticks/op over ");
+    serial_writestring(print_digits(iterations, str_buf));
+    serial_writestring(" ops.\n");
+}
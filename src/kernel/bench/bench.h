@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <kernel/cpu/cpu.h>
+#include <kernel/drivers/serial/serial.h>
+
+// NOTE: The microbenchmarks are only called from `kernel_main()` when building with `make BENCH=1` (which defines `KERNEL_BENCHMARKS`).
+//  All results are reported in TSC ticks per operation over serial.
+
+void bench_report(const char* name, uint64_t total_ticks, uint64_t iterations);
+
+// must be called after the reservations are done but before `phys_mem_buddy_init()`, since it exercises the bitmap path
+void bench_phys_mem_bitmap(void);
+void bench_phys_mem_buddy(void);
+void bench_page_cache(void);
+void bench_context_switch(void); // must be called after `vm_init()`
+void bench_string_functions(void);
+void bench_interrupts(void); // must be called once interrupts are enabled and `timer_init()` ran
+void bench_scheduler(void); // must be called after `smp_init()`, so that the other CPUs can steal
+void bench_framebuffer(void); // must be called after `framebuffer_init()`
+void bench_console(void); // must be called after `console_init()`
@@ -0,0 +1,76 @@
+#include "bench.h"
+
+#include <stdbool.h>
+
+#include <kernel/drivers/framebuffer/console.h>
+#include <kernel/drivers/framebuffer/font.h>
+#include <kernel/drivers/framebuffer/framebuffer.h>
+#include <kernel/time/clocksource.h>
+
+#define CONSOLE_BENCH_LINES 1000u // enough that nearly all of them scroll
+#define CONSOLE_BENCH_LINE_LENGTH 80u
+
+static char bench_line[CONSOLE_BENCH_LINE_LENGTH + 1u];
+
+static void report_lines_per_second(const char *const name, const uint64_t ticks) {
+    char str_buf[32];
+
+    bench_report(name, ticks, CONSOLE_BENCH_LINES);
+    serial_writestring("bench: ");
+    serial_writestring(name);
+    serial_writestring(": ");
+    serial_writestring(print_digits(ticks != 0u ? CONSOLE_BENCH_LINES * clocksource_get_info().tsc_hz / ticks : 0u, str_buf));
+    serial_writestring(" lines/s.\n");
+}
+
+// What the console would cost without its tricks: every glyph is decoded bit by bit from the font, and scrolling copies every row up.
+static void naive_write_line(const uint32_t row, const uint32_t foreground, const uint32_t background) {
+    const uint32_t rows = framebuffer_height() / CONSOLE_CELL_HEIGHT;
+    uint32_t y = row * CONSOLE_CELL_HEIGHT;
+    if(row >= rows) {
+        for(uint32_t i = 0u; i + CONSOLE_CELL_HEIGHT < rows * CONSOLE_CELL_HEIGHT; ++i) {
+            memcpy(framebuffer_shadow_row(i), framebuffer_shadow_row(i + CONSOLE_CELL_HEIGHT), framebuffer_width() * sizeof(uint32_t));
+        }
+        y = (rows - 1u) * CONSOLE_CELL_HEIGHT;
+    }
+
+    for(uint32_t column = 0u; column < CONSOLE_BENCH_LINE_LENGTH && (column + 1u) * CONSOLE_CELL_WIDTH <= framebuffer_width(); ++column) {
+        const uint8_t *const glyph = font_glyphs[(uint8_t)bench_line[column] - FONT_FIRST_CHAR];
+        for(uint32_t cell_y = 0u; cell_y < CONSOLE_CELL_HEIGHT; ++cell_y) {
+            uint32_t *const pixels = framebuffer_shadow_row(y + cell_y) + column * CONSOLE_CELL_WIDTH;
+            for(uint32_t cell_x = 0u; cell_x < CONSOLE_CELL_WIDTH; ++cell_x) {
+                const uint32_t font_x = (cell_x - CONSOLE_GLYPH_X_OFFSET) / CONSOLE_GLYPH_SCALE;
+                const uint32_t font_y = (cell_y - CONSOLE_GLYPH_Y_OFFSET) / CONSOLE_GLYPH_SCALE;
+                const bool set = cell_x >= CONSOLE_GLYPH_X_OFFSET && cell_y >= CONSOLE_GLYPH_Y_OFFSET && font_x < FONT_GLYPH_WIDTH && font_y < FONT_GLYPH_HEIGHT && ((glyph[font_y] >> (FONT_GLYPH_WIDTH - 1u - font_x)) & 1u);
+                pixels[cell_x] = set ? foreground : background;
+            }
+        }
+    }
+    framebuffer_mark_dirty(0u, 0u, framebuffer_width(), framebuffer_height());
+    framebuffer_flush();
+}
+
+void bench_console(void) {
+    for(uint32_t i = 0u; i < CONSOLE_BENCH_LINE_LENGTH; ++i) {
+        bench_line[i] = (char)(FONT_FIRST_CHAR + 1u + i % (FONT_NUMBER_OF_GLYPHS - 1u));
+    }
+
+    console_clear();
+    uint64_t start = rdtsc();
+    for(uint32_t i = 0u; i < CONSOLE_BENCH_LINES; ++i) {
+        console_write(bench_line, CONSOLE_BENCH_LINE_LENGTH);
+        console_write("\n", 1u);
+    }
+    report_lines_per_second("console line (glyph cache, scroll by offset)", rdtsc() - start);
+
+    console_clear();
+    const uint32_t foreground = framebuffer_color(0xCCu, 0xCCu, 0xCCu);
+    const uint32_t background = framebuffer_color(0u, 0u, 0u);
+    start = rdtsc();
+    for(uint32_t i = 0u; i < CONSOLE_BENCH_LINES; ++i) {
+        naive_write_line(i, foreground, background);
+    }
+    report_lines_per_second("console line (font decoding, scroll by copy)", rdtsc() - start);
+
+    console_clear();
+}
@@ -0,0 +1,33 @@
+#include "bench.h"
+
+#include <kernel/drivers/framebuffer/framebuffer.h>
+
+#define FRAMEBUFFER_BENCH_ITERATIONS 64u
+#define FRAMEBUFFER_BENCH_LINE_HEIGHT 16u // one text line of the console
+
+// Each round changes the shadow first, so that every flush really has something to send.
+static uint64_t bench_flush_round(const uint32_t height) {
+    uint64_t ticks = 0u;
+    for(uint32_t i = 0u; i < FRAMEBUFFER_BENCH_ITERATIONS; ++i) {
+        framebuffer_fill_rect(0u, 0u, framebuffer_width(), height, framebuffer_color((uint8_t)(i*8u), 0u, 0u));
+        const uint64_t start = rdtsc();
+        framebuffer_flush();
+        ticks += rdtsc() - start;
+    }
+    return ticks;
+}
+
+void bench_framebuffer(void) {
+    bench_report("framebuffer flush (one line)", bench_flush_round(FRAMEBUFFER_BENCH_LINE_HEIGHT), FRAMEBUFFER_BENCH_ITERATIONS);
+    bench_report("framebuffer flush (full screen)", bench_flush_round(framebuffer_height()), FRAMEBUFFER_BENCH_ITERATIONS);
+
+    // an empty dirty rectangle costs nothing
+    const uint64_t start = rdtsc();
+    for(uint32_t i = 0u; i < FRAMEBUFFER_BENCH_ITERATIONS; ++i) {
+        framebuffer_flush();
+    }
+    bench_report("framebuffer flush (nothing dirty)", rdtsc() - start, FRAMEBUFFER_BENCH_ITERATIONS);
+
+    framebuffer_fill_rect(0u, 0u, framebuffer_width(), framebuffer_height(), framebuffer_color(0u, 0u, 0u));
+    framebuffer_flush();
+}
@@ -0,0 +1,65 @@
+#include "bench.h"
+
+#include <kernel/cpu/percpu.h>
+#include <kernel/interrupts/idt.h>
+#include <kernel/interrupts/apic/apic.h>
+#include <kernel/time/clocksource.h>
+#include <kernel/time/timer.h>
+
+#define IPI_BENCH_VECTOR 0xE0u
+#define IPI_BENCH_ITERATIONS 10000u
+#define TIMER_BENCH_ITERATIONS 1000u
+#define TIMER_BENCH_DELAY_NS 50000ULL
+
+static volatile uint64_t ipi_send_tsc;
+static volatile uint32_t ipis_handled;
+
+static void bench_ipi_interrupt(struct interrupt_frame *const frame) {
+    (void)frame;
+    interrupt_record_latency(ipi_send_tsc);
+    ++ipis_handled;
+}
+
+static void bench_timer_callback(struct timer *const timer, void *const context) {
+    (void)timer;
+    *(volatile bool*)context = true;
+}
+
+// reports the average of the latencies recorded for `vector` since `before` was taken
+static void bench_report_latency(const char *const name, const uint8_t vector, const struct interrupt_stats before) {
+    const struct interrupt_stats after = interrupt_get_stats(current_cpu_id(), vector);
+    bench_report(name, after.total_latency_ticks - before.total_latency_ticks, after.latency_samples - before.latency_samples);
+}
+
+void bench_interrupts(void) {
+    const uint32_t cpu = current_cpu_id();
+
+    // a self-IPI measures the whole round trip: the `wrmsr` to the ICR, the entry stub, the dispatch, the EOI and the `iretq`
+    idt_register_handler(IPI_BENCH_VECTOR, bench_ipi_interrupt);
+    struct interrupt_stats before = interrupt_get_stats(cpu, IPI_BENCH_VECTOR);
+    const uint64_t start = rdtsc();
+    for(uint32_t i = 0u; i < IPI_BENCH_ITERATIONS; ++i) {
+        ipi_send_tsc = rdtsc_ordered();
+        x2apic_send_ipi(cpu_apic_ids[cpu], IPI_BENCH_VECTOR);
+        while(ipis_handled != i + 1u) {
+            cpu_relax();
+        }
+    }
+    bench_report("self-IPI round trip", rdtsc() - start, IPI_BENCH_ITERATIONS);
+    bench_report_latency("self-IPI to handler", IPI_BENCH_VECTOR, before);
+    idt_register_handler(IPI_BENCH_VECTOR, NULL);
+
+    // the latency from the TSC deadline to the handler, which is what every timer pays on top of the wheel's rounding
+    struct timer timer;
+    volatile bool fired;
+    timer_setup(&timer, bench_timer_callback, (void*)&fired);
+    before = interrupt_get_stats(cpu, LOCAL_TIMER_VECTOR);
+    for(uint32_t i = 0u; i < TIMER_BENCH_ITERATIONS; ++i) {
+        fired = false;
+        timer_add(&timer, ktime_get() + TIMER_BENCH_DELAY_NS);
+        while(!fired) {
+            cpu_relax();
+        }
+    }
+    bench_report_latency("TSC deadline to handler", LOCAL_TIMER_VECTOR, before);
+}
@@ -0,0 +1,110 @@
+#include "bench.h"
+
+#include <kernel/mem/phys/phys_mem_allocator.h>
+
+#define STRING_BENCH_BUFFER_ORDER 8u // 1MiB
+#define STRING_BENCH_BUFFER_SIZE (NORMAL_PAGE_SIZE << STRING_BENCH_BUFFER_ORDER)
+#define STRING_BENCH_BYTES_PER_SIZE (4ULL << 20) // every size moves about this many bytes in total
+
+static const uint64_t string_bench_sizes[] = { 16u, 64u, 256u, 1024u, 4096u, 65536u, STRING_BENCH_BUFFER_SIZE };
+
+// e.g. "memcpy 4096 bytes (byte loop)"
+static void report_string_bench(const char *const function, const uint64_t size, const char *const variant, const uint64_t ticks, const uint64_t iterations) {
+    char name[96];
+    char str_buf[32];
+    const char *const parts[] = { function, " ", print_digits(size, str_buf), " bytes (", variant, ")" };
+
+    size_t length = 0u;
+    for(size_t i = 0u; i < sizeof(parts)/sizeof(parts[0]); ++i) {
+        const size_t part_length = strlen(parts[i]);
+        memcpy(&name[length], parts[i], part_length);
+        length += part_length;
+    }
+    name[length] = '\0';
+
+    bench_report(name, ticks, iterations);
+}
+
+void bench_string_functions(void) {
+    uint8_t *const src = (uint8_t*)GENERAL_MEM_P2V(phys_mem_allocate_pages(STRING_BENCH_BUFFER_ORDER));
+    uint8_t *const dest = (uint8_t*)GENERAL_MEM_P2V(phys_mem_allocate_pages(STRING_BENCH_BUFFER_ORDER));
+    const char *const variant = libc_string_functions_variant();
+
+    for(size_t i = 0u; i < sizeof(string_bench_sizes)/sizeof(string_bench_sizes[0]); ++i) {
+        const uint64_t size = string_bench_sizes[i];
+        const uint64_t iterations = STRING_BENCH_BYTES_PER_SIZE/size;
+        uint64_t start;
+
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) memcpy_bytewise(dest, src, size);
+        report_string_bench("memcpy", size, "byte loop", rdtsc() - start, iterations);
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) memcpy(dest, src, size);
+        report_string_bench("memcpy", size, variant, rdtsc() - start, iterations);
+
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) memset_bytewise(dest, (int)j, size);
+        report_string_bench("memset", size, "byte loop", rdtsc() - start, iterations);
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) memset(dest, (int)j, size);
+        report_string_bench("memset", size, variant, rdtsc() - start, iterations);
+
+        // overlapping by half in both directions
+        const uint64_t move_size = size/2u;
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) {
+            memmove_bytewise(dest + move_size/2u, dest, move_size);
+            memmove_bytewise(dest, dest + move_size/2u, move_size);
+        }
+        report_string_bench("memmove", move_size, "byte loop", rdtsc() - start, 2u*iterations);
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) {
+            memmove(dest + move_size/2u, dest, move_size);
+            memmove(dest, dest + move_size/2u, move_size);
+        }
+        report_string_bench("memmove", move_size, variant, rdtsc() - start, 2u*iterations);
+    }
+
+    // equal buffers and strings, so that every byte has to be looked at
+    memset(src, 'a', STRING_BENCH_BUFFER_SIZE);
+    memset(dest, 'a', STRING_BENCH_BUFFER_SIZE);
+    for(size_t i = 0u; i < sizeof(string_bench_sizes)/sizeof(string_bench_sizes[0]); ++i) {
+        const uint64_t size = string_bench_sizes[i];
+        const uint64_t iterations = STRING_BENCH_BYTES_PER_SIZE/size;
+        volatile int compare_result = 0;
+        volatile size_t length = 0u;
+        uint64_t start;
+
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) compare_result = memcmp_bytewise(dest, src, size);
+        report_string_bench("memcmp", size, "byte loop", rdtsc() - start, iterations);
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) compare_result = memcmp(dest, src, size);
+        report_string_bench("memcmp", size, "word at a time", rdtsc() - start, iterations);
+
+        src[size - 1u] = '\0';
+        dest[size - 1u] = '\0';
+
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) length = strlen_bytewise((const char*)src);
+        report_string_bench("strlen", size, "byte loop", rdtsc() - start, iterations);
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) length = strlen((const char*)src);
+        report_string_bench("strlen", size, "word at a time", rdtsc() - start, iterations);
+
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) compare_result = strncmp_bytewise((const char*)dest, (const char*)src, size);
+        report_string_bench("strncmp", size, "byte loop", rdtsc() - start, iterations);
+        start = rdtsc();
+        for(uint64_t j = 0u; j < iterations; ++j) compare_result = strncmp((const char*)dest, (const char*)src, size);
+        report_string_bench("strncmp", size, "word at a time", rdtsc() - start, iterations);
+
+        src[size - 1u] = 'a';
+        dest[size - 1u] = 'a';
+        (void)compare_result;
+        (void)length;
+    }
+
+    phys_mem_free_pages(GENERAL_MEM_V2P((uint64_t)src), STRING_BENCH_BUFFER_ORDER);
+    phys_mem_free_pages(GENERAL_MEM_V2P((uint64_t)dest), STRING_BENCH_BUFFER_ORDER);
+}
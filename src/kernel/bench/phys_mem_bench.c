@@ -0,0 +1,92 @@
+#include "bench.h"
+
+#include <kernel/mem/phys/phys_mem_allocator.h>
+#include <kernel/mem/phys/page_cache.h>
+
+#define PHYS_MEM_BENCH_ROUNDS 4u
+#define PHYS_MEM_BENCH_PAGES_PER_ROUND 1024u
+#define PHYS_MEM_BENCH_MAX_ORDER 9u // 2MiB blocks
+
+static uint64_t bench_pages[PHYS_MEM_BENCH_ROUNDS*PHYS_MEM_BENCH_PAGES_PER_ROUND];
+
+// Each round allocates more pages without freeing the previous rounds, so a linear scan allocator gets slower round after round as low memory fills up.
+static void bench_single_pages(const char *const *const round_names, const char *const free_name, uint64_t (*const allocate)(void), void (*const free)(uint64_t)) {
+    for(uint32_t round = 0u; round < PHYS_MEM_BENCH_ROUNDS; ++round) {
+        uint64_t *const pages = &bench_pages[round*PHYS_MEM_BENCH_PAGES_PER_ROUND];
+
+        const uint64_t start = rdtsc();
+        for(uint32_t i = 0u; i < PHYS_MEM_BENCH_PAGES_PER_ROUND; ++i) {
+            pages[i] = allocate();
+        }
+        bench_report(round_names[round], rdtsc() - start, PHYS_MEM_BENCH_PAGES_PER_ROUND);
+    }
+
+    const uint64_t start = rdtsc();
+    for(uint32_t i = 0u; i < PHYS_MEM_BENCH_ROUNDS*PHYS_MEM_BENCH_PAGES_PER_ROUND; ++i) {
+        free(bench_pages[i]);
+    }
+    bench_report(free_name, rdtsc() - start, PHYS_MEM_BENCH_ROUNDS*PHYS_MEM_BENCH_PAGES_PER_ROUND);
+}
+
+void bench_phys_mem_bitmap(void) {
+    static const char *const round_names[PHYS_MEM_BENCH_ROUNDS] = {
+        "bitmap allocate_page (round 1)",
+        "bitmap allocate_page (round 2)",
+        "bitmap allocate_page (round 3)",
+        "bitmap allocate_page (round 4)",
+    };
+    bench_single_pages(round_names, "bitmap free_page", phys_mem_bitmap_allocate_page, phys_mem_bitmap_free_page);
+}
+
+static uint64_t buddy_allocate_single_page(void) {
+    return phys_mem_allocate_pages(0u);
+}
+
+static void buddy_free_single_page(const uint64_t page_addr) {
+    phys_mem_free_pages(page_addr, 0u);
+}
+
+void bench_phys_mem_buddy(void) {
+    static const char *const round_names[PHYS_MEM_BENCH_ROUNDS] = {
+        "buddy allocate_page (round 1)",
+        "buddy allocate_page (round 2)",
+        "buddy allocate_page (round 3)",
+        "buddy allocate_page (round 4)",
+    };
+    bench_single_pages(round_names, "buddy free_page", buddy_allocate_single_page, buddy_free_single_page);
+
+    // mixed orders, which the bitmap path cannot do at all
+    uint64_t start = rdtsc();
+    for(uint32_t i = 0u; i < PHYS_MEM_BENCH_PAGES_PER_ROUND; ++i) {
+        bench_pages[i] = phys_mem_allocate_pages(i % (PHYS_MEM_BENCH_MAX_ORDER + 1u));
+    }
+    bench_report("buddy allocate_pages (orders 0-9)", rdtsc() - start, PHYS_MEM_BENCH_PAGES_PER_ROUND);
+
+    start = rdtsc();
+    for(uint32_t i = 0u; i < PHYS_MEM_BENCH_PAGES_PER_ROUND; ++i) {
+        phys_mem_free_pages(bench_pages[i], i % (PHYS_MEM_BENCH_MAX_ORDER + 1u));
+    }
+    bench_report("buddy free_pages (orders 0-9)", rdtsc() - start, PHYS_MEM_BENCH_PAGES_PER_ROUND);
+}
+
+void bench_page_cache(void) {
+    static const char *const round_names[PHYS_MEM_BENCH_ROUNDS] = {
+        "page cache allocate_page (round 1)",
+        "page cache allocate_page (round 2)",
+        "page cache allocate_page (round 3)",
+        "page cache allocate_page (round 4)",
+    };
+
+    page_cache_reset_stats();
+    bench_single_pages(round_names, "page cache free_page", phys_mem_allocate_page, phys_mem_free_page);
+
+    // the common steady state: short lived pages that are freed right after they are allocated
+    const uint64_t start = rdtsc();
+    for(uint32_t i = 0u; i < PHYS_MEM_BENCH_PAGES_PER_ROUND; ++i) {
+        phys_mem_free_page(phys_mem_allocate_page());
+    }
+    bench_report("page cache allocate_page + free_page", rdtsc() - start, PHYS_MEM_BENCH_PAGES_PER_ROUND);
+
+    page_cache_print_stats();
+    page_cache_drain_current_cpu();
+}
@@ -0,0 +1,85 @@
+#include "bench.h"
+
+#include <libc/required_libc_functions.h>
+#include <kernel/cpu/percpu.h>
+#include <kernel/sched/sched.h>
+#include <kernel/time/clocksource.h>
+
+#define SCHED_BENCH_TASKS 16384u
+// stays well below the capacity of a run queue, since every task of a batch is queued on this CPU before any of them can run
+#define SCHED_BENCH_BATCH 512u
+#define SCHED_BENCH_TASK_WORK 1000u // iterations of busy work per task, which is short next to a time slice
+#define SCHED_BENCH_PING_PONGS 10000u
+
+static struct thread* bench_waiter;
+static volatile uint32_t tasks_left;
+
+static void short_task(void *const arg) {
+    (void)arg;
+    for(volatile uint32_t i = 0u; i < SCHED_BENCH_TASK_WORK; ++i) {
+    }
+    if(__atomic_sub_fetch(&tasks_left, 1u, __ATOMIC_ACQ_REL) == 0u) {
+        thread_unpark(bench_waiter);
+    }
+}
+
+struct ping_pong {
+    struct thread* ping;
+    struct thread* pong;
+    volatile uint64_t wake_tsc; // when the last `thread_unpark()` was called
+    // odd while it is pong's turn, even while it is ping's
+    //  NOTE: A park can return for an unpark that was left over from before (e.g. the throughput run), so each side checks that it is really its turn.
+    volatile uint32_t turn;
+    uint64_t total_wake_ticks; // only ever written by the thread that was just woken, so the two never race
+};
+
+static void pong_thread(void *const arg) {
+    struct ping_pong *const ping_pong = (struct ping_pong*)arg;
+    for(uint32_t i = 0u; i < SCHED_BENCH_PING_PONGS; ++i) {
+        while(ping_pong->turn != 2u*i + 1u) {
+            thread_park();
+        }
+        ping_pong->total_wake_ticks += rdtsc_ordered() - ping_pong->wake_tsc;
+        ping_pong->wake_tsc = rdtsc_ordered();
+        ping_pong->turn = 2u*i + 2u;
+        thread_unpark(ping_pong->ping);
+    }
+}
+
+void bench_scheduler(void) {
+    char str_buf[32];
+
+    // throughput: creating, running and exiting many short threads, with the idle CPUs stealing them from this one
+    bench_waiter = thread_current();
+    const uint64_t start = rdtsc_ordered();
+    for(uint32_t created = 0u; created < SCHED_BENCH_TASKS; created += SCHED_BENCH_BATCH) {
+        __atomic_store_n(&tasks_left, SCHED_BENCH_BATCH, __ATOMIC_RELEASE);
+        for(uint32_t i = 0u; i < SCHED_BENCH_BATCH; ++i) {
+            thread_create("bench task", short_task, NULL);
+        }
+        while(__atomic_load_n(&tasks_left, __ATOMIC_ACQUIRE) != 0u) {
+            thread_park();
+        }
+    }
+    const uint64_t ticks = rdtsc_ordered() - start;
+    bench_report("short thread create to exit", ticks, SCHED_BENCH_TASKS);
+    serial_writestring("bench: short threads: ");
+    serial_writestring(print_digits((uint64_t)SCHED_BENCH_TASKS * 1000000000ULL / tsc_ticks_to_ns(ticks), str_buf));
+    serial_writestring(" threads/s on ");
+    serial_writestring(print_digits(popcount64(online_cpus_mask), str_buf));
+    serial_writestring(" CPUs.\n");
+
+    // wake latency: two threads that take turns waking each other, from the `thread_unpark()` until the woken one runs
+    struct ping_pong ping_pong = { thread_current(), NULL, 0u, 0u, 0u };
+    ping_pong.pong = thread_create("bench pong", pong_thread, &ping_pong);
+    for(uint32_t i = 0u; i < SCHED_BENCH_PING_PONGS; ++i) {
+        ping_pong.wake_tsc = rdtsc_ordered();
+        ping_pong.turn = 2u*i + 1u;
+        thread_unpark(ping_pong.pong);
+        while(ping_pong.turn != 2u*i + 2u) {
+            thread_park();
+        }
+        ping_pong.total_wake_ticks += rdtsc_ordered() - ping_pong.wake_tsc;
+    }
+    bench_report("thread unpark to running", ping_pong.total_wake_ticks, 2u*SCHED_BENCH_PING_PONGS);
+}
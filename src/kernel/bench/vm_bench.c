@@ -0,0 +1,53 @@
+#include "bench.h"
+
+#include <kernel/mem/map_mem.h>
+#include <kernel/mem/phys/phys_mem_allocator.h>
+
+#define CONTEXT_SWITCH_BENCH_ITERATIONS 10000u
+#define CONTEXT_SWITCH_BENCH_PAGES 32u // touched after every switch, like a syscall touching its working set
+#define CONTEXT_SWITCH_BENCH_VIRT_ADDR 0x400000ULL
+
+static uint64_t bench_context_switch_round(struct address_space *const *const address_spaces) {
+    const uint64_t start = rdtsc();
+    for(uint32_t i = 0u; i < CONTEXT_SWITCH_BENCH_ITERATIONS; ++i) {
+        switch_address_space(address_spaces[i & 1u]);
+        for(uint32_t page = 0u; page < CONTEXT_SWITCH_BENCH_PAGES; ++page) {
+            (void)*(volatile const uint64_t*)(CONTEXT_SWITCH_BENCH_VIRT_ADDR + page*NORMAL_PAGE_SIZE);
+        }
+    }
+    const uint64_t ticks = rdtsc() - start;
+
+    switch_address_space(&kernel_address_space);
+    return ticks;
+}
+
+void bench_context_switch(void) {
+    struct address_space* address_spaces[2];
+    uint64_t pages[2][CONTEXT_SWITCH_BENCH_PAGES];
+
+    for(uint32_t i = 0u; i < 2u; ++i) {
+        address_spaces[i] = address_space_create();
+        for(uint32_t page = 0u; page < CONTEXT_SWITCH_BENCH_PAGES; ++page) {
+            pages[i][page] = phys_mem_allocate_page();
+            map_range(address_spaces[i], CONTEXT_SWITCH_BENCH_VIRT_ADDR + page*NORMAL_PAGE_SIZE, pages[i][page], NORMAL_PAGE_SIZE, VM_WRITEABLE);
+        }
+    }
+
+    if(vm_pcid_supported()) {
+        bench_report("context switch (PCID on)", bench_context_switch_round(address_spaces), CONTEXT_SWITCH_BENCH_ITERATIONS);
+        vm_set_pcid_enabled(false);
+    } else {
+        serial_writestring("bench: PCIDs are unsupported, only measuring without them.\n");
+    }
+    bench_report("context switch (PCID off)", bench_context_switch_round(address_spaces), CONTEXT_SWITCH_BENCH_ITERATIONS);
+    if(vm_pcid_supported()) {
+        vm_set_pcid_enabled(true);
+    }
+
+    for(uint32_t i = 0u; i < 2u; ++i) {
+        address_space_destroy(address_spaces[i]);
+        for(uint32_t page = 0u; page < CONTEXT_SWITCH_BENCH_PAGES; ++page) {
+            phys_mem_free_page(pages[i][page]);
+        }
+    }
+}
@@ -0,0 +1,253 @@
+#include "boot_info.h"
+
+#include <libc/required_libc_functions.h>
+#include <kernel/drivers/serial/serial.h>
+#include <kernel/error/error.h>
+#include <kernel/mem/map_mem.h>
+#include <kernel/mem/mem_constants.h>
+
+static struct boot_info boot_info;
+
+// the physical page that `early_single_page_virt_page_addr` currently maps for the parser
+static uint64_t window_phys_page;
+
+static const char *const multiboot_tag_names[NUMBER_OF_MULTIBOOT_TAG_TYPES] = {
+    [MULTIBOOT_TAG_TYPE_END] = "MULTIBOOT_TAG_TYPE_END",
+    [MULTIBOOT_TAG_TYPE_CMDLINE] = "MULTIBOOT_TAG_TYPE_CMDLINE",
+    [MULTIBOOT_TAG_TYPE_BOOT_LOADER_NAME] = "MULTIBOOT_TAG_TYPE_BOOT_LOADER_NAME",
+    [MULTIBOOT_TAG_TYPE_MODULE] = "MULTIBOOT_TAG_TYPE_MODULE",
+    [MULTIBOOT_TAG_TYPE_BASIC_MEMINFO] = "MULTIBOOT_TAG_TYPE_BASIC_MEMINFO",
+    [MULTIBOOT_TAG_TYPE_BOOTDEV] = "MULTIBOOT_TAG_TYPE_BOOTDEV",
+    [MULTIBOOT_TAG_TYPE_MMAP] = "MULTIBOOT_TAG_TYPE_MMAP",
+    [MULTIBOOT_TAG_TYPE_VBE] = "MULTIBOOT_TAG_TYPE_VBE",
+    [MULTIBOOT_TAG_TYPE_FRAMEBUFFER] = "MULTIBOOT_TAG_TYPE_FRAMEBUFFER",
+    [MULTIBOOT_TAG_TYPE_ELF_SECTIONS] = "MULTIBOOT_TAG_TYPE_ELF_SECTIONS",
+    [MULTIBOOT_TAG_TYPE_APM] = "MULTIBOOT_TAG_TYPE_APM",
+    [MULTIBOOT_TAG_TYPE_EFI32] = "MULTIBOOT_TAG_TYPE_EFI32",
+    [MULTIBOOT_TAG_TYPE_EFI64] = "MULTIBOOT_TAG_TYPE_EFI64",
+    [MULTIBOOT_TAG_TYPE_SMBIOS] = "MULTIBOOT_TAG_TYPE_SMBIOS",
+    [MULTIBOOT_TAG_TYPE_ACPI_OLD] = "MULTIBOOT_TAG_TYPE_ACPI_OLD",
+    [MULTIBOOT_TAG_TYPE_ACPI_NEW] = "MULTIBOOT_TAG_TYPE_ACPI_NEW",
+    [MULTIBOOT_TAG_TYPE_NETWORK] = "MULTIBOOT_TAG_TYPE_NETWORK",
+    [MULTIBOOT_TAG_TYPE_EFI_MMAP] = "MULTIBOOT_TAG_TYPE_EFI_MMAP",
+    [MULTIBOOT_TAG_TYPE_EFI_BS] = "MULTIBOOT_TAG_TYPE_EFI_BS",
+    [MULTIBOOT_TAG_TYPE_EFI32_IH] = "MULTIBOOT_TAG_TYPE_EFI32_IH",
+    [MULTIBOOT_TAG_TYPE_EFI64_IH] = "MULTIBOOT_TAG_TYPE_EFI64_IH",
+    [MULTIBOOT_TAG_TYPE_LOAD_BASE_ADDR] = "MULTIBOOT_TAG_TYPE_LOAD_BASE_ADDR",
+};
+
+// Copies `size` bytes starting at `phys_addr`. The window only gets remapped (and its TLB entry flushed) when the read
+//  moves onto another page, so a whole pass costs one `invlpg` per page of the structure and anything can straddle pages.
+static void read_phys(uint64_t phys_addr, void *const dest, uint64_t size) {
+    uint8_t* out = dest;
+    while(size > 0u) {
+        const uint64_t page = round_down_to_page(phys_addr);
+        if(page != window_phys_page) {
+            unconditional_map_page_in_first_2mib(page, early_single_page_virt_page_addr);
+            window_phys_page = page;
+        }
+
+        const uint64_t chunk = min(size, NORMAL_PAGE_SIZE - offset_in_page(phys_addr));
+        memcpy(out, (const void*)(early_single_page_virt_page_addr + offset_in_page(phys_addr)), chunk);
+        out += chunk;
+        phys_addr += chunk;
+        size -= chunk;
+    }
+}
+
+// the string payload of a tag starting `offset` bytes in, truncated to fit and always NUL-terminated
+static void read_tag_string(const uint64_t tag_phys_addr, const uint32_t tag_size, const uint32_t offset, char *const dest, const uint32_t capacity) {
+    const uint32_t length = (tag_size > offset) ? (uint32_t)min(tag_size - offset, capacity - 1u) : 0u;
+    read_phys(tag_phys_addr + offset, dest, length);
+    dest[length] = '\0';
+}
+
+static void parse_mmap(const uint64_t tag_phys_addr, const uint32_t tag_size) {
+    struct multiboot_tag_mmap header;
+    if(tag_size < sizeof(header)) {
+        halt_and_die("Multiboot mmap tag is too small.");
+    }
+    read_phys(tag_phys_addr, &header, sizeof(header));
+    if(header.entry_size < sizeof(struct multiboot_mmap_entry)) {
+        halt_and_die("Multiboot mmap entries are too small.");
+    }
+
+    const uint32_t number_of_entries = (tag_size - sizeof(header)) / header.entry_size;
+    if(number_of_entries > BOOT_INFO_MAX_MMAP_ENTRIES) {
+        halt_and_die("Too many memory map entries.");
+    }
+    // NOTE: `entry_size` may grow in later versions, so the entries are copied one by one and the rest of each entry is skipped.
+    for(uint32_t i = 0u; i < number_of_entries; ++i) {
+        read_phys(tag_phys_addr + sizeof(header) + (uint64_t)i*header.entry_size, &boot_info.mmap[i], sizeof(struct multiboot_mmap_entry));
+    }
+    boot_info.number_of_mmap_entries = number_of_entries;
+}
+
+static void parse_module(const uint64_t tag_phys_addr, const uint32_t tag_size) {
+    struct multiboot_tag_module header;
+    if(tag_size < sizeof(header)) {
+        halt_and_die("Multiboot module tag is too small.");
+    }
+    if(boot_info.number_of_modules == BOOT_INFO_MAX_MODULES) {
+        halt_and_die("Too many multiboot modules.");
+    }
+    read_phys(tag_phys_addr, &header, sizeof(header));
+
+    struct boot_module *const module = &boot_info.modules[boot_info.number_of_modules++];
+    module->start = header.mod_start;
+    module->end = header.mod_end;
+    read_tag_string(tag_phys_addr, tag_size, sizeof(header), module->cmdline, BOOT_INFO_MAX_MODULE_CMDLINE);
+}
+
+static void parse_framebuffer(const uint64_t tag_phys_addr, const uint32_t tag_size) {
+    struct multiboot_tag_framebuffer tag;
+    if(tag_size < sizeof(tag.common)) {
+        halt_and_die("Multiboot framebuffer tag is too small.");
+    }
+    memset(&tag, 0, sizeof(tag));
+    read_phys(tag_phys_addr, &tag, min(tag_size, sizeof(tag)));
+
+    boot_info.has_framebuffer = true;
+    boot_info.framebuffer = (struct boot_framebuffer) {
+        .phys_addr = tag.common.framebuffer_addr,
+        .pitch = tag.common.framebuffer_pitch,
+        .width = tag.common.framebuffer_width,
+        .height = tag.common.framebuffer_height,
+        .bpp = tag.common.framebuffer_bpp,
+        .type = tag.common.framebuffer_type,
+    };
+    if(tag.common.framebuffer_type == MULTIBOOT_FRAMEBUFFER_TYPE_RGB) {
+        boot_info.framebuffer.red_field_position = tag.framebuffer_red_field_position;
+        boot_info.framebuffer.red_mask_size = tag.framebuffer_red_mask_size;
+        boot_info.framebuffer.green_field_position = tag.framebuffer_green_field_position;
+        boot_info.framebuffer.green_mask_size = tag.framebuffer_green_mask_size;
+        boot_info.framebuffer.blue_field_position = tag.framebuffer_blue_field_position;
+        boot_info.framebuffer.blue_mask_size = tag.framebuffer_blue_mask_size;
+    }
+}
+
+static void parse_rsdp(const uint64_t tag_phys_addr, const uint32_t tag_size) {
+    const uint32_t size = (uint32_t)min(tag_size - sizeof(struct multiboot_tag), BOOT_INFO_MAX_RSDP_SIZE);
+    read_phys(tag_phys_addr + sizeof(struct multiboot_tag), boot_info.rsdp, size);
+    boot_info.rsdp_size = size;
+}
+
+static void parse_efi_mmap(const uint64_t tag_phys_addr, const uint32_t tag_size) {
+    struct multiboot_tag_efi_mmap header;
+    if(tag_size < sizeof(header)) {
+        halt_and_die("Multiboot EFI mmap tag is too small.");
+    }
+    read_phys(tag_phys_addr, &header, sizeof(header));
+
+    boot_info.has_efi_mmap = true;
+    boot_info.efi_mmap = (struct boot_efi_mmap) { tag_phys_addr + sizeof(header), tag_size - (uint32_t)sizeof(header), header.descr_size, header.descr_vers };
+}
+
+const struct boot_info* boot_info_init(const uint64_t mboot_header_phys_addr) {
+    memset(&boot_info, 0, sizeof(boot_info));
+    window_phys_page = UINT64_MAX;
+
+    // the fixed part is `total_size` and a reserved field, the tags follow
+    uint32_t fixed_part[2];
+    read_phys(mboot_header_phys_addr, fixed_part, sizeof(fixed_part));
+    boot_info.phys_addr = mboot_header_phys_addr;
+    boot_info.total_size = fixed_part[0];
+
+    const uint64_t end = mboot_header_phys_addr + boot_info.total_size;
+    uint64_t tag_phys_addr = mboot_header_phys_addr + sizeof(fixed_part);
+    bool found_end_tag = false;
+    bool has_new_rsdp = false;
+
+    while(tag_phys_addr + sizeof(struct multiboot_tag) <= end) {
+        struct multiboot_tag tag;
+        read_phys(tag_phys_addr, &tag, sizeof(tag));
+        if(tag.size < sizeof(tag) || tag_phys_addr + tag.size > end) {
+            halt_and_die("Multiboot tag has invalid size.");
+        }
+
+        if(tag.type < NUMBER_OF_MULTIBOOT_TAG_TYPES) {
+            ++boot_info.tag_counts[tag.type];
+        } else {
+            ++boot_info.number_of_unknown_tags;
+        }
+
+        if(tag.type == MULTIBOOT_TAG_TYPE_END) {
+            found_end_tag = true;
+            break;
+        }
+
+        switch(tag.type) {
+            case MULTIBOOT_TAG_TYPE_CMDLINE:
+                read_tag_string(tag_phys_addr, tag.size, sizeof(tag), boot_info.cmdline, BOOT_INFO_MAX_CMDLINE);
+                break;
+            case MULTIBOOT_TAG_TYPE_BOOT_LOADER_NAME:
+                read_tag_string(tag_phys_addr, tag.size, sizeof(tag), boot_info.boot_loader_name, BOOT_INFO_MAX_BOOT_LOADER_NAME);
+                break;
+            case MULTIBOOT_TAG_TYPE_MODULE:
+                parse_module(tag_phys_addr, tag.size);
+                break;
+            case MULTIBOOT_TAG_TYPE_MMAP:
+                parse_mmap(tag_phys_addr, tag.size);
+                break;
+            case MULTIBOOT_TAG_TYPE_FRAMEBUFFER:
+                parse_framebuffer(tag_phys_addr, tag.size);
+                break;
+            case MULTIBOOT_TAG_TYPE_ACPI_OLD:
+                if(!has_new_rsdp) {
+                    parse_rsdp(tag_phys_addr, tag.size);
+                }
+                break;
+            case MULTIBOOT_TAG_TYPE_ACPI_NEW:
+                parse_rsdp(tag_phys_addr, tag.size);
+                has_new_rsdp = true;
+                break;
+            case MULTIBOOT_TAG_TYPE_EFI_MMAP:
+                parse_efi_mmap(tag_phys_addr, tag.size);
+                break;
+            default:
+                break;
+        }
+
+        tag_phys_addr += round_up(tag.size, MULTIBOOT_TAG_ALIGN);
+    }
+
+    if(!found_end_tag) {
+        halt_and_die("Multiboot structure has no end tag.");
+    }
+    if(boot_info.number_of_mmap_entries == 0u) {
+        halt_and_die("Memory map not found.");
+    }
+
+    return &boot_info;
+}
+
+uint64_t boot_info_end_of_used_memory(const struct boot_info *const info) {
+    uint64_t end = info->phys_addr + info->total_size;
+    for(uint32_t i = 0u; i < info->number_of_modules; ++i) {
+        end = max(end, info->modules[i].end);
+    }
+    return end;
+}
+
+void boot_info_print_tags(const struct boot_info *const info) {
+    char str_buf[32];
+
+    serial_writestring("All multiboot tags found: {\n");
+    for(uint32_t type = 0u; type < NUMBER_OF_MULTIBOOT_TAG_TYPES; ++type) {
+        if(type == MULTIBOOT_TAG_TYPE_END || info->tag_counts[type] == 0u) {
+            continue;
+        }
+        serial_writestring(multiboot_tag_names[type]);
+        if(info->tag_counts[type] > 1u) {
+            serial_writestring(" x");
+            serial_writestring(print_digits(info->tag_counts[type], str_buf));
+        }
+        serial_writestring("\n");
+    }
+    if(info->number_of_unknown_tags > 0u) {
+        serial_writestring("Unknown types: ");
+        serial_writestring(print_digits(info->number_of_unknown_tags, str_buf));
+        serial_writestring("\n");
+    }
+    serial_writestring("}\n");
+}
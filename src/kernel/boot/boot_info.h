@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "multiboot.h"
+
+// Everything the kernel needs from the multiboot2 structure, gathered in one pass over its tags.
+//  The parts that are read during boot are copied, so they stay valid no matter what the early page mapping is,
+//  and every consumer reads them in O(1) instead of walking the tag list again.
+// NOTE: The EFI memory map is too big to copy and is only needed once the linear map exists, so only its location is kept.
+
+#define BOOT_INFO_MAX_MMAP_ENTRIES 256u
+#define BOOT_INFO_MAX_MODULES 16u
+#define BOOT_INFO_MAX_CMDLINE 256u
+#define BOOT_INFO_MAX_MODULE_CMDLINE 64u
+#define BOOT_INFO_MAX_BOOT_LOADER_NAME 64u
+#define BOOT_INFO_MAX_RSDP_SIZE 64u // the ACPI 2.0+ RSDP is 36 bytes
+#define NUMBER_OF_MULTIBOOT_TAG_TYPES (MULTIBOOT_TAG_TYPE_LOAD_BASE_ADDR + 1u)
+
+struct boot_module {
+    uint64_t start; // physical
+    uint64_t end; // physical, exclusive
+    char cmdline[BOOT_INFO_MAX_MODULE_CMDLINE]; // truncated if longer
+};
+
+struct boot_framebuffer {
+    uint64_t phys_addr;
+    uint32_t pitch; // in bytes
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t type; // `MULTIBOOT_FRAMEBUFFER_TYPE_*`
+    // only meaningful for `MULTIBOOT_FRAMEBUFFER_TYPE_RGB`
+    uint8_t red_field_position;
+    uint8_t red_mask_size;
+    uint8_t green_field_position;
+    uint8_t green_mask_size;
+    uint8_t blue_field_position;
+    uint8_t blue_mask_size;
+};
+
+struct boot_efi_mmap {
+    uint64_t phys_addr; // of the first descriptor
+    uint32_t size; // in bytes
+    uint32_t descriptor_size;
+    uint32_t descriptor_version;
+};
+
+struct boot_info {
+    uint64_t phys_addr; // of the multiboot structure
+    uint32_t total_size;
+
+    uint32_t number_of_mmap_entries;
+    struct multiboot_mmap_entry mmap[BOOT_INFO_MAX_MMAP_ENTRIES];
+
+    uint32_t number_of_modules;
+    struct boot_module modules[BOOT_INFO_MAX_MODULES]; // in the order the boot loader passed them
+
+    bool has_framebuffer;
+    struct boot_framebuffer framebuffer;
+
+    // a copy of the RSDP from the ACPI_NEW tag, or from the ACPI_OLD tag if there is no ACPI_NEW tag, `rsdp_size` is 0 without either
+    uint32_t rsdp_size;
+    uint8_t rsdp[BOOT_INFO_MAX_RSDP_SIZE] __attribute__((aligned(8)));
+
+    bool has_efi_mmap;
+    struct boot_efi_mmap efi_mmap;
+
+    char cmdline[BOOT_INFO_MAX_CMDLINE]; // empty without a cmdline tag, truncated if longer
+    char boot_loader_name[BOOT_INFO_MAX_BOOT_LOADER_NAME];
+
+    uint16_t tag_counts[NUMBER_OF_MULTIBOOT_TAG_TYPES]; // how many tags of each type there were
+    uint32_t number_of_unknown_tags;
+};
+
+// Parses the multiboot structure through `early_single_page_virt_page_addr`, so it can run before the linear map exists.
+//  Must be called after `early_single_page_virt_page_init()` and `apply_alternatives()`.
+//  Dies if the structure is malformed or has more mmap entries or modules than there is room for.
+const struct boot_info* boot_info_init(uint64_t mboot_header_phys_addr);
+
+// The physical address right after the multiboot structure and every module.
+uint64_t boot_info_end_of_used_memory(const struct boot_info* info);
+
+// Prints which tags were found and how many of each.
+void boot_info_print_tags(const struct boot_info* info);
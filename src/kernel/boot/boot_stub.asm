@@ -120,16 +120,29 @@ EFLAGS_ID_BIT equ 1 << 21
 
 CPUID_EXTENSIONS equ 0x80000000
 CPUID_EXTENSIONS_FEATURES equ 0x80000001
+CPUID_EXTENSIONS_ADDRESS_SIZES equ 0x80000008
 CPUID_EDX_EXTENSION_FEATURE_LONG_MODE equ 1 << 29
+CPUID_EDX_EXTENSION_FEATURE_NX equ 1 << 20
+
+CPUID_STRUCTURED_EXTENDED_FEATURES equ 7
+CPUID_ECX_STRUCTURED_FEATURE_LA57 equ 1 << 16
+
+; The 4-level direct map can use PML4 entries [256, 509], which is 254 * 512GiB (just under 2^47 bytes). Entry 510 holds
+;  the kernel regions (KERNEL_REGIONS_TOP_LEVEL_INDEX) and 511 the kernel image.
+;  So we only switch to 5-level paging when the CPU can physically address more than 2^46 bytes.
+MAX_PHYSICAL_ADDRESS_BITS_FOR_4_LEVEL_PAGING equ 46
 
 PAE_ENABLE_BIT equ 1 << 5
 MACHINE_CHECK_ENABLE_BIT equ 1 << 6
 GLOBAL_PAGE_ENABLE_BIT equ 1 << 7
+LA57_ENABLE_BIT equ 1 << 12
 
 IA32_EFER equ 0xC0000080
 IA32_EFER_LME_BIT equ 1 << 8
+IA32_EFER_NXE_BIT equ 1 << 11
 
 PAGING_ENABLE_BIT equ 1 << 31
+WRITE_PROTECT_BIT equ 1 << 16
 
 KERNEL_OFFSET equ 0xFFFFFFFF80000000
 
@@ -182,6 +195,11 @@ pml4t:
 resb PAGE_SIZE
 pdpt:
 resb PAGE_SIZE
+
+global pml5t
+align PAGE_SIZE
+pml5t: ; only used with 5-level paging, where it points to `pml4t` for both the identity map and the higher half
+resb PAGE_SIZE
 pdt:
 resb PAGE_SIZE
 pt:
@@ -247,6 +265,58 @@ check_support_for_long_mode:
     .no_long_mode:
         jmp boot_die
 
+; sets `paging_levels` to 5 if the CPU supports LA57 and can address more physical memory than the 4-level direct map can hold, otherwise sets it to 4
+extern paging_levels
+BITS 32
+select_paging_levels:
+    mov DWORD [V2P(paging_levels)], 4
+
+    xor ecx, ecx
+    xor eax, eax
+    cpuid
+    cmp eax, CPUID_STRUCTURED_EXTENDED_FEATURES
+    jb .done
+
+    xor ecx, ecx
+    mov eax, CPUID_STRUCTURED_EXTENDED_FEATURES
+    cpuid
+    test ecx, CPUID_ECX_STRUCTURED_FEATURE_LA57
+    jz .done
+
+    xor ecx, ecx
+    mov eax, CPUID_EXTENSIONS
+    cpuid
+    cmp eax, CPUID_EXTENSIONS_ADDRESS_SIZES
+    jb .done
+
+    xor ecx, ecx
+    mov eax, CPUID_EXTENSIONS_ADDRESS_SIZES
+    cpuid
+    and eax, 0xFF ; eax[7:0] = MAXPHYADDR
+    cmp eax, MAX_PHYSICAL_ADDRESS_BITS_FOR_4_LEVEL_PAGING
+    jbe .done
+
+    mov DWORD [V2P(paging_levels)], 5
+    .done:
+        ret
+
+; NX is needed for the execute-disable bit in the direct map, which would otherwise be a reserved bit and fault
+BITS 32
+enable_nx_if_supported:
+    xor ecx, ecx
+    mov eax, CPUID_EXTENSIONS_FEATURES
+    cpuid
+
+    test edx, CPUID_EDX_EXTENSION_FEATURE_NX
+    jz .done
+
+    mov ecx, IA32_EFER
+    rdmsr
+    or eax, IA32_EFER_NXE_BIT
+    wrmsr
+    .done:
+        ret
+
 global _start
 BITS 32
 _start:
@@ -259,9 +329,11 @@ _start:
     push ebx ; mboot header
     push eax ; mboot magic
 
-    extern multiboot_total_size
-    mov ecx, [ebx] ; We read this here since paging is disabled. This is more elegant than mapping a page just to read the multiboot size (and then mapping the rest afterwards).
-    mov [V2P(multiboot_total_size)], ecx
+    ; the start of the boot timeline, see boot_timing.h (the magic in EAX was just pushed, and EDX holds nothing yet)
+    extern boot_start_tsc
+    rdtsc
+    mov [V2P(boot_start_tsc)], eax
+    mov [V2P(boot_start_tsc) + 4], edx
 
     lgdt [V2P(gdt_ptr)]
 
@@ -276,6 +348,7 @@ _start:
 
     call check_cpuid
     call check_support_for_long_mode
+    call select_paging_levels
 
     ; this is optional and sets up the Page Attribution Table (PAT) as follows:
     ; PAT0 = 0x06 (Write-back)
@@ -293,6 +366,10 @@ _start:
 
     mov eax, cr4
     or eax, PAE_ENABLE_BIT | MACHINE_CHECK_ENABLE_BIT | GLOBAL_PAGE_ENABLE_BIT
+    cmp DWORD [V2P(paging_levels)], 5
+    jne .set_cr4
+    or eax, LA57_ENABLE_BIT ; this can only be changed while paging is disabled
+.set_cr4:
     mov cr4, eax
 
     mov ecx, IA32_EFER
@@ -300,6 +377,8 @@ _start:
     or eax, IA32_EFER_LME_BIT
     wrmsr
 
+    call enable_nx_if_supported
+
     ; zero out the page tables:
     mov edi, V2P(pml4t)
     xor eax, eax
@@ -360,11 +439,24 @@ _start:
     ;     edi += SIZEOF_PT_ENTRY/4; // divided by 4 since `edi` is a pointer to a 4-byte value (so `+= 1` increments the address by 4)
     ; }
 
+    cmp DWORD [V2P(paging_levels)], 5
+    jne .four_level_paging
+
+    mov edi, V2P(pml5t)
+    mov eax, V2P(pml4t)
+    or eax, PT_PRESENT | PT_WRITEABLE
+    mov DWORD [edi], eax ; identity map
+    mov DWORD [edi + 511 * SIZEOF_PT_ENTRY], eax ; higher half map
+
+    mov edi, V2P(pml5t)
+    jmp .load_cr3
+.four_level_paging:
     mov edi, V2P(pml4t)
+.load_cr3:
     mov cr3, edi
 
     mov eax, cr0
-    or eax, PAGING_ENABLE_BIT
+    or eax, PAGING_ENABLE_BIT | WRITE_PROTECT_BIT ; WP makes ring 0 writes fault on read-only pages too, e.g. the shared zero page
     mov cr0, eax
 
     pop ecx ; mboot magic
@@ -399,7 +491,11 @@ higher_half_long_mode:
     mov rdi, pdpt ; use the higher half virtual address since we just removed the identity map entry
     mov QWORD [rdi], 0 ; remove identity mapping
 
-    mov rdi, V2P(pml4t)
+    mov rdi, pml5t
+    mov QWORD [rdi], 0 ; remove identity mapping (this is a no-op with 4-level paging)
+
+    ; reload whichever root table we are using to flush the identity mapping out of the TLB
+    mov rdi, cr3
     mov cr3, rdi
 
     mov rdi, rcx    ; first arg = mboot magic
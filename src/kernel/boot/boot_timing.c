@@ -0,0 +1,68 @@
+#include "boot_timing.h"
+
+#include <libc/required_libc_functions.h>
+#include <kernel/cpu/cpu.h>
+#include <kernel/drivers/serial/serial.h>
+#include <kernel/io/port_io.h>
+#include <kernel/time/clocksource.h>
+#include <kernel/trace/trace.h>
+
+#define BOOT_TIMING_NAME_COLUMN 40u
+
+struct boot_phase {
+    const char* name;
+    uint64_t end_tsc;
+};
+
+uint64_t boot_start_tsc;
+
+static struct boot_phase boot_phases[MAX_BOOT_PHASES];
+static uint32_t number_of_boot_phases;
+
+void boot_phase_end(const char *const name) {
+    // NOTE: Stamps past the end are dropped, since this runs before anything could report the overflow.
+    if(number_of_boot_phases < MAX_BOOT_PHASES) {
+        boot_phases[number_of_boot_phases++] = (struct boot_phase){ name, rdtsc_ordered() };
+    }
+    // NOTE: Only phases that end after `trace_init_cpu()` show up in the trace.
+    TRACE(TRACE_BOOT_PHASE, name, 0u);
+}
+
+static void write_padded(const char *const text, const uint32_t width) {
+    serial_writestring(text);
+    for(size_t length = strlen(text); length < width; ++length) {
+        serial_writestring(" ");
+    }
+}
+
+static void write_ns_column(const uint64_t ns) {
+    char str_buf[32];
+    print_digits(ns, str_buf);
+    write_padded(str_buf, 16u);
+}
+
+void boot_timing_print(void) {
+    serial_writestring("Boot timeline (ns since _start):\n");
+    write_padded("  phase", BOOT_TIMING_NAME_COLUMN);
+    write_padded("took", 16u);
+    serial_writestring("ended at\n");
+
+    uint64_t previous_tsc = boot_start_tsc;
+    for(uint32_t i = 0u; i < number_of_boot_phases; ++i) {
+        serial_writestring("  ");
+        write_padded(boot_phases[i].name, BOOT_TIMING_NAME_COLUMN - 2u);
+        write_ns_column(tsc_ticks_to_ns(boot_phases[i].end_tsc - previous_tsc));
+        write_ns_column(tsc_ticks_to_ns(boot_phases[i].end_tsc - boot_start_tsc));
+        serial_writestring("\n");
+        previous_tsc = boot_phases[i].end_tsc;
+    }
+
+    write_padded("  total", BOOT_TIMING_NAME_COLUMN);
+    write_ns_column(tsc_ticks_to_ns(previous_tsc - boot_start_tsc));
+    serial_writestring("\n");
+}
+
+void qemu_debug_exit(const uint8_t code) {
+    serial_flush();
+    outb(QEMU_DEBUG_EXIT_PORT, code);
+}
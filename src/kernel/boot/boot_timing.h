@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+// Where boot time goes: the boot stub takes the TSC as one of the first things in `_start`, and `kernel_main()` stamps the end of each phase.
+//  Stamping is just an `rdtsc`, so it works from the first line of `kernel_main()` on. The ticks are only turned into nanoseconds
+//  for the summary, once the clocksource knows the TSC frequency.
+
+#define MAX_BOOT_PHASES 32u
+
+extern uint64_t boot_start_tsc; // written by boot_stub.asm
+
+// Ends the current phase (which began at the previous stamp, or at `_start`). `name` must be a string literal.
+void boot_phase_end(const char* name);
+
+// QEMU's isa-debug-exit device (which `make boot_time` adds) quits with exit status (code << 1) | 1 once this port is written.
+//  Without the device nothing is listening on the port, so the write does nothing.
+#define QEMU_DEBUG_EXIT_PORT 0xF4u
+
+// Prints one table with how long each phase took and when it ended. Must be called after `clocksource_init()`.
+void boot_timing_print(void);
+
+// Flushes serial and writes `code` to `QEMU_DEBUG_EXIT_PORT`.
+void qemu_debug_exit(uint8_t code);
@@ -1,61 +1,53 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include <kernel/cpu/alternatives.h>
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/cpu_features.h>
+#include <kernel/cpu/gdt.h>
+#include <kernel/cpu/percpu.h>
+#include <kernel/cpu/smp.h>
+#include <kernel/drivers/framebuffer/console.h>
+#include <kernel/drivers/framebuffer/framebuffer.h>
 #include <kernel/drivers/serial/serial.h>
 #include <kernel/error/error.h>
 
 #include <kernel/mem/mem_constants.h>
 #include <kernel/mem/map_mem.h>
 #include <kernel/mem/early_boot/early_boot_allocator.h>
+#include <kernel/mem/numa/numa.h>
 #include <kernel/mem/phys/phys_mem_allocator.h>
+#include <kernel/mem/slab/slab.h>
+#include <kernel/mem/tlb/tlb_shootdown.h>
+#include <kernel/mem/vm/vm_region.h>
 
 #include <kernel/acpi/acpi_tables.h>
-
-#include "multiboot.h"
-
-struct ramdisk_metadata {
-    uint64_t mod_start;
-    uint64_t mod_end;
-};
-
-// this will also setup the temporary virtual memory mapping for the memory map at `(early_single_page_virt_page_addr + offset_in_page(mmap_physical_addr))`
-static uint64_t get_memory_map(const uint64_t mboot_header_phys_addr) {
-    uint64_t current_phys_ptr = mboot_header_phys_addr + 2*sizeof(multiboot_uint32_t);
-
-    for(;;) {
-        const struct multiboot_tag *const current_virt_ptr = (struct multiboot_tag*) (early_single_page_virt_page_addr + offset_in_page(current_phys_ptr));
-        unconditional_map_page_in_first_2mib(current_phys_ptr, (uint64_t)current_virt_ptr);
-
-        if(current_virt_ptr->type == MULTIBOOT_TAG_TYPE_END) break;
-
-        if(current_virt_ptr->type == MULTIBOOT_TAG_TYPE_MMAP) {
-            // NOTE: The memory map is not guaranteed to be a single page, so we should replace the below check with the same traversal logic we used above when reading it later
-            const uint64_t mmap_base = (uint64_t)current_virt_ptr;
-            const uint64_t mmap_end = mmap_base + current_virt_ptr->size - 1u;
-
-            if(round_down_to_page(mmap_base) != round_down_to_page(mmap_end)) {
-                halt_and_die("mmap crosses multiple pages.");
-            }
-
-            return current_phys_ptr;
-        }
-
-        current_phys_ptr = (uint64_t)(current_phys_ptr  + round_up(current_virt_ptr->size, MULTIBOOT_TAG_ALIGN));
-    }
-
-    halt_and_die("Memory map not found.");
-}
+#include <kernel/fs/initrd.h>
+#include <kernel/interrupts/idt.h>
+#include <kernel/interrupts/apic/apic.h>
+#include <kernel/interrupts/apic/ioapic.h>
+#include <kernel/sched/sched.h>
+#include <kernel/time/clocksource.h>
+#include <kernel/time/timer.h>
+#include <kernel/trace/trace.h>
+
+#ifdef KERNEL_BENCHMARKS
+#include <kernel/bench/bench.h>
+#endif
+
+#include "boot_info.h"
+#include "boot_timing.h"
 
 struct memory_size_info {
     uint64_t total_available_memory;
     uint64_t amount_to_map;
 };
 
-static struct memory_size_info get_memory_size_info(const struct multiboot_tag_mmap *const memory_map_virtual_ptr) {
+static struct memory_size_info get_memory_size_info(const struct boot_info *const boot_info) {
     uint64_t total_available_memory = 0u;
     uint64_t amount_to_map = 0u;
-    for(uint32_t i = 0; i < (memory_map_virtual_ptr->size - sizeof(struct multiboot_tag_mmap))/memory_map_virtual_ptr->entry_size; ++i) {
-        const struct multiboot_mmap_entry current_entry = memory_map_virtual_ptr->entries[i];
+    for(uint32_t i = 0; i < boot_info->number_of_mmap_entries; ++i) {
+        const struct multiboot_mmap_entry current_entry = boot_info->mmap[i];
         if(current_entry.type == MULTIBOOT_MEMORY_AVAILABLE) {
             total_available_memory += current_entry.len;
         }
@@ -70,11 +62,11 @@ static struct memory_size_info get_memory_size_info(const struct multiboot_tag_m
     return (struct memory_size_info) { total_available_memory, amount_to_map };
 }
 
-static void print_memory_map(const struct multiboot_tag_mmap *const memory_map_virtual_ptr, const struct memory_size_info mem_size_info) {
+static void print_memory_map(const struct boot_info *const boot_info, const struct memory_size_info mem_size_info) {
     char str_buf[128];
     serial_writestring("Memory map:\n");
-    for(uint32_t i = 0; i < (memory_map_virtual_ptr->size - sizeof(struct multiboot_tag_mmap))/memory_map_virtual_ptr->entry_size; ++i) {
-        const struct multiboot_mmap_entry current_entry = memory_map_virtual_ptr->entries[i];
+    for(uint32_t i = 0; i < boot_info->number_of_mmap_entries; ++i) {
+        const struct multiboot_mmap_entry current_entry = boot_info->mmap[i];
         serial_writestring("mmap_entry : { [");
         serial_writestring(print_hex(current_entry.addr, str_buf)); // TODO: Print hex
         serial_writestring("--");
@@ -108,46 +100,95 @@ static void print_memory_map(const struct multiboot_tag_mmap *const memory_map_v
     serial_writestring(".\n");
 }
 
-static uint64_t setup_linear_mapping(const struct multiboot_tag_mmap *const memory_map_virtual_ptr, const struct memory_size_info mem_size_info) {
-    const uint64_t number_of_huge_pages = round_up(mem_size_info.amount_to_map, HUGE_PAGE_1GIB)/HUGE_PAGE_1GIB;
-    const uint64_t number_of_pdpte_pages = round_up(number_of_huge_pages, 512)/512ULL;
-    if(number_of_pdpte_pages != 1) {
-        halt_and_die("More than 512GiB of memory detected.");
-    }
+struct linear_mapping_tables {
+    uint64_t phys_addr;
+    uint64_t size;
+};
 
-    const uint64_t pdpte_phys_page_addr = early_boot_alloc(memory_map_virtual_ptr, number_of_pdpte_pages*NORMAL_PAGE_SIZE);
-    uint64_t *const pdpte_virtual_page_ptr = (uint64_t*)early_single_page_virt_page_addr;
-    unconditional_map_page_in_first_2mib(pdpte_phys_page_addr, early_single_page_virt_page_addr);
+// The entries of every table in the linear map form an arithmetic sequence, so each table is just a start value and a stride.
+static void fill_linear_mapping_table(const uint64_t table_phys_addr, const uint64_t first_entry, const uint64_t entry_stride, const uint64_t number_of_entries) {
+    uint64_t *const table_virtual_page_ptr = (uint64_t*)early_single_page_virt_page_addr;
+    unconditional_map_page_in_first_2mib(table_phys_addr, early_single_page_virt_page_addr);
     memset((void*)early_single_page_virt_page_addr, 0, NORMAL_PAGE_SIZE);
-    for(uint64_t i = 0; i < number_of_huge_pages; ++i) {
-        pdpte_virtual_page_ptr[i] = (HUGE_PAGE_1GIB * i) | PDPTE_PRESENT | PDPTE_WRITEABLE | PDPTE_HUGE_PAGE | PDPTE_GLOBAL_PAGE | PDPTE_DISABLE_EXECUTE;
+    for(uint64_t i = 0; i < number_of_entries; ++i) {
+        table_virtual_page_ptr[i] = first_entry + entry_stride*i;
+    }
+}
+
+static struct linear_mapping_tables setup_linear_mapping(const struct boot_info *const boot_info, const struct memory_size_info mem_size_info) {
+    const bool has_1gib_pages = cpu_has(X86_FEATURE_1GIB_PAGES);
+    const uint64_t disable_execute = cpu_has(X86_FEATURE_NX) ? PDPTE_DISABLE_EXECUTE : 0u; // the boot stub only enables NX if it is supported
+    const uint64_t huge_page_flags = PDPTE_PRESENT | PDPTE_WRITEABLE | PDPTE_HUGE_PAGE | PDPTE_GLOBAL_PAGE | disable_execute;
+
+    direct_map_offset = (paging_levels == 5u) ? DIRECT_MAP_OFFSET_5_LEVEL : DIRECT_MAP_OFFSET_4_LEVEL;
+
+    // without 1GiB page support, every 1GiB region gets a PDT full of 2MiB pages instead
+    const uint64_t number_of_1gib_regions = round_up(mem_size_info.amount_to_map, HUGE_PAGE_1GIB)/HUGE_PAGE_1GIB;
+    const uint64_t number_of_pdt_pages = has_1gib_pages ? 0u : number_of_1gib_regions;
+    const uint64_t number_of_pdpte_pages = round_up(number_of_1gib_regions, 512)/512ULL;
+    const uint64_t number_of_pml4_pages = (paging_levels == 5u) ? round_up(number_of_pdpte_pages, 512)/512ULL : 0u;
+    const uint64_t number_of_top_level_entries = (paging_levels == 5u) ? number_of_pml4_pages : number_of_pdpte_pages;
+    if(number_of_top_level_entries > DIRECT_MAP_MAX_TOP_LEVEL_ENTRIES) {
+        halt_and_die("Too much memory for the direct map.");
     }
-    uint64_t *const pml4_virt_addr = (uint64_t*)(KERNEL_VIRT_OFFSET + PM4LT_PHYS_ADDR);
-    pml4_virt_addr[256] = (pdpte_phys_page_addr & PT_ADDR_MASK) | PT_PRESENT | PT_WRITEABLE;
 
-    reload_cr3(PM4LT_PHYS_ADDR);
-    return pdpte_phys_page_addr;
+    const uint64_t total_number_of_table_pages = number_of_pdt_pages + number_of_pdpte_pages + number_of_pml4_pages;
+    const uint64_t tables_phys_addr = early_boot_alloc(boot_info, total_number_of_table_pages*NORMAL_PAGE_SIZE);
+    const uint64_t pdt_phys_addr = tables_phys_addr;
+    const uint64_t pdpte_phys_addr = pdt_phys_addr + number_of_pdt_pages*NORMAL_PAGE_SIZE;
+    const uint64_t pml4_phys_addr = pdpte_phys_addr + number_of_pdpte_pages*NORMAL_PAGE_SIZE;
+
+    for(uint64_t i = 0; i < number_of_pdt_pages; ++i) {
+        fill_linear_mapping_table(pdt_phys_addr + i*NORMAL_PAGE_SIZE, (HUGE_PAGE_1GIB * i) | huge_page_flags, HUGE_PAGE_2MIB, 512);
+    }
+    for(uint64_t i = 0; i < number_of_pdpte_pages; ++i) {
+        const uint64_t number_of_entries = min(number_of_1gib_regions - 512ULL*i, 512);
+        if(has_1gib_pages) {
+            fill_linear_mapping_table(pdpte_phys_addr + i*NORMAL_PAGE_SIZE, (HUGE_PAGE_1GIB * 512ULL * i) | huge_page_flags, HUGE_PAGE_1GIB, number_of_entries);
+        }
+        else {
+            fill_linear_mapping_table(pdpte_phys_addr + i*NORMAL_PAGE_SIZE, (pdt_phys_addr + NORMAL_PAGE_SIZE * 512ULL * i) | PT_PRESENT | PT_WRITEABLE, NORMAL_PAGE_SIZE, number_of_entries);
+        }
+    }
+    for(uint64_t i = 0; i < number_of_pml4_pages; ++i) {
+        const uint64_t number_of_entries = min(number_of_pdpte_pages - 512ULL*i, 512);
+        fill_linear_mapping_table(pml4_phys_addr + i*NORMAL_PAGE_SIZE, (pdpte_phys_addr + NORMAL_PAGE_SIZE * 512ULL * i) | PT_PRESENT | PT_WRITEABLE, NORMAL_PAGE_SIZE, number_of_entries);
+    }
+
+    uint64_t *const top_level_virt_addr = (uint64_t*)(KERNEL_VIRT_OFFSET + kernel_root_page_table_phys_addr());
+    const uint64_t first_second_level_phys_addr = (paging_levels == 5u) ? pml4_phys_addr : pdpte_phys_addr;
+    for(uint64_t i = 0; i < number_of_top_level_entries; ++i) {
+        top_level_virt_addr[DIRECT_MAP_FIRST_TOP_LEVEL_INDEX + i] = ((first_second_level_phys_addr + NORMAL_PAGE_SIZE*i) & PT_ADDR_MASK) | PT_PRESENT | PT_WRITEABLE;
+    }
+
+    reload_cr3(kernel_root_page_table_phys_addr());
+    return (struct linear_mapping_tables) { tables_phys_addr, total_number_of_table_pages*NORMAL_PAGE_SIZE };
 }
 
-static void reserve_unavailable_physical_memory(const uint64_t mboot_header_phys_addr, const uint64_t mmap_physical_addr, const struct memory_size_info mem_size_info, const struct ramdisk_metadata ramdisk_metadata, const uint64_t pdpte_phys_page_addr) {
+static void reserve_unavailable_physical_memory(const struct boot_info *const boot_info, const struct memory_size_info mem_size_info, const struct linear_mapping_tables linear_mapping_tables) {
     const uint64_t total_number_of_pages = round_down_to_page(mem_size_info.amount_to_map)/NORMAL_PAGE_SIZE;
     const uint64_t total_number_of_pages_rounded_up = round_up(total_number_of_pages, 64ULL);
     const uint64_t total_number_of_uint64t_entries = total_number_of_pages_rounded_up/64ULL;
     const uint64_t total_number_of_excess_pages = total_number_of_pages_rounded_up - total_number_of_pages;
-    const uint64_t phys_mem_physical_memory = early_boot_alloc((struct multiboot_tag_mmap*) GENERAL_MEM_P2V(mmap_physical_addr), total_number_of_uint64t_entries*sizeof(uint64_t));
+    const uint64_t phys_mem_physical_memory = early_boot_alloc(boot_info, total_number_of_uint64t_entries*sizeof(uint64_t));
+    const uint64_t buddy_page_orders_physical_memory = early_boot_alloc(boot_info, total_number_of_pages_rounded_up);
 
-    phys_mem_alloc_init((uint64_t*)GENERAL_MEM_P2V(phys_mem_physical_memory), total_number_of_uint64t_entries);
+    phys_mem_alloc_init((uint64_t*)GENERAL_MEM_P2V(phys_mem_physical_memory), total_number_of_uint64t_entries, (uint8_t*)GENERAL_MEM_P2V(buddy_page_orders_physical_memory));
+    boot_phase_end("phys bitmap init");
 
     phys_mem_reserve_pages(0x00100000ULL, KERNEL_V2P((uint64_t)&kernel_end) - 0x00100000ULL);
-    phys_mem_reserve_pages(mboot_header_phys_addr, multiboot_total_size);
+    phys_mem_reserve_pages(boot_info->phys_addr, boot_info->total_size);
     phys_mem_reserve_pages(total_number_of_pages*NORMAL_PAGE_SIZE, total_number_of_excess_pages*NORMAL_PAGE_SIZE);
-    phys_mem_reserve_pages(ramdisk_metadata.mod_start, ramdisk_metadata.mod_end - ramdisk_metadata.mod_start);
+    for(uint32_t i = 0; i < boot_info->number_of_modules; ++i) {
+        phys_mem_reserve_pages(boot_info->modules[i].start, boot_info->modules[i].end - boot_info->modules[i].start);
+    }
     phys_mem_reserve_pages(phys_mem_physical_memory, total_number_of_uint64t_entries*sizeof(uint64_t));
-    phys_mem_reserve_pages(pdpte_phys_page_addr, NORMAL_PAGE_SIZE);
+    phys_mem_reserve_pages(buddy_page_orders_physical_memory, total_number_of_pages_rounded_up);
+    phys_mem_reserve_pages(linear_mapping_tables.phys_addr, linear_mapping_tables.size);
+    phys_mem_reserve_pages(AP_TRAMPOLINE_PHYS_ADDR, NORMAL_PAGE_SIZE); // NOTE: Low memory like this is always usable RAM on PCs.
 
-    const struct multiboot_tag_mmap *const memory_map_virtual_ptr = (struct multiboot_tag_mmap*) GENERAL_MEM_P2V(mmap_physical_addr);
-    for(uint32_t i = 0; i < (memory_map_virtual_ptr->size - sizeof(struct multiboot_tag_mmap))/memory_map_virtual_ptr->entry_size; ++i) {
-        const struct multiboot_mmap_entry current_entry = memory_map_virtual_ptr->entries[i];
+    for(uint32_t i = 0; i < boot_info->number_of_mmap_entries; ++i) {
+        const struct multiboot_mmap_entry current_entry = boot_info->mmap[i];
         if(current_entry.type == MULTIBOOT_MEMORY_RESERVED) {
             const uint64_t start = current_entry.addr;
             uint64_t end   = current_entry.addr + current_entry.len; // exclusive
@@ -165,150 +206,33 @@ static void reserve_unavailable_physical_memory(const uint64_t mboot_header_phys
     }
 }
 
-static void dump_multiboot_tags(const uint64_t mboot_header_phys_addr) {
-    uint64_t current_phys_ptr = mboot_header_phys_addr + 2*sizeof(multiboot_uint32_t);
-
-    char str_buf[128];
-
-    serial_writestring("All multiboot tags found: {\n");
-    for(;;) {
-        const struct multiboot_tag *const current_virt_ptr = (struct multiboot_tag*) GENERAL_MEM_P2V(current_phys_ptr);
-
-        if(current_virt_ptr->type == MULTIBOOT_TAG_TYPE_END) break;
-
-        switch(current_virt_ptr->type) {
-            case MULTIBOOT_TAG_TYPE_CMDLINE:
-                serial_writestring("MULTIBOOT_TAG_TYPE_CMDLINE\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_BOOT_LOADER_NAME:
-                serial_writestring("MULTIBOOT_TAG_TYPE_BOOT_LOADER_NAME\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_MODULE:
-                serial_writestring("MULTIBOOT_TAG_TYPE_MODULE\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_BASIC_MEMINFO:
-                serial_writestring("MULTIBOOT_TAG_TYPE_BASIC_MEMINFO\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_BOOTDEV:
-                serial_writestring("MULTIBOOT_TAG_TYPE_BOOTDEV\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_MMAP:
-                serial_writestring("MULTIBOOT_TAG_TYPE_MMAP\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_VBE:
-                serial_writestring("MULTIBOOT_TAG_TYPE_VBE\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_FRAMEBUFFER:
-                serial_writestring("MULTIBOOT_TAG_TYPE_FRAMEBUFFER\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_ELF_SECTIONS:
-                serial_writestring("MULTIBOOT_TAG_TYPE_ELF_SECTIONS\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_APM:
-                serial_writestring("MULTIBOOT_TAG_TYPE_APM\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_EFI32:
-                serial_writestring("MULTIBOOT_TAG_TYPE_EFI32\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_EFI64:
-                serial_writestring("MULTIBOOT_TAG_TYPE_EFI64\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_SMBIOS:
-                serial_writestring("MULTIBOOT_TAG_TYPE_SMBIOS\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_ACPI_OLD:
-                serial_writestring("MULTIBOOT_TAG_TYPE_ACPI_OLD\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_ACPI_NEW:
-                serial_writestring("MULTIBOOT_TAG_TYPE_ACPI_NEW\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_NETWORK:
-                serial_writestring("MULTIBOOT_TAG_TYPE_NETWORK\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_EFI_MMAP:
-                serial_writestring("MULTIBOOT_TAG_TYPE_EFI_MMAP\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_EFI_BS:
-                serial_writestring("MULTIBOOT_TAG_TYPE_EFI_BS\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_EFI32_IH:
-                serial_writestring("MULTIBOOT_TAG_TYPE_EFI32_IH\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_EFI64_IH:
-                serial_writestring("MULTIBOOT_TAG_TYPE_EFI64_IH\n");
-                break;
-            case MULTIBOOT_TAG_TYPE_LOAD_BASE_ADDR:
-                serial_writestring("MULTIBOOT_TAG_TYPE_LOAD_BASE_ADDR\n");
-                break;
-            default:
-                serial_writestring("Unknown type: ");
-                serial_writestring(print_digits(current_virt_ptr->type, str_buf));
-                serial_writestring("\n");
-        }
-
-        current_phys_ptr = (uint64_t)(current_phys_ptr  + round_up(current_virt_ptr->size, MULTIBOOT_TAG_ALIGN));
-    }
-    serial_writestring("}\n");
-}
-
-static struct multiboot_tag_framebuffer* get_framebuffer(const uint64_t mboot_header_phys_addr) {
-    uint64_t current_phys_ptr = mboot_header_phys_addr + 2*sizeof(multiboot_uint32_t);
-
-    for(;;) {
-        const struct multiboot_tag *const current_virt_ptr = (struct multiboot_tag*) GENERAL_MEM_P2V(current_phys_ptr);
-
-        if(current_virt_ptr->type == MULTIBOOT_TAG_TYPE_END) break;
-
-        if(current_virt_ptr->type == MULTIBOOT_TAG_TYPE_FRAMEBUFFER) {
-            return (struct multiboot_tag_framebuffer*) current_virt_ptr;
-        }
 
-        current_phys_ptr = (uint64_t)(current_phys_ptr  + round_up(current_virt_ptr->size, MULTIBOOT_TAG_ALIGN));
-    }
-
-    halt_and_die("Framebuffer not found.");
-}
-
-static struct ramdisk_metadata get_ramdisk_metadata(const uint64_t mboot_header_phys_addr) {
-    uint64_t current_phys_ptr = mboot_header_phys_addr + 2*sizeof(multiboot_uint32_t);
-
-    for(;;) {
-        const struct multiboot_tag *const current_virt_ptr = (struct multiboot_tag*) (early_single_page_virt_page_addr + offset_in_page(current_phys_ptr));
-        unconditional_map_page_in_first_2mib(current_phys_ptr, (uint64_t)current_virt_ptr);
-
-        if(current_virt_ptr->type == MULTIBOOT_TAG_TYPE_END) break;
-
-        if(current_virt_ptr->type == MULTIBOOT_TAG_TYPE_MODULE) {
-            struct multiboot_tag_module *const module = (struct multiboot_tag_module*) current_virt_ptr;
-            return (struct ramdisk_metadata) { module->mod_start, module->mod_end };
-        }
+static void print_initrd_files(void) {
+    char str_buf[32];
 
-        current_phys_ptr = (uint64_t)(current_phys_ptr  + round_up(current_virt_ptr->size, MULTIBOOT_TAG_ALIGN));
+    serial_writestring("Files in the initrd:\n");
+    for(uint64_t i = 0u; i < initrd_number_of_files(); ++i) {
+        const struct initrd_file *const file = initrd_file_at(i);
+        serial_writestring(file->path);
+        serial_writestring(" (");
+        serial_writestring(print_digits(file->size, str_buf));
+        serial_writestring(" bytes)\n");
     }
 
-    halt_and_die("Ramdisk not found.");
-}
-
-static struct multiboot_tag_module* get_ramdisk(const uint64_t mboot_header_phys_addr) {
-    uint64_t current_phys_ptr = mboot_header_phys_addr + 2*sizeof(multiboot_uint32_t);
-
-    for(;;) {
-        const struct multiboot_tag *const current_virt_ptr = (struct multiboot_tag*) GENERAL_MEM_P2V(current_phys_ptr);
-
-        if(current_virt_ptr->type == MULTIBOOT_TAG_TYPE_END) break;
-
-        if(current_virt_ptr->type == MULTIBOOT_TAG_TYPE_MODULE) {
-            return (struct multiboot_tag_module*) current_virt_ptr;
-        }
-
-        current_phys_ptr = (uint64_t)(current_phys_ptr  + round_up(current_virt_ptr->size, MULTIBOOT_TAG_ALIGN));
+    const struct initrd_file *const motd = initrd_lookup("/etc/motd");
+    if(motd != NULL) {
+        serial_write((const char*)motd->data, motd->size);
+        console_write((const char*)motd->data, motd->size);
     }
-
-    halt_and_die("Ramdisk not found.");
 }
 
-
 void kernel_main(const uint64_t mboot_magic, const uint64_t mboot_header_phys_addr) {
+    boot_phase_end("boot stub");
+    percpu_init_cpu(0u, read_initial_apic_id());
+    cpu_features_init();
+    apply_alternatives();
+    boot_phase_end("CPU features and alternatives");
+
     if(serial_init()) {
         serial_writestring("Serial driver works.\n");
     } else {
@@ -321,62 +245,131 @@ void kernel_main(const uint64_t mboot_magic, const uint64_t mboot_header_phys_ad
         halt_and_die("Bad multiboot magic.");
     }
 
-    early_single_page_virt_page_init();
+    cpu_features_print();
+    mark_cpu_online(current_cpu_id(), read_initial_apic_id());
+    boot_phase_end("serial init and CPU feature printing");
 
-    struct ramdisk_metadata ramdisk_metadata = get_ramdisk_metadata(mboot_header_phys_addr);
+    early_single_page_virt_page_init();
 
-    const uint64_t mmap_physical_addr = get_memory_map(mboot_header_phys_addr);
-    // temporary mapping until we set up linear map:
-    const struct multiboot_tag_mmap* mmap_virtual_ptr = (struct multiboot_tag_mmap*) (early_single_page_virt_page_addr + offset_in_page(mmap_physical_addr));
+    const struct boot_info *const boot_info = boot_info_init(mboot_header_phys_addr);
+    if(boot_info->number_of_modules == 0u) {
+        halt_and_die("Ramdisk not found.");
+    }
 
-    const uint64_t first_unused_memory_address = max(max(KERNEL_V2P((uint64_t)&kernel_end), mboot_header_phys_addr+multiboot_total_size), ramdisk_metadata.mod_end);
+    const uint64_t first_unused_memory_address = max(KERNEL_V2P((uint64_t)&kernel_end), boot_info_end_of_used_memory(boot_info));
     early_boot_alloc_init(first_unused_memory_address);
 
-    struct memory_size_info mem_size_info = get_memory_size_info(mmap_virtual_ptr);
+    struct memory_size_info mem_size_info = get_memory_size_info(boot_info);
+    boot_phase_end("multiboot parsing");
+
+    const struct linear_mapping_tables linear_mapping_tables = setup_linear_mapping(boot_info, mem_size_info);
+    boot_phase_end("setup_linear_mapping");
+
+    reserve_unavailable_physical_memory(boot_info, mem_size_info, linear_mapping_tables);
+    boot_phase_end("physical memory reservations");
+
+    // the ACPI tables are needed this early since the NUMA topology decides how physical memory is split into zones
+    const struct RSDP *const RSDP_virt_addr = get_rsdp(boot_info);
+    acpi_tables_init(RSDP_virt_addr);
+    numa_init(get_SRAT(), get_SLIT());
+    boot_phase_end("ACPI tables and NUMA");
+
+#ifdef KERNEL_BENCHMARKS
+    bench_phys_mem_bitmap();
+#endif
+
+    phys_mem_buddy_init();
+    boot_phase_end("buddy allocator");
+
+#ifdef KERNEL_TRACING
+    trace_init_cpu();
+#endif
+
+#ifdef KERNEL_BENCHMARKS
+    bench_phys_mem_buddy();
+    bench_page_cache();
+    bench_string_functions();
+#endif
+
+    slab_init();
+    vm_init();
+    tlb_shootdown_init();
+    vm_region_init();
+    boot_phase_end("slab and virtual memory");
+
+    const struct FADT *const FADT_virt_addr = get_FADT();
+    clocksource_init(FADT_virt_addr, get_HPET());
+    clocksource_print_info();
+    boot_phase_end("clocksource calibration");
+    gdt_init_cpu();
+    idt_init();
+    idt_init_cpu();
+    apic_init();
+    timer_init();
+    const struct MADT *const MADT_virt_addr = get_MADT();
+    ioapic_init(MADT_virt_addr);
+    serial_enable_interrupts();
+    interrupts_enable();
+    sched_init();
+    boot_phase_end("interrupts, timers and scheduler");
+
+    // NOTE: The framebuffer's shadow buffer is a demand-zero kernel region, so clearing it page faults, which needs the IDT.
+    if(!boot_info->has_framebuffer) {
+        halt_and_die("Framebuffer not found.");
+    }
+    framebuffer_init(&boot_info->framebuffer);
+    console_init();
+    boot_phase_end("framebuffer mapping and console");
 
-    const uint64_t pdpte_phys_page_addr = setup_linear_mapping(mmap_virtual_ptr, mem_size_info);
+    smp_init(MADT_virt_addr);
+    boot_phase_end("SMP bring-up");
 
-    // use the linear map:
-    mmap_virtual_ptr = (struct multiboot_tag_mmap*) GENERAL_MEM_P2V(mmap_physical_addr);
+#ifdef KERNEL_BENCHMARKS
+    bench_context_switch();
+    bench_interrupts();
+    bench_scheduler();
+    bench_framebuffer();
+    bench_console();
+    boot_phase_end("benchmarks");
+#endif
 
-    reserve_unavailable_physical_memory(mboot_header_phys_addr, mmap_physical_addr, mem_size_info, ramdisk_metadata, pdpte_phys_page_addr);
+    numa_print_topology();
+    phys_mem_print_zones();
 
 
 
 
-    dump_multiboot_tags(mboot_header_phys_addr);
+    boot_info_print_tags(boot_info);
 
-    print_memory_map(mmap_virtual_ptr, mem_size_info);
+    print_memory_map(boot_info, mem_size_info);
+    boot_phase_end("topology and memory map printing");
 
-    const struct multiboot_tag_framebuffer *const fb_tag = get_framebuffer(mboot_header_phys_addr);
-    volatile uint32_t *fb_ptr = (uint32_t*) GENERAL_MEM_P2V(fb_tag->common.framebuffer_addr);
-    uint32_t fb_pitch  = fb_tag->common.framebuffer_pitch;
-    uint8_t  fb_bpp    = fb_tag->common.framebuffer_bpp;
-    uint8_t  fb_type   = fb_tag->common.framebuffer_type;
-    if (fb_type != MULTIBOOT_FRAMEBUFFER_TYPE_RGB || fb_bpp != 32) {
-        halt_and_die("Unsupported framebuffer format.");
-    }
-    for (size_t i = 0; i < 100; i++) {
-        fb_ptr[i * (fb_pitch / 4) + i] = 0xffffff;
-    }
+    console_writestring("Framebuffer console works.\n");
+    boot_phase_end("framebuffer console");
 
-    const struct multiboot_tag_module *const initrd = get_ramdisk(mboot_header_phys_addr);
-    const char *const start_of_data = (const char*) GENERAL_MEM_P2V(initrd->mod_start);
-    serial_writestring("Contents of ramdisk:\n");
-    serial_write(start_of_data, initrd->mod_end - initrd->mod_start);
-    serial_writestring("\n");
+    // the first module is the initrd
+    initrd_init(boot_info->modules[0].start, boot_info->modules[0].end);
+    print_initrd_files();
+    boot_phase_end("initrd");
 
 
 
 
-    const struct RSDP *const RSDP_virt_addr = get_rsdp(mboot_header_phys_addr);
-    const struct XSDT *const XSDT_virt_addr = get_XSDT(RSDP_virt_addr);
-    enumerate_sdt_entries(XSDT_virt_addr);
-    const struct FADT *const FADT_virt_addr = get_FADT(XSDT_virt_addr);
-    const struct MADT *const MADT_virt_addr = get_MADT(XSDT_virt_addr);
+    enumerate_sdt_entries();
     enumerate_madt_interrupt_entries(MADT_virt_addr);
+    boot_phase_end("ACPI enumeration");
+
+    interrupt_print_stats();
+    sched_print_stats();
+    boot_phase_end("statistics printing");
+    boot_timing_print();
 
+#ifdef KERNEL_TRACING
+    trace_dump();
+#endif
 
+    qemu_debug_exit(0u);
 
-    halt();
+    // the other threads (and the idle loop) keep running on this CPU
+    thread_exit();
 }
@@ -0,0 +1,82 @@
+#include "alternatives.h"
+
+#include <stdbool.h>
+
+#include "cpu.h"
+#include <kernel/error/error.h>
+
+// defined in linker.ld
+extern const struct alternative_entry alternatives_start[];
+extern const struct alternative_entry alternatives_end[];
+
+#define OPCODE_CALL_REL32 0xE8u
+#define OPCODE_JMP_REL32 0xE9u
+#define REL32_INSTRUCTION_LENGTH 5u
+
+// the recommended multi-byte `nop`s from the Intel SDM (Vol. 2B, NOP), one for each length
+#define LONGEST_NOP 9u
+static const uint8_t nops[LONGEST_NOP + 1u][LONGEST_NOP] = {
+    [1] = { 0x90 },
+    [2] = { 0x66, 0x90 },
+    [3] = { 0x0F, 0x1F, 0x00 },
+    [4] = { 0x0F, 0x1F, 0x40, 0x00 },
+    [5] = { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+    [6] = { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+    [7] = { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
+    [8] = { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    [9] = { 0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+};
+
+// NOTE: This can't use `memcpy()`, since `memcpy()` itself is one of the sites being patched.
+//  The sites are written in place, with cr0.WP cleared by `apply_alternatives()` so that this works even if the text is mapped read-only.
+static void write_text(volatile uint8_t *const dest, const uint8_t *const src, const uint32_t count) {
+    for(uint32_t i = 0u; i < count; ++i) {
+        dest[i] = src[i];
+    }
+}
+
+static void fill_with_nops(volatile uint8_t* dest, uint32_t count) {
+    while(count != 0u) {
+        const uint32_t length = (count < LONGEST_NOP) ? count : LONGEST_NOP;
+        write_text(dest, nops[length], length);
+        dest += length;
+        count -= length;
+    }
+}
+
+static void apply_alternative(const struct alternative_entry *const entry) {
+    kassert(entry->replacement_length <= entry->site_length, "An alternative replacement is longer than its site.");
+
+    volatile uint8_t *const site = (volatile uint8_t*)entry->site;
+    const uint8_t *const replacement = (const uint8_t*)entry->replacement;
+    write_text(site, replacement, entry->replacement_length);
+
+    // A rel32 target is relative to the end of the instruction, so it has to be moved by how far the instruction moved.
+    if(entry->replacement_length >= REL32_INSTRUCTION_LENGTH && (replacement[0] == OPCODE_CALL_REL32 || replacement[0] == OPCODE_JMP_REL32)) {
+        uint32_t displacement = 0u;
+        for(uint32_t i = 0u; i < 4u; ++i) {
+            displacement |= (uint32_t)replacement[1u + i] << (8u * i);
+        }
+        displacement += (uint32_t)(entry->replacement - entry->site);
+        for(uint32_t i = 0u; i < 4u; ++i) {
+            site[1u + i] = (uint8_t)(displacement >> (8u * i));
+        }
+    }
+
+    fill_with_nops(&site[entry->replacement_length], entry->site_length - entry->replacement_length);
+}
+
+void apply_alternatives(void) {
+    // NOTE: Interrupts are still disabled this early, so nothing else runs while write protection is off.
+    const uint64_t cr0 = read_cr0();
+    write_cr0(cr0 & ~CR0_WRITE_PROTECT);
+    for(const struct alternative_entry* entry = alternatives_start; entry < alternatives_end; ++entry) {
+        if(cpu_has(entry->feature)) {
+            apply_alternative(entry);
+        }
+    }
+    write_cr0(cr0);
+
+    // NOTE: Modified code has to be followed by a serializing instruction before it runs, otherwise stale prefetched bytes could execute.
+    cpuid(0u, 0u);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "cpu_features.h"
+
+// One patch site. The linker collects these between `alternatives_start` and `alternatives_end`.
+struct alternative_entry {
+    uint64_t site; // the default instructions, which run on every CPU until they are patched
+    uint64_t replacement; // lives in `.alternatives_replacement` and is never executed in place
+    uint16_t feature;
+    uint8_t site_length;
+    uint8_t replacement_length;
+} __attribute__ ((packed));
+
+#define ALTERNATIVE_STRINGIFY_INNER(x) #x
+#define ALTERNATIVE_STRINGIFY(x) ALTERNATIVE_STRINGIFY_INNER(x)
+
+// Emits `old_instructions` inline and records `new_instructions` as their replacement on CPUs that have `feature`,
+//  so the choice costs nothing at runtime. Both versions share the operands of the surrounding `asm` statement.
+//  The site is padded with `nop`s to the longer of the two, and `apply_alternatives()` fills the rest of a shorter replacement with `nop`s as well.
+// NOTE: The replacement is copied, so it must not contain relative jumps or calls, except for a leading `call`/`jmp rel32` which gets relocated.
+#define ALTERNATIVE(old_instructions, new_instructions, feature) \
+    "661:\n\t" old_instructions "\n662:\n\t" \
+    ".skip -(((665f-664f)-(662b-661b)) > 0) * ((665f-664f)-(662b-661b)), 0x90\n" \
+    "663:\n" \
+    ".pushsection .alternatives, \"a\"\n\t" \
+    ".quad 661b\n\t" \
+    ".quad 664f\n\t" \
+    ".word " ALTERNATIVE_STRINGIFY(feature) "\n\t" \
+    ".byte 663b-661b\n\t" \
+    ".byte 665f-664f\n" \
+    ".popsection\n" \
+    ".pushsection .alternatives_replacement, \"ax\"\n" \
+    "664:\n\t" new_instructions "\n665:\n" \
+    ".popsection\n"
+
+// Patches every site whose feature the CPU has. This writes to the kernel text, so it runs on the bootstrap processor
+//  right after `cpu_features_init()` and before any other CPU is started.
+void apply_alternatives(void);
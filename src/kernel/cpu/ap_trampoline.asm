@@ -0,0 +1,105 @@
+; The application processors start here in real mode after the startup IPI, at `AP_TRAMPOLINE_PHYS_ADDR` (with CS = that address >> 4 and IP = 0).
+;  `smp_init()` copies everything between `ap_trampoline_start` and `ap_trampoline_end` there, fills in `ap_trampoline_data` and identity maps the page.
+;  Every address used below is relative to the start of the trampoline, since it runs at a different address than the one it was linked at.
+;
+; All APs run this at the same time, so the trampoline has no shared mutable state: each AP looks up its CPU id by its x2APIC id
+;  and takes the stack that was allocated for that id. An AP that is not in the table (firmware started it, or there are more than MAX_CPUS) parks itself.
+
+AP_TRAMPOLINE_PHYS_ADDR equ 0x8000 ; NOTE: This has to match `AP_TRAMPOLINE_PHYS_ADDR` in smp.h.
+MAX_CPUS equ 64 ; NOTE: This has to match `MAX_CPUS` in percpu.h.
+
+AP_CODE_SELECTOR equ 0x08
+IA32_EFER equ 0xC0000080
+CPUID_LEAF_EXTENDED_TOPOLOGY equ 0x0B
+
+%define TRAMPOLINE_OFFSET(label) ((label) - ap_trampoline_start)
+%define TRAMPOLINE_PHYS(label) (AP_TRAMPOLINE_PHYS_ADDR + TRAMPOLINE_OFFSET(label))
+
+section .rodata
+
+global ap_trampoline_start
+global ap_trampoline_end
+global ap_trampoline_data
+
+align 16
+BITS 16
+ap_trampoline_start:
+    cli
+    cld
+
+    mov ax, cs
+    mov ds, ax ; so that the trampoline offsets can be used as addresses
+
+    o32 lgdt [TRAMPOLINE_OFFSET(ap_gdt_pointer)]
+
+    ; Real mode goes straight to long mode: PAE (and LA57) in cr4, the kernel page tables in cr3, EFER.LME,
+    ;  and then protected mode and paging get enabled together in cr0.
+    mov eax, [TRAMPOLINE_OFFSET(ap_cr4)]
+    mov cr4, eax
+    mov eax, [TRAMPOLINE_OFFSET(ap_cr3)]
+    mov cr3, eax
+
+    mov ecx, IA32_EFER
+    mov eax, [TRAMPOLINE_OFFSET(ap_efer)]
+    xor edx, edx
+    wrmsr
+
+    mov eax, [TRAMPOLINE_OFFSET(ap_cr0)]
+    mov cr0, eax
+
+    jmp dword AP_CODE_SELECTOR:TRAMPOLINE_PHYS(ap_long_mode)
+
+BITS 64
+ap_long_mode:
+    xor eax, eax
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    ; EDX = the x2APIC id of this CPU
+    mov eax, CPUID_LEAF_EXTENDED_TOPOLOGY
+    xor ecx, ecx
+    cpuid
+
+    lea rsi, [rel ap_apic_ids]
+    xor ecx, ecx
+.find_cpu_id:
+    cmp [rsi + rcx*4], edx
+    je .found_cpu_id
+    inc ecx
+    cmp ecx, MAX_CPUS
+    jb .find_cpu_id
+.park:
+    cli
+    hlt
+    jmp .park
+
+.found_cpu_id:
+    lea rsi, [rel ap_stacks]
+    mov rsp, [rsi + rcx*8] ; 16-byte aligned, so the call below leaves the stack like the ABI expects on entry
+    mov edi, ecx ; first arg = CPU id
+    mov rax, [rel ap_entry]
+    call rax ; `ap_entry` is in the higher half and never returns
+    jmp .park
+
+align 16
+ap_gdt:
+    dq 0
+    dq 0x00AF9A000000FFFF ; 64-bit code, the same as in the boot stub
+ap_gdt_end:
+
+ap_gdt_pointer:
+    dw ap_gdt_end - ap_gdt - 1
+    dd TRAMPOLINE_PHYS(ap_gdt)
+
+; NOTE: This has to match `struct ap_trampoline_data` in smp.c.
+align 8
+ap_trampoline_data:
+ap_cr0: dq 0
+ap_cr3: dq 0
+ap_cr4: dq 0
+ap_efer: dq 0
+ap_entry: dq 0
+ap_apic_ids: times MAX_CPUS dd 0
+ap_stacks: times MAX_CPUS dq 0
+ap_trampoline_end:
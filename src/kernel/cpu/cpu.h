@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "alternatives.h"
+
+struct cpuid_result {
+    uint32_t eax;
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+};
+
+static inline struct cpuid_result cpuid(const uint32_t leaf, const uint32_t subleaf) {
+    struct cpuid_result result;
+    asm volatile("cpuid" : "=a" (result.eax), "=b" (result.ebx), "=c" (result.ecx), "=d" (result.edx) : "a" (leaf), "c" (subleaf));
+    return result;
+}
+
+#define CPUID_LEAF_FEATURES 0x01U
+#define CPUID_LEAF_STRUCTURED_EXTENDED_FEATURES 0x07U
+#define CPUID_LEAF_EXTENDED_TOPOLOGY 0x0BU
+#define CPUID_LEAF_EXTENDED_FEATURES 0x80000001U
+
+// NOTE: Feature bits are checked with `cpu_has()` from cpu_features.h, which reads them once at boot.
+
+// This works before the local APIC is enabled. Leaf 0xB gives the full 32-bit x2APIC id, leaf 1 only has the low 8 bits.
+static inline uint32_t read_initial_apic_id(void) {
+    if(cpuid(0u, 0u).eax >= CPUID_LEAF_EXTENDED_TOPOLOGY) {
+        return cpuid(CPUID_LEAF_EXTENDED_TOPOLOGY, 0u).edx;
+    }
+    return cpuid(1u, 0u).ebx >> 24;
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a" (low), "=d" (high));
+    return ((uint64_t)high << 32) | low;
+}
+
+// Unlike `rdtsc()`, this waits for every earlier instruction to finish first, so it can't be reordered before the code being timed.
+//  `rdtscp` does the same in a single instruction and also returns the `IA32_TSC_AUX` value in ecx, which is ignored here.
+static inline uint64_t rdtsc_ordered(void) {
+    uint32_t low, high;
+    asm volatile(ALTERNATIVE("lfence\n\trdtsc", "rdtscp", X86_FEATURE_RDTSCP) : "=a" (low), "=d" (high) :: "rcx", "memory");
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline uint64_t rdmsr(const uint32_t msr) {
+    uint32_t low, high;
+    asm volatile("rdmsr" : "=a" (low), "=d" (high) : "c" (msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void wrmsr(const uint32_t msr, const uint64_t value) {
+    asm volatile("wrmsr" :: "c" (msr), "a" ((uint32_t)value), "d" ((uint32_t)(value >> 32)) : "memory");
+}
+
+#define RFLAGS_INTERRUPT_ENABLE (1ULL << 9)
+
+// returns the previous RFLAGS so that `interrupts_restore()` only re-enables interrupts if they were enabled before
+static inline uint64_t interrupts_save_and_disable(void) {
+    uint64_t rflags;
+    asm volatile("pushfq\n\tpopq %0\n\tcli" : "=r" (rflags) :: "memory");
+    return rflags;
+}
+
+static inline void interrupts_restore(const uint64_t rflags) {
+    if(rflags & RFLAGS_INTERRUPT_ENABLE) {
+        asm volatile("sti" ::: "memory");
+    }
+}
+
+static inline void interrupts_enable(void) {
+    asm volatile("sti" ::: "memory");
+}
+
+static inline void cpu_relax(void) {
+    asm volatile("pause" ::: "memory");
+}
+
+// With cr0.WP set, ring 0 writes honor read-only page table entries too, which the shared zero page relies on.
+#define CR0_WRITE_PROTECT (1ULL << 16)
+
+static inline uint64_t read_cr0(void) {
+    uint64_t cr0;
+    asm volatile("movq %%cr0, %0" : "=r" (cr0));
+    return cr0;
+}
+
+static inline void write_cr0(const uint64_t cr0) {
+    asm volatile("movq %0, %%cr0" :: "r" (cr0) : "memory");
+}
@@ -0,0 +1,133 @@
+#include "cpu_features.h"
+
+#include "cpu.h"
+#include <kernel/drivers/serial/serial.h>
+
+uint32_t cpu_feature_words[NUMBER_OF_CPU_FEATURE_WORDS];
+struct cpu_info boot_cpu_info;
+
+#define CPUID_LEAF_VENDOR 0x00U
+#define CPUID_LEAF_THERMAL_AND_POWER 0x06U
+#define CPUID_LEAF_EXTENDED_MAX 0x80000000U
+#define CPUID_LEAF_ADVANCED_POWER_MANAGEMENT 0x80000007U
+
+static void read_vendor_and_signature(void) {
+    const struct cpuid_result vendor = cpuid(CPUID_LEAF_VENDOR, 0u);
+    boot_cpu_info.max_basic_leaf = vendor.eax;
+
+    // the vendor string is stored in ebx, edx, ecx (in that order)
+    const uint32_t vendor_registers[3] = { vendor.ebx, vendor.edx, vendor.ecx };
+    for(uint32_t i = 0u; i < 12u; ++i) {
+        boot_cpu_info.vendor[i] = (char)(vendor_registers[i / 4u] >> (8u * (i % 4u)));
+    }
+    boot_cpu_info.vendor[12] = '\0';
+
+    // The family and model are split into a base and an extended part. The extended model only counts for families 6 and 15.
+    const uint32_t signature = cpuid(CPUID_LEAF_FEATURES, 0u).eax;
+    const uint32_t base_family = (signature >> 8) & 0xFu;
+    const uint32_t base_model = (signature >> 4) & 0xFu;
+    boot_cpu_info.family = (base_family == 0xFu) ? base_family + ((signature >> 20) & 0xFFu) : base_family;
+    boot_cpu_info.model = (base_family == 0x6u || base_family == 0xFu) ? base_model | (((signature >> 16) & 0xFu) << 4) : base_model;
+    boot_cpu_info.stepping = signature & 0xFu;
+}
+
+void cpu_features_init(void) {
+    read_vendor_and_signature();
+    boot_cpu_info.max_extended_leaf = cpuid(CPUID_LEAF_EXTENDED_MAX, 0u).eax;
+
+    // NOTE: Leaves above the maximum return the data of the highest basic leaf on Intel, so they must never be read.
+    const struct cpuid_result features = cpuid(CPUID_LEAF_FEATURES, 0u);
+    cpu_feature_words[CPU_FEATURE_WORD_LEAF_1_ECX] = features.ecx;
+    cpu_feature_words[CPU_FEATURE_WORD_LEAF_1_EDX] = features.edx;
+
+    if(boot_cpu_info.max_basic_leaf >= CPUID_LEAF_THERMAL_AND_POWER) {
+        cpu_feature_words[CPU_FEATURE_WORD_LEAF_6_EAX] = cpuid(CPUID_LEAF_THERMAL_AND_POWER, 0u).eax;
+    }
+
+    if(boot_cpu_info.max_basic_leaf >= CPUID_LEAF_STRUCTURED_EXTENDED_FEATURES) {
+        const struct cpuid_result structured_extended_features = cpuid(CPUID_LEAF_STRUCTURED_EXTENDED_FEATURES, 0u);
+        cpu_feature_words[CPU_FEATURE_WORD_LEAF_7_EBX] = structured_extended_features.ebx;
+        cpu_feature_words[CPU_FEATURE_WORD_LEAF_7_ECX] = structured_extended_features.ecx;
+        cpu_feature_words[CPU_FEATURE_WORD_LEAF_7_EDX] = structured_extended_features.edx;
+    }
+
+    if(boot_cpu_info.max_extended_leaf >= CPUID_LEAF_EXTENDED_FEATURES) {
+        const struct cpuid_result extended_features = cpuid(CPUID_LEAF_EXTENDED_FEATURES, 0u);
+        cpu_feature_words[CPU_FEATURE_WORD_LEAF_80000001_ECX] = extended_features.ecx;
+        cpu_feature_words[CPU_FEATURE_WORD_LEAF_80000001_EDX] = extended_features.edx;
+    }
+
+    if(boot_cpu_info.max_extended_leaf >= CPUID_LEAF_ADVANCED_POWER_MANAGEMENT) {
+        cpu_feature_words[CPU_FEATURE_WORD_LEAF_80000007_EDX] = cpuid(CPUID_LEAF_ADVANCED_POWER_MANAGEMENT, 0u).edx;
+    }
+
+    uint32_t synthetic = 0u;
+    if(cpu_has(X86_FEATURE_ERMS) || cpu_has(X86_FEATURE_FSRM)) {
+        synthetic |= 1u << (X86_FEATURE_FAST_STRING % 32u);
+    }
+    cpu_feature_words[CPU_FEATURE_WORD_SYNTHETIC] = synthetic;
+}
+
+struct cpu_feature_name {
+    uint32_t feature;
+    const char* name;
+};
+
+static const struct cpu_feature_name cpu_feature_names[] = {
+    { X86_FEATURE_SSE3, "sse3" },
+    { X86_FEATURE_PCID, "pcid" },
+    { X86_FEATURE_X2APIC, "x2apic" },
+    { X86_FEATURE_TSC_DEADLINE, "tsc_deadline" },
+    { X86_FEATURE_XSAVE, "xsave" },
+    { X86_FEATURE_AVX, "avx" },
+    { X86_FEATURE_RDRAND, "rdrand" },
+    { X86_FEATURE_HYPERVISOR, "hypervisor" },
+    { X86_FEATURE_FPU, "fpu" },
+    { X86_FEATURE_TSC, "tsc" },
+    { X86_FEATURE_MSR, "msr" },
+    { X86_FEATURE_APIC, "apic" },
+    { X86_FEATURE_PGE, "pge" },
+    { X86_FEATURE_PAT, "pat" },
+    { X86_FEATURE_CLFLUSH, "clflush" },
+    { X86_FEATURE_SSE2, "sse2" },
+    { X86_FEATURE_FSGSBASE, "fsgsbase" },
+    { X86_FEATURE_SMEP, "smep" },
+    { X86_FEATURE_ERMS, "erms" },
+    { X86_FEATURE_INVPCID, "invpcid" },
+    { X86_FEATURE_SMAP, "smap" },
+    { X86_FEATURE_CLFLUSHOPT, "clflushopt" },
+    { X86_FEATURE_UMIP, "umip" },
+    { X86_FEATURE_LA57, "la57" },
+    { X86_FEATURE_RDPID, "rdpid" },
+    { X86_FEATURE_FSRM, "fsrm" },
+    { X86_FEATURE_LAHF_LM, "lahf_lm" },
+    { X86_FEATURE_SYSCALL, "syscall" },
+    { X86_FEATURE_NX, "nx" },
+    { X86_FEATURE_1GIB_PAGES, "pdpe1gb" },
+    { X86_FEATURE_RDTSCP, "rdtscp" },
+    { X86_FEATURE_LONG_MODE, "lm" },
+    { X86_FEATURE_ARAT, "arat" },
+    { X86_FEATURE_INVARIANT_TSC, "invariant_tsc" },
+    { X86_FEATURE_FAST_STRING, "fast_string" },
+};
+
+void cpu_features_print(void) {
+    char str_buf[32];
+
+    serial_writestring("CPU: ");
+    serial_writestring(boot_cpu_info.vendor);
+    serial_writestring(" family ");
+    serial_writestring(print_hex(boot_cpu_info.family, str_buf));
+    serial_writestring(" model ");
+    serial_writestring(print_hex(boot_cpu_info.model, str_buf));
+    serial_writestring(" stepping ");
+    serial_writestring(print_digits(boot_cpu_info.stepping, str_buf));
+    serial_writestring("\nCPU features:");
+    for(size_t i = 0u; i < sizeof(cpu_feature_names)/sizeof(cpu_feature_names[0]); ++i) {
+        if(cpu_has(cpu_feature_names[i].feature)) {
+            serial_writestring(" ");
+            serial_writestring(cpu_feature_names[i].name);
+        }
+    }
+    serial_writestring("\n");
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Every CPUID leaf the kernel cares about is read once by `cpu_features_init()` and cached as a bitmap of feature words.
+//  A feature is `word*32 + bit`, where the bit is the same as in the CPUID register that the word caches.
+enum cpu_feature_word {
+    CPU_FEATURE_WORD_LEAF_1_ECX = 0,
+    CPU_FEATURE_WORD_LEAF_1_EDX = 1,
+    CPU_FEATURE_WORD_LEAF_7_EBX = 2,
+    CPU_FEATURE_WORD_LEAF_7_ECX = 3,
+    CPU_FEATURE_WORD_LEAF_7_EDX = 4,
+    CPU_FEATURE_WORD_LEAF_80000001_ECX = 5,
+    CPU_FEATURE_WORD_LEAF_80000001_EDX = 6,
+    CPU_FEATURE_WORD_LEAF_6_EAX = 7,
+    CPU_FEATURE_WORD_LEAF_80000007_EDX = 8,
+    CPU_FEATURE_WORD_SYNTHETIC = 9, // derived from other words, so hot paths only need to check one bit
+    NUMBER_OF_CPU_FEATURE_WORDS = 10,
+};
+
+// NOTE: These are macros instead of an enum, since `ALTERNATIVE()` pastes them into inline assembly.
+#define CPU_FEATURE(word, bit) ((word)*32 + (bit))
+
+#define X86_FEATURE_SSE3 CPU_FEATURE(0, 0)
+#define X86_FEATURE_PCID CPU_FEATURE(0, 17)
+#define X86_FEATURE_X2APIC CPU_FEATURE(0, 21)
+#define X86_FEATURE_TSC_DEADLINE CPU_FEATURE(0, 24)
+#define X86_FEATURE_XSAVE CPU_FEATURE(0, 26)
+#define X86_FEATURE_AVX CPU_FEATURE(0, 28)
+#define X86_FEATURE_RDRAND CPU_FEATURE(0, 30)
+#define X86_FEATURE_HYPERVISOR CPU_FEATURE(0, 31)
+
+#define X86_FEATURE_FPU CPU_FEATURE(1, 0)
+#define X86_FEATURE_TSC CPU_FEATURE(1, 4)
+#define X86_FEATURE_MSR CPU_FEATURE(1, 5)
+#define X86_FEATURE_APIC CPU_FEATURE(1, 9)
+#define X86_FEATURE_PGE CPU_FEATURE(1, 13)
+#define X86_FEATURE_PAT CPU_FEATURE(1, 16)
+#define X86_FEATURE_CLFLUSH CPU_FEATURE(1, 19)
+#define X86_FEATURE_SSE2 CPU_FEATURE(1, 26)
+
+#define X86_FEATURE_FSGSBASE CPU_FEATURE(2, 0)
+#define X86_FEATURE_SMEP CPU_FEATURE(2, 7)
+#define X86_FEATURE_ERMS CPU_FEATURE(2, 9)
+#define X86_FEATURE_INVPCID CPU_FEATURE(2, 10)
+#define X86_FEATURE_SMAP CPU_FEATURE(2, 20)
+#define X86_FEATURE_CLFLUSHOPT CPU_FEATURE(2, 23)
+
+#define X86_FEATURE_UMIP CPU_FEATURE(3, 2)
+#define X86_FEATURE_LA57 CPU_FEATURE(3, 16)
+#define X86_FEATURE_RDPID CPU_FEATURE(3, 22)
+
+#define X86_FEATURE_FSRM CPU_FEATURE(4, 4)
+
+#define X86_FEATURE_LAHF_LM CPU_FEATURE(5, 0)
+
+#define X86_FEATURE_SYSCALL CPU_FEATURE(6, 11)
+#define X86_FEATURE_NX CPU_FEATURE(6, 20)
+#define X86_FEATURE_1GIB_PAGES CPU_FEATURE(6, 26)
+#define X86_FEATURE_RDTSCP CPU_FEATURE(6, 27)
+#define X86_FEATURE_LONG_MODE CPU_FEATURE(6, 29)
+
+#define X86_FEATURE_ARAT CPU_FEATURE(7, 2) // the local APIC timer keeps running in deep C-states
+
+#define X86_FEATURE_INVARIANT_TSC CPU_FEATURE(8, 8)
+
+#define X86_FEATURE_FAST_STRING CPU_FEATURE(9, 0) // ERMS or FSRM, so `rep movsb`/`rep stosb` are at least as fast as the qword versions
+
+struct cpu_info {
+    char vendor[13]; // null terminated
+    uint32_t max_basic_leaf;
+    uint32_t max_extended_leaf;
+    uint32_t family;
+    uint32_t model;
+    uint32_t stepping;
+};
+
+extern uint32_t cpu_feature_words[NUMBER_OF_CPU_FEATURE_WORDS];
+extern struct cpu_info boot_cpu_info;
+
+// Has to run before anything checks a feature, so it is the first thing `kernel_main()` does. Until then every feature reads as missing.
+void cpu_features_init(void);
+
+static inline bool cpu_has(const uint32_t feature) {
+    return (cpu_feature_words[feature / 32u] >> (feature % 32u)) & 1u;
+}
+
+void cpu_features_print(void);
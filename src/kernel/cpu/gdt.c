@@ -0,0 +1,63 @@
+#include "gdt.h"
+
+#include <kernel/cpu/percpu.h>
+#include <kernel/mem/mem_constants.h>
+#include <kernel/mem/phys/phys_mem_allocator.h>
+
+#define GDT_ENTRIES 5u // null, kernel code, kernel data and the two halves of the TSS descriptor
+
+#define KERNEL_CODE_DESCRIPTOR 0x00AF9A000000FFFFULL // present, ring 0, executable, readable, long mode (L bit)
+#define KERNEL_DATA_DESCRIPTOR 0x00CF92000000FFFFULL // present, ring 0, writeable
+#define TSS_DESCRIPTOR_TYPE 0x89ULL // present, ring 0, available 64-bit TSS
+
+struct cpu_descriptor_tables {
+    uint64_t gdt[GDT_ENTRIES];
+    struct tss tss;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct cpu_descriptor_tables cpu_descriptor_tables[MAX_CPUS];
+
+static void set_tss_descriptor(uint64_t *const descriptor, const struct tss *const tss) {
+    const uint64_t base = (uint64_t)tss;
+    const uint64_t limit = sizeof(struct tss) - 1u;
+
+    descriptor[0] = (limit & 0xFFFFu) | ((base & 0xFFFFFFu) << 16) | (TSS_DESCRIPTOR_TYPE << 40) | (((limit >> 16) & 0xFu) << 48) | (((base >> 24) & 0xFFu) << 56);
+    descriptor[1] = base >> 32;
+}
+
+void gdt_init_cpu(void) {
+    struct cpu_descriptor_tables *const tables = &cpu_descriptor_tables[current_cpu_id()];
+
+    tables->gdt[0] = 0u;
+    tables->gdt[KERNEL_CODE_SELECTOR / sizeof(uint64_t)] = KERNEL_CODE_DESCRIPTOR;
+    tables->gdt[KERNEL_DATA_SELECTOR / sizeof(uint64_t)] = KERNEL_DATA_DESCRIPTOR;
+    set_tss_descriptor(&tables->gdt[TSS_SELECTOR / sizeof(uint64_t)], &tables->tss);
+
+    // the stacks come from the node of this CPU and are never freed
+    for(uint32_t ist = 0u; ist < NUMBER_OF_IST_STACKS; ++ist) {
+        const uint64_t stack_bottom = GENERAL_MEM_P2V(phys_mem_allocate_pages(IST_STACK_ORDER));
+        tables->tss.ist[ist] = stack_bottom + (NORMAL_PAGE_SIZE << IST_STACK_ORDER);
+    }
+    tables->tss.iomap_base = sizeof(struct tss); // no I/O permission bitmap
+
+    struct descriptor_table_pseudo_register gdtr;
+    gdtr.limit = sizeof(tables->gdt) - 1u;
+    gdtr.base = (uint64_t)tables->gdt;
+    asm volatile("lgdt %0" :: "m" (gdtr) : "memory");
+
+    // There is no far jump to an immediate in long mode, so CS is reloaded with a far return to the next instruction.
+    //  NOTE: FS and GS are left alone, since loading a selector into them would clear their base.
+    asm volatile(
+        "pushq %[code]\n\t"
+        "leaq 1f(%%rip), %%rax\n\t"
+        "pushq %%rax\n\t"
+        "lretq\n"
+        "1:\n\t"
+        "movl %[data], %%eax\n\t"
+        "movw %%ax, %%ds\n\t"
+        "movw %%ax, %%es\n\t"
+        "movw %%ax, %%ss"
+        :: [code] "i" (KERNEL_CODE_SELECTOR), [data] "i" (KERNEL_DATA_SELECTOR) : "rax", "memory");
+
+    asm volatile("ltr %w0" :: "r" ((uint16_t)TSS_SELECTOR));
+}
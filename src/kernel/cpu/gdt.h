@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// The boot stub's GDT is only reachable through the identity map (which is gone once the kernel runs) and has no TSS,
+//  so every CPU switches to its own GDT in the higher half.
+//  Each GDT has a TSS, since that is where the IST stacks come from.
+#define KERNEL_CODE_SELECTOR 0x08u
+#define KERNEL_DATA_SELECTOR 0x10u
+#define TSS_SELECTOR 0x18u // the TSS descriptor takes up two entries in long mode
+
+// IST slots of the TSS. These are 1-based, since an IST of 0 in an IDT entry means "stay on the current stack".
+//  #DF, NMI and #MC can hit while the kernel stack is unusable (overflowed, or in the middle of being switched), so they always get a known good stack.
+#define IST_DOUBLE_FAULT 1u
+#define IST_NMI 2u
+#define IST_MACHINE_CHECK 3u
+#define NUMBER_OF_IST_STACKS 3u
+#define IST_STACK_ORDER 2u // 16KiB
+
+struct descriptor_table_pseudo_register {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__ ((packed));
+
+struct tss {
+    uint32_t reserved0;
+    uint64_t rsp[3]; // stacks for a privilege level change, which don't happen yet since everything runs in ring 0
+    uint64_t reserved1;
+    uint64_t ist[7]; // `ist[i]` is IST slot `i + 1`
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} __attribute__ ((packed));
+
+// Builds the GDT and TSS of the current CPU, allocates its IST stacks and loads both. Must be called after `phys_mem_buddy_init()`.
+void gdt_init_cpu(void);
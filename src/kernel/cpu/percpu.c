@@ -0,0 +1,24 @@
+#include "percpu.h"
+
+#include <kernel/cpu/cpu.h>
+
+#define IA32_GS_BASE 0xC0000101u
+
+// NOTE: These are static rather than allocated, since the bootstrap processor needs its area before the physical memory allocator exists.
+static struct percpu percpu_areas[MAX_CPUS];
+
+uint32_t cpu_apic_ids[MAX_CPUS];
+volatile uint64_t online_cpus_mask;
+
+void percpu_init_cpu(const uint32_t cpu_id, const uint32_t apic_id) {
+    struct percpu *const percpu = &percpu_areas[cpu_id];
+    percpu->self = percpu;
+    percpu->cpu_id = cpu_id;
+    percpu->apic_id = apic_id;
+    wrmsr(IA32_GS_BASE, (uint64_t)percpu);
+}
+
+void mark_cpu_online(const uint32_t cpu_id, const uint32_t apic_id) {
+    cpu_apic_ids[cpu_id] = apic_id;
+    __atomic_or_fetch(&online_cpus_mask, 1ULL << cpu_id, __ATOMIC_SEQ_CST);
+}
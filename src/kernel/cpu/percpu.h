@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_CPUS 64u
+
+#define CACHE_LINE_SIZE 64u
+
+// Every CPU points IA32_GS_BASE at its own `struct percpu`, so reading a field of it is a single %gs relative load.
+struct percpu {
+    struct percpu* self; // for turning the GS base back into a pointer
+    uint32_t cpu_id;
+    uint32_t apic_id;
+    // The scheduler only preempts a thread while this is 0. Every held spinlock counts one, since a thread that is switched out while
+    //  holding a lock would leave everyone else spinning on it until it runs again.
+    uint32_t preempt_count;
+    volatile bool need_resched; // set by the time slice timer, acted on when the interrupt returns with `preempt_count` at 0
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// NOTE: This is volatile, so that a read can't be moved across a point where the current thread could migrate to another CPU.
+static inline uint32_t current_cpu_id(void) {
+    uint32_t cpu_id;
+    asm volatile("movl %%gs:%c1, %0" : "=r" (cpu_id) : "i" (offsetof(struct percpu, cpu_id)));
+    return cpu_id;
+}
+
+static inline struct percpu* this_cpu(void) {
+    struct percpu* percpu;
+    asm volatile("movq %%gs:%c1, %0" : "=r" (percpu) : "i" (offsetof(struct percpu, self)));
+    return percpu;
+}
+
+// NOTE: A single `incl`/`decl` on the current CPU's area is atomic with respect to interrupts, so these don't need to disable them.
+static inline void preempt_disable(void) {
+    asm volatile("incl %%gs:%c0" :: "i" (offsetof(struct percpu, preempt_count)) : "memory");
+}
+
+static inline void preempt_enable(void) {
+    asm volatile("decl %%gs:%c0" :: "i" (offsetof(struct percpu, preempt_count)) : "memory");
+}
+
+static inline uint32_t preempt_count(void) {
+    uint32_t count;
+    asm volatile("movl %%gs:%c1, %0" : "=r" (count) : "i" (offsetof(struct percpu, preempt_count)));
+    return count;
+}
+
+// Sets up the per-CPU area of the calling CPU. Must be the first thing a CPU does, before anything calls `current_cpu_id()`.
+void percpu_init_cpu(uint32_t cpu_id, uint32_t apic_id);
+
+extern uint32_t cpu_apic_ids[MAX_CPUS];
+extern volatile uint64_t online_cpus_mask; // bit `i` is set once CPU `i` is running, which works since `MAX_CPUS` is 64
+
+void mark_cpu_online(uint32_t cpu_id, uint32_t apic_id);
@@ -0,0 +1,210 @@
+#include "smp.h"
+
+#include <libc/required_libc_functions.h>
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/gdt.h>
+#include <kernel/cpu/percpu.h>
+#include <kernel/error/error.h>
+#include <kernel/interrupts/idt.h>
+#include <kernel/interrupts/apic/apic.h>
+#include <kernel/mem/map_mem.h>
+#include <kernel/mem/numa/numa.h>
+#include <kernel/mem/phys/phys_mem_allocator.h>
+#include <kernel/sched/sched.h>
+#include <kernel/time/clocksource.h>
+#include <kernel/time/timer.h>
+#include <kernel/trace/trace.h>
+
+#define IA32_EFER 0xC0000080u
+#define IA32_EFER_LONG_MODE_ACTIVE (1ULL << 10) // read-only, the CPU sets it once paging is enabled with EFER.LME
+#define IA32_PAT 0x277u
+
+// the delays from the MultiProcessor Specification
+#define INIT_TO_STARTUP_DELAY_NS 10000000ULL
+#define STARTUP_TO_STARTUP_DELAY_NS 200000ULL
+#define AP_STARTUP_TIMEOUT_NS 100000000ULL
+
+#define NO_APIC_ID UINT32_MAX
+
+// NOTE: This has to match the layout at `ap_trampoline_data` in ap_trampoline.asm.
+struct ap_trampoline_data {
+    uint64_t cr0;
+    uint64_t cr3;
+    uint64_t cr4;
+    uint64_t efer;
+    uint64_t entry;
+    uint32_t apic_ids[MAX_CPUS]; // indexed by CPU id
+    uint64_t stacks[MAX_CPUS];
+};
+
+extern const char ap_trampoline_start[];
+extern const char ap_trampoline_end[];
+extern const char ap_trampoline_data[];
+
+static uint32_t present_apic_ids[MAX_CPUS]; // indexed by CPU id, where the bootstrap processor is CPU 0
+static uint32_t number_of_present_cpus;
+
+// state of the bootstrap processor that every AP copies
+static uint64_t boot_cr4;
+static uint64_t boot_pat;
+
+static void delay_ns(const uint64_t ns) {
+    const uint64_t end = ktime_get() + ns;
+    while(ktime_get() < end) {
+        cpu_relax();
+    }
+}
+
+static void add_present_cpu(const uint32_t apic_id, const uint32_t flags) {
+    // NOTE: A CPU that is only online capable would need hotplug support, so it is ignored like a disabled one.
+    if(!(flags & Enabled)) {
+        return;
+    }
+
+    // the bootstrap processor is already in there, and some firmware lists a CPU both as a local APIC and as a local x2APIC
+    for(uint32_t cpu = 0u; cpu < number_of_present_cpus; ++cpu) {
+        if(present_apic_ids[cpu] == apic_id) {
+            return;
+        }
+    }
+
+    if(number_of_present_cpus == MAX_CPUS) {
+        serial_writestring("SMP: Ignoring a CPU beyond MAX_CPUS.\n");
+        return;
+    }
+    present_apic_ids[number_of_present_cpus++] = apic_id;
+}
+
+static void find_present_cpus(const struct MADT *const MADT_virt_addr) {
+    const uint64_t total_len = MADT_virt_addr->header.Length;
+    uint64_t offset = sizeof(struct MADT);
+    const uint8_t* ptr = (const uint8_t*)MADT_virt_addr->InterruptControllerStructure;
+
+    while(offset + sizeof(struct InterruptEntryHeader) <= total_len) {
+        const struct InterruptEntryHeader *const current_header = (const struct InterruptEntryHeader*) ptr;
+        if(current_header->Length < sizeof(struct InterruptEntryHeader) || offset + current_header->Length > total_len) {
+            halt_and_die("MADT entry has invalid Length.");
+        }
+
+        if(current_header->Type == 0 && current_header->Length >= sizeof(struct ProcessorLocal_APIC_Structure)) {
+            const struct ProcessorLocal_APIC_Structure *const entry = (const struct ProcessorLocal_APIC_Structure*) ptr;
+            add_present_cpu(entry->APIC_ID, entry->Flags);
+        }
+        else if(current_header->Type == 9 && current_header->Length >= sizeof(struct ProcessorLocalx2APIC_Structure)) {
+            const struct ProcessorLocalx2APIC_Structure *const entry = (const struct ProcessorLocalx2APIC_Structure*) ptr;
+            add_present_cpu(entry->X2APIC_ID, entry->Flags);
+        }
+
+        offset += current_header->Length;
+        ptr += current_header->Length;
+    }
+}
+
+static __attribute__((noreturn)) void ap_entry(const uint32_t cpu_id) {
+    const uint32_t apic_id = present_apic_ids[cpu_id];
+
+    // has to come first, since everything below uses `current_cpu_id()`
+    percpu_init_cpu(cpu_id, apic_id);
+
+    wrmsr(IA32_PAT, boot_pat);
+    write_cr4(boot_cr4); // the trampoline leaves out cr4.PCIDE, which can only be set in long mode
+
+#ifdef KERNEL_TRACING
+    trace_init_cpu();
+#endif
+
+    gdt_init_cpu();
+    idt_init_cpu();
+    apic_init_cpu();
+    timer_init();
+    sched_init_cpu();
+
+    // only now can the other CPUs steal from this one
+    mark_cpu_online(cpu_id, apic_id);
+    sched_idle();
+}
+
+static void send_ipi_to_present_aps(const uint32_t command) {
+    for(uint32_t cpu = 1u; cpu < number_of_present_cpus; ++cpu) {
+        if(!(online_cpus_mask & (1ULL << cpu))) {
+            x2apic_write_icr(present_apic_ids[cpu], command);
+        }
+    }
+}
+
+static bool all_present_cpus_online(void) {
+    const uint64_t present_mask = (number_of_present_cpus == 64u) ? UINT64_MAX : (1ULL << number_of_present_cpus) - 1u;
+    return (__atomic_load_n(&online_cpus_mask, __ATOMIC_ACQUIRE) & present_mask) == present_mask;
+}
+
+void smp_init(const struct MADT *const MADT_virt_addr) {
+    present_apic_ids[0] = cpu_apic_ids[current_cpu_id()];
+    number_of_present_cpus = 1u;
+    find_present_cpus(MADT_virt_addr);
+    if(number_of_present_cpus == 1u) {
+        return;
+    }
+
+    const uint64_t trampoline_size = (uint64_t)(ap_trampoline_end - ap_trampoline_start);
+    kassert(trampoline_size <= NORMAL_PAGE_SIZE, "The AP trampoline does not fit into its page.");
+    kassert(kernel_address_space.root_table_phys_addr < (1ULL << 32), "The trampoline can only load a 32-bit cr3.");
+
+    uint8_t *const trampoline = (uint8_t*) GENERAL_MEM_P2V(AP_TRAMPOLINE_PHYS_ADDR);
+    memcpy(trampoline, ap_trampoline_start, trampoline_size);
+
+    boot_cr4 = read_cr4();
+    boot_pat = rdmsr(IA32_PAT);
+
+    struct ap_trampoline_data *const data = (struct ap_trampoline_data*)(trampoline + (ap_trampoline_data - ap_trampoline_start));
+    data->cr0 = read_cr0() | CR0_WRITE_PROTECT;
+    data->cr3 = kernel_address_space.root_table_phys_addr;
+    data->cr4 = boot_cr4 & ~CR4_PCID_ENABLE;
+    data->efer = rdmsr(IA32_EFER) & ~IA32_EFER_LONG_MODE_ACTIVE;
+    data->entry = (uint64_t)ap_entry;
+    for(uint32_t cpu = 0u; cpu < MAX_CPUS; ++cpu) {
+        data->apic_ids[cpu] = (cpu != 0u && cpu < number_of_present_cpus) ? present_apic_ids[cpu] : NO_APIC_ID;
+        data->stacks[cpu] = 0u;
+    }
+
+    // every stack comes from the node of the CPU that uses it
+    for(uint32_t cpu = 1u; cpu < number_of_present_cpus; ++cpu) {
+        numa_set_cpu_apic_id(cpu, present_apic_ids[cpu]);
+        const uint64_t stack_bottom = GENERAL_MEM_P2V(phys_mem_allocate_pages_node(numa_node_of_cpu(cpu), AP_STACK_ORDER));
+        data->stacks[cpu] = stack_bottom + (NORMAL_PAGE_SIZE << AP_STACK_ORDER);
+    }
+
+    // the APs run the trampoline with paging already on, so it needs an identity mapping
+    map_range(&kernel_address_space, AP_TRAMPOLINE_PHYS_ADDR, AP_TRAMPOLINE_PHYS_ADDR, NORMAL_PAGE_SIZE, VM_EXECUTABLE);
+
+    // Every AP gets each IPI before the delay, instead of going through the whole sequence one AP at a time.
+    //  The second SIPI is only for the APs that missed the first one.
+    const uint64_t start_ns = ktime_get();
+    send_ipi_to_present_aps(ICR_DELIVERY_MODE_INIT | ICR_LEVEL_ASSERT);
+    delay_ns(INIT_TO_STARTUP_DELAY_NS);
+    send_ipi_to_present_aps(ICR_DELIVERY_MODE_STARTUP | ICR_LEVEL_ASSERT | (uint32_t)(AP_TRAMPOLINE_PHYS_ADDR / NORMAL_PAGE_SIZE));
+    delay_ns(STARTUP_TO_STARTUP_DELAY_NS);
+    send_ipi_to_present_aps(ICR_DELIVERY_MODE_STARTUP | ICR_LEVEL_ASSERT | (uint32_t)(AP_TRAMPOLINE_PHYS_ADDR / NORMAL_PAGE_SIZE));
+
+    while(!all_present_cpus_online() && ktime_get() - start_ns < AP_STARTUP_TIMEOUT_NS) {
+        cpu_relax();
+    }
+    const uint64_t bring_up_ns = ktime_get() - start_ns;
+
+    // NOTE: An AP that missed the timeout could still be on its way through the trampoline, so its mapping only goes away once every AP made it.
+    if(all_present_cpus_online()) {
+        unmap_range(&kernel_address_space, AP_TRAMPOLINE_PHYS_ADDR, NORMAL_PAGE_SIZE);
+    }
+
+    char str_buf[32];
+    serial_writestring("SMP: ");
+    serial_writestring(print_digits(smp_number_of_cpus(), str_buf));
+    serial_writestring(" of ");
+    serial_writestring(print_digits(number_of_present_cpus, str_buf));
+    serial_writestring(" CPUs online after ");
+    serial_writestring(print_digits(bring_up_ns / 1000u, str_buf));
+    serial_writestring("us\n");
+}
+
+uint32_t smp_number_of_cpus(void) {
+    return popcount64(__atomic_load_n(&online_cpus_mask, __ATOMIC_ACQUIRE));
+}
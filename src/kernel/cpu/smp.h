@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <kernel/acpi/acpi_tables.h>
+
+// The startup IPI can only start a CPU at a page below 1MiB, so the trampoline gets a fixed page that is reserved at boot.
+//  NOTE: This has to match `AP_TRAMPOLINE_PHYS_ADDR` in ap_trampoline.asm.
+#define AP_TRAMPOLINE_PHYS_ADDR 0x8000ULL
+#define AP_STACK_ORDER 3u // 32KiB, the same as the boot stack
+
+// Starts every enabled CPU from the MADT. All APs are sent INIT-SIPI-SIPI together, so the bring-up takes about the same time
+//  no matter how many there are. Each AP sets up its per-CPU area, GDT/TSS, IDT, local APIC and timer, and then idles.
+//  Must be called on the bootstrap processor after `timer_init()`.
+void smp_init(const struct MADT* MADT_virt_addr);
+
+uint32_t smp_number_of_cpus(void); // the ones that came up, including the bootstrap processor
@@ -0,0 +1,135 @@
+#include "console.h"
+
+#include <stdbool.h>
+
+#include <kernel/error/error.h>
+#include <kernel/mem/mem_constants.h>
+#include <kernel/sync/spinlock.h>
+
+#include "font.h"
+#include "framebuffer.h"
+
+#define CONSOLE_TAB_WIDTH 8u
+
+struct console {
+    uint32_t columns;
+    uint32_t rows;
+    uint32_t column; // of the cursor
+    uint32_t row;
+    uint32_t foreground;
+    uint32_t background;
+    uint32_t glyph_cache[FONT_NUMBER_OF_GLYPHS][CONSOLE_CELL_HEIGHT][CONSOLE_CELL_WIDTH];
+};
+
+static struct console console;
+static struct spinlock console_lock = SPINLOCK_INIT;
+
+static bool font_pixel(const uint32_t glyph, const uint32_t cell_x, const uint32_t cell_y) {
+    if(cell_x < CONSOLE_GLYPH_X_OFFSET || cell_y < CONSOLE_GLYPH_Y_OFFSET) {
+        return false;
+    }
+    const uint32_t font_x = (cell_x - CONSOLE_GLYPH_X_OFFSET) / CONSOLE_GLYPH_SCALE;
+    const uint32_t font_y = (cell_y - CONSOLE_GLYPH_Y_OFFSET) / CONSOLE_GLYPH_SCALE;
+    if(font_x >= FONT_GLYPH_WIDTH || font_y >= FONT_GLYPH_HEIGHT) {
+        return false;
+    }
+    return (font_glyphs[glyph][font_y] >> (FONT_GLYPH_WIDTH - 1u - font_x)) & 1u;
+}
+
+static void expand_glyph_cache(void) {
+    for(uint32_t glyph = 0u; glyph < FONT_NUMBER_OF_GLYPHS; ++glyph) {
+        for(uint32_t y = 0u; y < CONSOLE_CELL_HEIGHT; ++y) {
+            for(uint32_t x = 0u; x < CONSOLE_CELL_WIDTH; ++x) {
+                console.glyph_cache[glyph][y][x] = font_pixel(glyph, x, y) ? console.foreground : console.background;
+            }
+        }
+    }
+}
+
+static void draw_character(const char c) {
+    const uint8_t code = (uint8_t)c;
+    const uint32_t glyph = (code >= FONT_FIRST_CHAR && code < FONT_FIRST_CHAR + FONT_NUMBER_OF_GLYPHS) ? code - FONT_FIRST_CHAR : '?' - FONT_FIRST_CHAR;
+    const uint32_t x = console.column * CONSOLE_CELL_WIDTH;
+    const uint32_t y = console.row * CONSOLE_CELL_HEIGHT;
+
+    for(uint32_t i = 0u; i < CONSOLE_CELL_HEIGHT; ++i) {
+        memcpy(framebuffer_shadow_row(y + i) + x, console.glyph_cache[glyph][i], sizeof(console.glyph_cache[glyph][i]));
+    }
+    framebuffer_mark_dirty(x, y, CONSOLE_CELL_WIDTH, CONSOLE_CELL_HEIGHT);
+}
+
+static void new_line(void) {
+    console.column = 0u;
+    if(console.row + 1u < console.rows) {
+        ++console.row;
+        return;
+    }
+
+    framebuffer_scroll(CONSOLE_CELL_HEIGHT);
+    // the last line now shows what scrolled out at the top, and so do the leftover pixel rows below the last whole line
+    const uint32_t last_line_y = (console.rows - 1u) * CONSOLE_CELL_HEIGHT;
+    framebuffer_fill_rect(0u, last_line_y, framebuffer_width(), framebuffer_height() - last_line_y, console.background);
+}
+
+static void clear_locked(void) {
+    framebuffer_fill_rect(0u, 0u, framebuffer_width(), framebuffer_height(), console.background);
+    console.column = 0u;
+    console.row = 0u;
+}
+
+void console_init(void) {
+    console.columns = framebuffer_width() / CONSOLE_CELL_WIDTH;
+    console.rows = framebuffer_height() / CONSOLE_CELL_HEIGHT;
+    kassert(console.columns > 0u && console.rows > 0u, "The framebuffer is too small for the console.");
+
+    console.foreground = framebuffer_color(0xCCu, 0xCCu, 0xCCu);
+    console.background = framebuffer_color(0u, 0u, 0u);
+    expand_glyph_cache();
+    clear_locked();
+    framebuffer_flush();
+}
+
+void console_set_colors(const uint32_t foreground, const uint32_t background) {
+    const uint64_t rflags = spin_lock_irqsave(&console_lock);
+    console.foreground = foreground;
+    console.background = background;
+    expand_glyph_cache();
+    spin_unlock_irqrestore(&console_lock, rflags);
+}
+
+void console_write(const char *const text, const size_t size) {
+    const uint64_t rflags = spin_lock_irqsave(&console_lock);
+
+    for(size_t i = 0u; i < size; ++i) {
+        switch(text[i]) {
+            case '\n':
+                new_line();
+                break;
+            case '\r':
+                console.column = 0u;
+                break;
+            case '\t':
+                console.column = (uint32_t)min(round_up(console.column + 1u, CONSOLE_TAB_WIDTH), console.columns);
+                if(console.column == console.columns) {
+                    new_line();
+                }
+                break;
+            default:
+                draw_character(text[i]);
+                if(++console.column == console.columns) {
+                    new_line();
+                }
+                break;
+        }
+    }
+    framebuffer_flush();
+
+    spin_unlock_irqrestore(&console_lock, rflags);
+}
+
+void console_clear(void) {
+    const uint64_t rflags = spin_lock_irqsave(&console_lock);
+    clear_locked();
+    framebuffer_flush();
+    spin_unlock_irqrestore(&console_lock, rflags);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libc/required_libc_functions.h>
+
+// A text console on the framebuffer. Every glyph is expanded to 32bpp in the current colors ahead of time,
+//  so drawing a character is one row copy per pixel row, and scrolling moves the start of the framebuffer's
+//  ring of shadow rows instead of copying the whole screen up. Each write flushes once at the end, however many lines it scrolled.
+// NOTE: Must be called after `framebuffer_init()`. Characters outside of printable ASCII are drawn as '?'.
+
+// The 5x7 font is drawn twice as wide and tall, with a pixel of padding around it (and more below for descenders).
+//  Cell pixel (x, y) is font pixel ((x - CONSOLE_GLYPH_X_OFFSET) / CONSOLE_GLYPH_SCALE, (y - CONSOLE_GLYPH_Y_OFFSET) / CONSOLE_GLYPH_SCALE).
+#define CONSOLE_GLYPH_SCALE 2u
+#define CONSOLE_CELL_WIDTH 12u
+#define CONSOLE_CELL_HEIGHT 16u
+#define CONSOLE_GLYPH_X_OFFSET 1u
+#define CONSOLE_GLYPH_Y_OFFSET 1u
+
+void console_init(void);
+
+// `foreground` and `background` are pixel values from `framebuffer_color()`. This rebuilds the glyph cache, but leaves what is on screen alone.
+void console_set_colors(uint32_t foreground, uint32_t background);
+
+void console_write(const char* text, size_t size);
+
+static inline void console_writestring(const char *const text) {
+    console_write(text, strlen(text));
+}
+
+// clears the screen and moves the cursor to the top left
+void console_clear(void);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+// A 5x7 bitmap font for printable ASCII. Row `r` of a glyph is `font_glyphs[c - FONT_FIRST_CHAR][r]`, and bit 4 is the leftmost column.
+//  The console scales it up and pads it into its character cells, so the font itself stays tiny.
+
+#define FONT_GLYPH_WIDTH 5u
+#define FONT_GLYPH_HEIGHT 7u
+#define FONT_FIRST_CHAR 0x20u // ' '
+#define FONT_NUMBER_OF_GLYPHS 95u // up to and including '~'
+
+extern const uint8_t font_glyphs[FONT_NUMBER_OF_GLYPHS][FONT_GLYPH_HEIGHT];
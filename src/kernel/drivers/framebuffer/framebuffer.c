@@ -0,0 +1,162 @@
+#include "framebuffer.h"
+
+#include <libc/required_libc_functions.h>
+#include <kernel/error/error.h>
+#include <kernel/mem/map_mem.h>
+#include <kernel/mem/mem_constants.h>
+#include <kernel/mem/vm/vm_region.h>
+
+struct framebuffer {
+    volatile uint32_t* device; // the write-combining mapping
+    uint32_t* shadow;
+    uint32_t width;
+    uint32_t height;
+    uint32_t device_pitch; // in pixels
+    uint32_t first_row; // the shadow row that is at the top of the screen
+    uint8_t red_shift;
+    uint8_t green_shift;
+    uint8_t blue_shift;
+    // the dirty rectangle is [dirty_x0, dirty_x1) x [dirty_y0, dirty_y1), and empty while `dirty_x0 >= dirty_x1`
+    uint32_t dirty_x0;
+    uint32_t dirty_y0;
+    uint32_t dirty_x1;
+    uint32_t dirty_y1;
+};
+
+static struct framebuffer framebuffer;
+
+static void reset_dirty_rect(void) {
+    framebuffer.dirty_x0 = framebuffer.width;
+    framebuffer.dirty_y0 = framebuffer.height;
+    framebuffer.dirty_x1 = 0u;
+    framebuffer.dirty_y1 = 0u;
+}
+
+void framebuffer_init(const struct boot_framebuffer *const info) {
+    if(info->type != MULTIBOOT_FRAMEBUFFER_TYPE_RGB || info->bpp != 32u || info->pitch % sizeof(uint32_t) != 0u) {
+        halt_and_die("Unsupported framebuffer format.");
+    }
+
+    const uint64_t size = (uint64_t)info->pitch * info->height;
+    // NOTE: The direct map covers the framebuffer too if it is below the end of RAM, and then maps it write-back.
+    //  Two mappings of the same memory with different memory types is undefined behavior, so that alias goes away first.
+    unmap_range(&kernel_address_space, round_down_to_page(GENERAL_MEM_P2V(info->phys_addr)), round_up_to_page(info->phys_addr + size) - round_down_to_page(info->phys_addr));
+
+    framebuffer.device = vm_map_mmio(info->phys_addr, size, VM_WRITEABLE | VM_WRITE_COMBINING);
+    kassert(framebuffer.device != NULL, "Could not map the framebuffer.");
+    framebuffer.width = info->width;
+    framebuffer.height = info->height;
+    framebuffer.device_pitch = info->pitch / sizeof(uint32_t);
+    framebuffer.red_shift = info->red_field_position;
+    framebuffer.green_shift = info->green_field_position;
+    framebuffer.blue_shift = info->blue_field_position;
+
+    const uint64_t shadow_size = (uint64_t)framebuffer.width * framebuffer.height * sizeof(uint32_t);
+    framebuffer.shadow = vm_region_create_kernel(shadow_size, VM_WRITEABLE);
+    kassert(framebuffer.shadow != NULL, "Could not allocate the framebuffer shadow buffer.");
+
+    // the shadow starts out black, so the first flush makes the screen match it
+    memset(framebuffer.shadow, 0, shadow_size);
+    framebuffer.dirty_x0 = 0u;
+    framebuffer.dirty_y0 = 0u;
+    framebuffer.dirty_x1 = framebuffer.width;
+    framebuffer.dirty_y1 = framebuffer.height;
+}
+
+uint32_t framebuffer_width(void) {
+    return framebuffer.width;
+}
+
+uint32_t framebuffer_height(void) {
+    return framebuffer.height;
+}
+
+uint32_t framebuffer_color(const uint8_t red, const uint8_t green, const uint8_t blue) {
+    return ((uint32_t)red << framebuffer.red_shift) | ((uint32_t)green << framebuffer.green_shift) | ((uint32_t)blue << framebuffer.blue_shift);
+}
+
+uint32_t* framebuffer_shadow_row(const uint32_t y) {
+    uint32_t row = framebuffer.first_row + y;
+    if(row >= framebuffer.height) {
+        row -= framebuffer.height;
+    }
+    return framebuffer.shadow + (uint64_t)row * framebuffer.width;
+}
+
+void framebuffer_scroll(const uint32_t rows) {
+    framebuffer.first_row = (uint32_t)(((uint64_t)framebuffer.first_row + rows) % framebuffer.height);
+    framebuffer_mark_dirty(0u, 0u, framebuffer.width, framebuffer.height);
+}
+
+void framebuffer_mark_dirty(const uint32_t x, const uint32_t y, const uint32_t width, const uint32_t height) {
+    if(x >= framebuffer.width || y >= framebuffer.height || width == 0u || height == 0u) {
+        return;
+    }
+    framebuffer.dirty_x0 = (uint32_t)min(framebuffer.dirty_x0, x);
+    framebuffer.dirty_y0 = (uint32_t)min(framebuffer.dirty_y0, y);
+    framebuffer.dirty_x1 = (uint32_t)max(framebuffer.dirty_x1, min((uint64_t)x + width, framebuffer.width));
+    framebuffer.dirty_y1 = (uint32_t)max(framebuffer.dirty_y1, min((uint64_t)y + height, framebuffer.height));
+}
+
+void framebuffer_put_pixel(const uint32_t x, const uint32_t y, const uint32_t color) {
+    if(x >= framebuffer.width || y >= framebuffer.height) {
+        return;
+    }
+    framebuffer_shadow_row(y)[x] = color;
+    framebuffer_mark_dirty(x, y, 1u, 1u);
+}
+
+void framebuffer_fill_rect(const uint32_t x, const uint32_t y, const uint32_t width, const uint32_t height, const uint32_t color) {
+    if(x >= framebuffer.width || y >= framebuffer.height) {
+        return;
+    }
+    const uint32_t clipped_width = (uint32_t)min(width, framebuffer.width - x);
+    const uint32_t clipped_height = (uint32_t)min(height, framebuffer.height - y);
+
+    for(uint32_t row = y; row < y + clipped_height; ++row) {
+        uint32_t *const pixels = framebuffer_shadow_row(row) + x;
+        for(uint32_t i = 0u; i < clipped_width; ++i) {
+            pixels[i] = color;
+        }
+    }
+    framebuffer_mark_dirty(x, y, clipped_width, clipped_height);
+}
+
+// `movnti` only needs SSE2, which every x86_64 CPU has, and works on general purpose registers, so it is fine without SSE state.
+static inline void stream_store_32(volatile uint32_t *const dest, const uint32_t value) {
+    asm volatile("movnti %1, %0" : "=m" (*dest) : "r" (value));
+}
+
+static inline void stream_store_64(volatile uint32_t *const dest, const uint64_t value) {
+    asm volatile("movnti %1, %0" : "=m" (*(volatile uint64_t*)dest) : "r" (value));
+}
+
+static void stream_row(volatile uint32_t* dest, const uint32_t* src, uint32_t count) {
+    if(count > 0u && ((uint64_t)dest & 7u) != 0u) {
+        stream_store_32(dest++, *src++);
+        --count;
+    }
+    for(; count >= 2u; count -= 2u) {
+        stream_store_64(dest, src[0] | (uint64_t)src[1] << 32);
+        dest += 2;
+        src += 2;
+    }
+    if(count > 0u) {
+        stream_store_32(dest, *src);
+    }
+}
+
+void framebuffer_flush(void) {
+    if(framebuffer.dirty_x0 >= framebuffer.dirty_x1) {
+        return;
+    }
+
+    const uint32_t width = framebuffer.dirty_x1 - framebuffer.dirty_x0;
+    for(uint32_t y = framebuffer.dirty_y0; y < framebuffer.dirty_y1; ++y) {
+        stream_row(framebuffer.device + (uint64_t)y * framebuffer.device_pitch + framebuffer.dirty_x0, framebuffer_shadow_row(y) + framebuffer.dirty_x0, width);
+    }
+    // non-temporal stores are weakly ordered, this makes them all visible before anything that comes after the flush
+    asm volatile("sfence" ::: "memory");
+
+    reset_dirty_rect();
+}
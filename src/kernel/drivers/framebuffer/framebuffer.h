@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <kernel/boot/boot_info.h>
+
+// Everything is drawn into a shadow copy of the screen in ordinary write-back RAM, so drawing runs at cache speed and
+//  reading pixels back never touches the device. The framebuffer itself is mapped write-combining (PAT entry 5), and
+//  `framebuffer_flush()` copies only the rectangle that changed since the last flush over with non-temporal stores,
+//  which the CPU sends to the device as full 64 byte bursts instead of one bus transaction per pixel.
+// NOTE: This is not thread-safe, the callers have to serialize drawing and flushing.
+
+// Only 32bpp RGB framebuffers are supported. Must be called after `vm_region_init()` and `idt_init_cpu()`,
+//  since the shadow buffer is demand-faulted in.
+void framebuffer_init(const struct boot_framebuffer* info);
+
+uint32_t framebuffer_width(void);
+uint32_t framebuffer_height(void);
+
+// a pixel value in the framebuffer's own channel layout
+uint32_t framebuffer_color(uint8_t red, uint8_t green, uint8_t blue);
+
+// Row `y` of the screen in the shadow buffer. The shadow is a ring of rows (see `framebuffer_scroll()`), so only a single row
+//  is contiguous. Whoever writes into a row directly has to call `framebuffer_mark_dirty()` for it.
+uint32_t* framebuffer_shadow_row(uint32_t y);
+
+// Moves the screen content up by `rows` by advancing where the ring of shadow rows starts, instead of copying anything.
+//  The `rows` rows that come in at the bottom still hold what scrolled out at the top, so the caller redraws or clears them.
+//  The device has no such offset, so the next flush sends the whole screen.
+void framebuffer_scroll(uint32_t rows);
+
+// These clip to the screen and mark what they draw as dirty.
+void framebuffer_put_pixel(uint32_t x, uint32_t y, uint32_t color);
+void framebuffer_fill_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t color);
+
+// Grows the dirty rectangle so that it also covers this one (clipped to the screen).
+void framebuffer_mark_dirty(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+// Copies the dirty rectangle to the device and resets it.
+void framebuffer_flush(void);
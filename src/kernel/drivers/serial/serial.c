@@ -1,9 +1,59 @@
 #include "serial.h"
 
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/percpu.h>
+#include <kernel/interrupts/idt.h>
+#include <kernel/interrupts/apic/apic.h>
+#include <kernel/interrupts/apic/ioapic.h>
+
+#define UART_DATA 0u
+#define UART_INTERRUPT_ENABLE 1u
+#define UART_INTERRUPT_IDENTIFICATION 2u
+#define UART_LINE_STATUS 5u
+
+#define UART_LINE_STATUS_THR_EMPTY 0x20u // the transmit FIFO is empty
+#define UART_LINE_STATUS_TRANSMITTER_IDLE 0x40u // the FIFO and the shift register are empty, so the last byte is out
+#define UART_INTERRUPT_THR_EMPTY 0x02u
+#define UART_FIFO_SIZE 16u
+#define COM1_IRQ 4u
+
+// Every slot holds a byte and, in its high byte, a tag for the lap of the ring it was written in. A slot only counts as written
+//  once its tag matches the lap of its position, so producers never wait for each other: each one reserves its range with a CAS
+//  on `ring_head` and fills it in at its own pace, and the UART side just stops at the first slot that isn't written yet.
+//  NOTE: A producer can't get a whole lap ahead of `ring_tail`, so an 8-bit tag can't be mistaken for one from 256 laps ago.
+//  The tag of the first lap is 1, so the zeroed ring counts as empty.
+#define SERIAL_RING_SIZE 16384u // a power of 2
+#define SERIAL_RING_MASK (SERIAL_RING_SIZE - 1u)
+// how long a panic waits for another CPU to finish draining before it takes over the UART
+#define SERIAL_PANIC_WAIT_LOOPS 1000000u
+
+static volatile uint16_t serial_ring[SERIAL_RING_SIZE];
+static volatile uint64_t ring_head; // the next position to reserve
+static volatile uint64_t ring_tail; // the next position to send, only written by whoever holds `draining`
+// only one CPU feeds the UART at a time, the others leave the work to it
+static volatile uint32_t draining;
+static volatile bool tx_interrupts_enabled;
+static volatile bool panic_mode;
+
+static inline uint16_t lap_tag(const uint64_t position) {
+    return (uint16_t)((((position / SERIAL_RING_SIZE) + 1u) & 0xFFu) << 8);
+}
+
+static inline bool is_transmit_empty(void) {
+    return (inb(COM1 + UART_LINE_STATUS) & UART_LINE_STATUS_THR_EMPTY) != 0u;
+}
+
+static void polled_putchar(const char c) {
+    while(!is_transmit_empty()) {
+        cpu_relax();
+    }
+    outb(COM1 + UART_DATA, (uint8_t)c);
+}
+
 bool serial_init(void) {
     outb(COM1 + 1, 0x00);    // Disable all interrupts
     outb(COM1 + 3, 0x80);    // Enable DLAB (set baud rate divisor)
-    outb(COM1 + 0, 0x03);    // Set divisor to 3 (lo byte) 38400 baud
+    outb(COM1 + 0, 0x01);    // Set divisor to 1 (lo byte) 115200 baud
     outb(COM1 + 1, 0x00);    //                  (hi byte)
     outb(COM1 + 3, 0x03);    // 8 bits, no parity, one stop bit
     outb(COM1 + 2, 0xC7);    // Enable FIFO, clear them, with 14-byte threshold
@@ -13,10 +63,138 @@ bool serial_init(void) {
 
     if(inb(COM1 + 0) != 0xAE) return false;
 
-    outb(COM1 + 4, 0x0F);
+    outb(COM1 + 4, 0x0F);    // OUT2 stays set, since it gates the UART's IRQ line
     return true;
 }
 
+static bool has_written_bytes(void) {
+    const uint64_t tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+    return (__atomic_load_n(&serial_ring[tail & SERIAL_RING_MASK], __ATOMIC_ACQUIRE) & 0xFF00u) == lap_tag(tail);
+}
+
+// Moves up to `max` written bytes from the ring into the UART. The caller holds `draining` and knows that the FIFO has room.
+static void send_written_bytes(const uint32_t max) {
+    uint64_t tail = ring_tail;
+    for(uint32_t sent = 0u; sent < max; ++sent) {
+        const uint16_t slot = __atomic_load_n(&serial_ring[tail & SERIAL_RING_MASK], __ATOMIC_ACQUIRE);
+        if((slot & 0xFF00u) != lap_tag(tail)) {
+            break;
+        }
+        outb(COM1 + UART_DATA, (uint8_t)slot);
+        ++tail;
+    }
+    // frees the slots for the producers
+    __atomic_store_n(&ring_tail, tail, __ATOMIC_RELEASE);
+}
+
+// Refills the UART's FIFO if it is empty. Called after every write and from the transmitter-empty interrupt.
+//  Without the interrupt, this keeps polling until the ring is empty.
+static void serial_kick(void) {
+    const uint64_t rflags = interrupts_save_and_disable();
+    do {
+        if(__atomic_exchange_n(&draining, 1u, __ATOMIC_ACQUIRE) != 0u) {
+            break; // the CPU that is draining looks at the ring again once it is done
+        }
+        if(is_transmit_empty()) {
+            send_written_bytes(UART_FIFO_SIZE);
+        }
+        __atomic_store_n(&draining, 0u, __ATOMIC_RELEASE);
+        // A writer that found `draining` taken relies on this last look at the ring.
+        //  This pairs with the fence between writing the slots and the exchange on `draining` in `serial_write()`.
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    } while(has_written_bytes() && (!tx_interrupts_enabled || is_transmit_empty()));
+    interrupts_restore(rflags);
+}
+
+void serial_write(const char *const text, const size_t size) {
+    if(panic_mode) {
+        for(size_t i = 0u; i < size; ++i) {
+            polled_putchar(text[i]);
+        }
+        return;
+    }
+
+    // a string that doesn't fit into the ring goes in pieces
+    for(size_t written = 0u; written < size;) {
+        const uint64_t chunk = (size - written < SERIAL_RING_SIZE) ? size - written : SERIAL_RING_SIZE;
+
+        // NOTE: Interrupts are disabled from reserving a range until it is written, since a handler that writes on the same CPU
+        //  could otherwise fill the ring up behind the range and wait for room forever.
+        const uint64_t rflags = interrupts_save_and_disable();
+        uint64_t head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+        for(;;) {
+            if(head + chunk - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) > SERIAL_RING_SIZE) {
+                // the ring is full, so this writer has to help empty it
+                serial_kick();
+                cpu_relax();
+                head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+                continue;
+            }
+            if(__atomic_compare_exchange_n(&ring_head, &head, head + chunk, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        for(uint64_t i = 0u; i < chunk; ++i) {
+            const uint64_t position = head + i;
+            __atomic_store_n(&serial_ring[position & SERIAL_RING_MASK], (uint16_t)(lap_tag(position) | (uint8_t)text[written + i]), __ATOMIC_RELEASE);
+        }
+        interrupts_restore(rflags);
+        written += chunk;
+
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        serial_kick();
+    }
+}
+
+void serial_flush(void) {
+    while(__atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE)) {
+        serial_kick();
+        cpu_relax();
+    }
+    while(!(inb(COM1 + UART_LINE_STATUS) & UART_LINE_STATUS_TRANSMITTER_IDLE)) {
+        cpu_relax();
+    }
+}
+
+static void serial_interrupt(struct interrupt_frame *const frame) {
+    (void)frame;
+    // reading the identification register acknowledges the transmitter-empty interrupt
+    (void)inb(COM1 + UART_INTERRUPT_IDENTIFICATION);
+    serial_kick();
+}
+
+void serial_enable_interrupts(void) {
+    idt_register_handler(SERIAL_VECTOR, serial_interrupt);
+    ioapic_route_isa_irq(COM1_IRQ, SERIAL_VECTOR, this_cpu()->apic_id);
+
+    __atomic_store_n(&tx_interrupts_enabled, true, __ATOMIC_SEQ_CST);
+    // the UART raises the interrupt right away if the FIFO is already empty
+    outb(COM1 + UART_INTERRUPT_ENABLE, UART_INTERRUPT_THR_EMPTY);
+}
+
+void serial_panic_write(const char *const text) {
+    (void)interrupts_save_and_disable();
+    __atomic_store_n(&panic_mode, true, __ATOMIC_SEQ_CST);
+
+    // Another CPU might be feeding the UART right now. It gets a moment to finish, but it might also be the one that is stuck.
+    for(uint32_t i = 0u; i < SERIAL_PANIC_WAIT_LOOPS && __atomic_load_n(&draining, __ATOMIC_ACQUIRE) != 0u; ++i) {
+        cpu_relax();
+    }
+    __atomic_store_n(&draining, 1u, __ATOMIC_SEQ_CST);
+
+    // A writer that never finishes its range (e.g. the one that panicked) would stop the flush there, so the ring is sent up to its head
+    //  and whatever was not written in time comes out as the bytes that were in those slots before.
+    const uint64_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+    for(uint64_t position = ring_tail; position < head; ++position) {
+        polled_putchar((char)(uint8_t)serial_ring[position & SERIAL_RING_MASK]);
+    }
+    ring_tail = head;
+
+    for(size_t i = 0u; text[i] != '\0'; ++i) {
+        polled_putchar(text[i]);
+    }
+}
+
 
 
 
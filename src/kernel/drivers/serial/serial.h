@@ -24,28 +24,28 @@ static inline uint8_t serial_read(void) {
     return inb(COM1);
 }
 
-static inline uint8_t is_transmit_empty(void) {
-    return inb(COM1 + 5) & 0x20u;
-}
+// Output goes through a lock-free ring buffer that any CPU can write into without waiting for the UART.
+//  Once `serial_enable_interrupts()` ran, the ring is drained by the transmitter-empty interrupt, 16 bytes (a whole FIFO) at a time.
+//  Before that, a write waits until the ring is empty again, just like writing to the UART directly.
+void serial_write(const char* text, size_t size);
 
 static inline void serial_putchar(const char c) {
-    while (is_transmit_empty() == 0);
-
-    outb(COM1, (uint8_t)c);
-}
-
-static inline void serial_write(const char *const text, const size_t size) {
-    for(size_t i = 0u; i < size; ++i) {
-        serial_putchar(text[i]);
-    }
+    serial_write(&c, 1u);
 }
 
 static inline void serial_writestring(const char *const text) {
     serial_write(text, strlen(text));
 }
 
+// Waits until everything written so far has left the UART, e.g. before the machine is turned off.
+void serial_flush(void);
 
+// Routes the UART's interrupt through the I/O APIC to the current CPU. Must be called after `ioapic_init()`.
+void serial_enable_interrupts(void);
 
+// For `halt_and_die()`: disables interrupts, sends everything in the ring, and then `text`, by polling the UART.
+//  From then on every write goes to the UART directly, so nothing that comes after a panic gets stuck in the ring either.
+void serial_panic_write(const char* text);
 
 // TODO: Remove this later
 char* print_digits(uint64_t input, char* string_ret);
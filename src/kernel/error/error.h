@@ -9,7 +9,7 @@ static inline __attribute__((noreturn)) void halt(void) {
 }
 
 static inline __attribute__((noreturn)) void halt_and_die(const char *const str) {
-    serial_writestring(str);
+    serial_panic_write(str);
     halt();
 }
 
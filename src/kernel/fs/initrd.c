@@ -0,0 +1,251 @@
+#include "initrd.h"
+
+#include <libc/required_libc_functions.h>
+#include <kernel/error/error.h>
+
+#include <kernel/drivers/serial/serial.h>
+#include <kernel/mem/phys/phys_mem_allocator.h>
+#include <kernel/mem/slab/slab.h>
+
+#define USTAR_BLOCK_SIZE 512u
+
+struct ustar_header {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6]; // "ustar\0" for POSIX, "ustar " for GNU tar
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155]; // prepended to `name` with a "/" in between, for paths that do not fit into `name`
+    char padding[12];
+} __attribute__ ((packed));
+
+_Static_assert(sizeof(struct ustar_header) == USTAR_BLOCK_SIZE, "A ustar header must be exactly one block.");
+
+#define USTAR_TYPE_REGULAR_FILE '0'
+#define USTAR_TYPE_REGULAR_FILE_OLD '\0' // pre-POSIX archives
+
+// The files live in a growable array and the index is an open addressing hash table of `file index + 1` (0 = empty slot),
+//  which gets rebuilt at twice the size whenever it is half full. Both are allocated straight from the buddy allocator since they outgrow kmalloc.
+#define INITRD_INITIAL_TABLE_ORDER 0u
+
+static struct initrd_file* initrd_files;
+static uint64_t initrd_file_count;
+static uint64_t initrd_file_capacity;
+static uint32_t initrd_files_order;
+
+static uint32_t* initrd_hash_slots;
+static uint64_t initrd_number_of_hash_slots; // always a power of two
+static uint32_t initrd_hash_slots_order;
+
+static void* allocate_table(const uint32_t order) {
+    return (void*)GENERAL_MEM_P2V(phys_mem_allocate_pages(order));
+}
+
+static void free_table(void *const table, const uint32_t order) {
+    phys_mem_free_pages(GENERAL_MEM_V2P((uint64_t)table), order);
+}
+
+// FNV-1a
+static uint64_t hash_path(const char* path) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for(; *path != '\0'; ++path) {
+        hash ^= (uint8_t)*path;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static uint64_t parse_octal(const char *const field, const size_t length) {
+    uint64_t value = 0u;
+    for(size_t i = 0u; i < length; ++i) {
+        if(field[i] == ' ') continue;
+        if(field[i] < '0' || field[i] > '7') break;
+        value = value*8u + (uint64_t)(field[i] - '0');
+    }
+    return value;
+}
+
+static size_t bounded_strlen(const char *const str, const size_t max_length) {
+    size_t length = 0u;
+    while(length < max_length && str[length] != '\0') {
+        ++length;
+    }
+    return length;
+}
+
+static bool is_valid_header(const struct ustar_header *const header) {
+    if(strncmp(header->magic, "ustar", 5u) != 0) {
+        return false;
+    }
+
+    // the checksum is the sum of every header byte, with the checksum field itself counted as spaces
+    const uint8_t *const bytes = (const uint8_t*)header;
+    uint64_t checksum = 0u;
+    for(size_t i = 0u; i < USTAR_BLOCK_SIZE; ++i) {
+        const bool is_checksum_field = i >= offsetof(struct ustar_header, checksum) && i < offsetof(struct ustar_header, checksum) + sizeof(header->checksum);
+        checksum += is_checksum_field ? (uint64_t)' ' : bytes[i];
+    }
+    return checksum == parse_octal(header->checksum, sizeof(header->checksum));
+}
+
+// Most paths are already NUL terminated inside the header and are used in place.
+//  Only a path that is split into `prefix` and `name`, or fills all of `name`, gets copied.
+static const char* header_path(const struct ustar_header *const header) {
+    const size_t prefix_length = bounded_strlen(header->prefix, sizeof(header->prefix));
+    const size_t name_length = bounded_strlen(header->name, sizeof(header->name));
+
+    const char* path = header->name;
+    if(prefix_length != 0u || name_length == sizeof(header->name)) {
+        char *const joined_path = kmalloc(prefix_length + 1u + name_length + 1u);
+        size_t length = 0u;
+        if(prefix_length != 0u) {
+            memcpy(joined_path, header->prefix, prefix_length);
+            joined_path[prefix_length] = '/';
+            length = prefix_length + 1u;
+        }
+        memcpy(&joined_path[length], header->name, name_length);
+        joined_path[length + name_length] = '\0';
+        path = joined_path;
+    }
+
+    // `tar -C initrd .` stores everything under "./"
+    while(path[0] == '.' && path[1] == '/') {
+        path += 2;
+    }
+    while(path[0] == '/') {
+        ++path;
+    }
+    return path;
+}
+
+static void insert_into_hash_slots(const uint32_t file_index) {
+    const uint64_t mask = initrd_number_of_hash_slots - 1u;
+    uint64_t slot = initrd_files[file_index].path_hash & mask;
+    while(initrd_hash_slots[slot] != 0u) {
+        slot = (slot + 1u) & mask;
+    }
+    initrd_hash_slots[slot] = file_index + 1u;
+}
+
+static void grow_hash_slots(void) {
+    free_table(initrd_hash_slots, initrd_hash_slots_order);
+
+    ++initrd_hash_slots_order;
+    initrd_hash_slots = allocate_table(initrd_hash_slots_order);
+    initrd_number_of_hash_slots = (NORMAL_PAGE_SIZE << initrd_hash_slots_order)/sizeof(uint32_t);
+    memset(initrd_hash_slots, 0, NORMAL_PAGE_SIZE << initrd_hash_slots_order);
+
+    for(uint32_t i = 0u; i < initrd_file_count; ++i) {
+        insert_into_hash_slots(i);
+    }
+}
+
+static void grow_files(void) {
+    struct initrd_file *const old_files = initrd_files;
+    const uint32_t old_order = initrd_files_order;
+
+    ++initrd_files_order;
+    initrd_files = allocate_table(initrd_files_order);
+    initrd_file_capacity = (NORMAL_PAGE_SIZE << initrd_files_order)/sizeof(struct initrd_file);
+    memcpy(initrd_files, old_files, initrd_file_count*sizeof(struct initrd_file));
+
+    free_table(old_files, old_order);
+}
+
+static void add_file(const char *const path, const uint8_t *const data, const uint64_t size) {
+    if(initrd_file_count == initrd_file_capacity) {
+        grow_files();
+    }
+    if(2u*(initrd_file_count + 1u) > initrd_number_of_hash_slots) {
+        grow_hash_slots();
+    }
+
+    initrd_files[initrd_file_count] = (struct initrd_file) { path, hash_path(path), data, size };
+    insert_into_hash_slots((uint32_t)initrd_file_count);
+    ++initrd_file_count;
+}
+
+void initrd_init(const uint64_t module_phys_start, const uint64_t module_phys_end) {
+    initrd_files_order = INITRD_INITIAL_TABLE_ORDER;
+    initrd_files = allocate_table(initrd_files_order);
+    initrd_file_capacity = (NORMAL_PAGE_SIZE << initrd_files_order)/sizeof(struct initrd_file);
+    initrd_file_count = 0u;
+
+    initrd_hash_slots_order = INITRD_INITIAL_TABLE_ORDER;
+    initrd_hash_slots = allocate_table(initrd_hash_slots_order);
+    initrd_number_of_hash_slots = (NORMAL_PAGE_SIZE << initrd_hash_slots_order)/sizeof(uint32_t);
+    memset(initrd_hash_slots, 0, NORMAL_PAGE_SIZE << initrd_hash_slots_order);
+
+    const uint8_t *const archive_start = (const uint8_t*)GENERAL_MEM_P2V(module_phys_start);
+    const uint64_t archive_size = module_phys_end - module_phys_start;
+
+    // the archive ends with two zeroed blocks, but a truncated one just ends at the end of the module
+    uint64_t archive_offset = 0u;
+    while(archive_offset + USTAR_BLOCK_SIZE <= archive_size) {
+        const struct ustar_header *const header = (const struct ustar_header*)&archive_start[archive_offset];
+        if(header->name[0] == '\0') {
+            break;
+        }
+        if(!is_valid_header(header)) {
+            halt_and_die("The initrd is not a valid ustar archive.");
+        }
+
+        const uint64_t size = parse_octal(header->size, sizeof(header->size));
+        const uint64_t data_offset = archive_offset + USTAR_BLOCK_SIZE;
+        if(size > archive_size - data_offset) {
+            halt_and_die("An initrd file runs past the end of the archive.");
+        }
+
+        if(header->typeflag == USTAR_TYPE_REGULAR_FILE || header->typeflag == USTAR_TYPE_REGULAR_FILE_OLD) {
+            add_file(header_path(header), &archive_start[data_offset], size);
+        }
+
+        archive_offset = data_offset + round_up(size, USTAR_BLOCK_SIZE);
+    }
+}
+
+const struct initrd_file* initrd_lookup(const char* path) {
+    while(path[0] == '/') {
+        ++path;
+    }
+
+    const uint64_t hash = hash_path(path);
+    const uint64_t mask = initrd_number_of_hash_slots - 1u;
+    for(uint64_t slot = hash & mask; initrd_hash_slots[slot] != 0u; slot = (slot + 1u) & mask) {
+        const struct initrd_file *const file = &initrd_files[initrd_hash_slots[slot] - 1u];
+        if(file->path_hash == hash && strncmp(file->path, path, SIZE_MAX) == 0) {
+            return file;
+        }
+    }
+    return NULL;
+}
+
+uint64_t initrd_number_of_files(void) {
+    return initrd_file_count;
+}
+
+const struct initrd_file* initrd_file_at(const uint64_t index) {
+    kassert(index < initrd_file_count, "Initrd file index is out of bounds.");
+    return &initrd_files[index];
+}
+
+const void* initrd_map_file(struct address_space *const address_space, const struct initrd_file *const file, const uint64_t virt_addr, const uint32_t flags) {
+    kassert(offset_in_page(virt_addr) == 0u, "Initrd files must be mapped at a page aligned address.");
+
+    const uint64_t data_phys_addr = GENERAL_MEM_V2P((uint64_t)file->data);
+    const uint64_t first_page_phys_addr = round_down_to_page(data_phys_addr);
+    const uint64_t offset_into_first_page = data_phys_addr - first_page_phys_addr;
+
+    map_range(address_space, virt_addr, first_page_phys_addr, round_up_to_page(offset_into_first_page + file->size), flags & ~VM_WRITEABLE);
+    return (const void*)(virt_addr + offset_into_first_page);
+}
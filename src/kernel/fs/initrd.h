@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <kernel/mem/map_mem.h>
+
+// The initrd is a ustar archive (see the `ramdisk.img` rule in the Makefile) that stays where the bootloader put it.
+//  `initrd_init()` walks the archive once and builds a hash index of the regular files, and every file access afterwards
+//  hands out pointers straight into the module through the direct map instead of copying.
+
+struct initrd_file {
+    const char* path; // relative to the archive root without a leading "./" or "/", NUL terminated
+    uint64_t path_hash;
+    const uint8_t* data; // direct map address inside the module
+    uint64_t size;
+};
+
+// `module_phys_start` and `module_phys_end` come from the multiboot module tag, and the module memory must stay reserved
+void initrd_init(uint64_t module_phys_start, uint64_t module_phys_end);
+
+// O(1) on average. `path` may start with "/". Returns NULL if there is no such regular file.
+const struct initrd_file* initrd_lookup(const char* path);
+
+uint64_t initrd_number_of_files(void);
+// for iterating over every file, in archive order
+const struct initrd_file* initrd_file_at(uint64_t index);
+
+// Maps the pages holding `file` read-only at `virt_addr` (which must be page aligned) and returns the address that the file data starts at.
+//  The first and last page can also show neighbouring bytes of the archive.
+const void* initrd_map_file(struct address_space* address_space, const struct initrd_file* file, uint64_t virt_addr, uint32_t flags);
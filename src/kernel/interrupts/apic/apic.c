@@ -1,32 +1,77 @@
 #include "apic.h"
 
-struct IDT_entry interrupt_descriptor_table[256];
+#include <kernel/cpu/cpu_features.h>
+#include <kernel/error/error.h>
+#include <kernel/interrupts/idt.h>
+#include <kernel/io/port_io.h>
+
+#define PIC1_COMMAND 0x20u
+#define PIC1_DATA 0x21u
+#define PIC2_COMMAND 0xA0u
+#define PIC2_DATA 0xA1u
+
+#define PIC_ICW1_INIT 0x10u
+#define PIC_ICW1_ICW4 0x01u // ICW4 follows
+#define PIC_ICW4_8086 0x01u
+#define PIC1_CASCADE_IRQ 2u // the slave PIC is wired to IRQ 2 of the master
+#define PIC_MASK_ALL 0xFFu
+
+// an access to an unused port takes about 1us, which gives an old PIC time to react between the initialization words
+static inline void io_wait(void) {
+    outb(0x80u, 0u);
+}
 
 void remap_and_mask_pic_interrupts(void) {
-    
+    outb(PIC1_COMMAND, PIC_ICW1_INIT | PIC_ICW1_ICW4);
+    io_wait();
+    outb(PIC2_COMMAND, PIC_ICW1_INIT | PIC_ICW1_ICW4);
+    io_wait();
+    outb(PIC1_DATA, PIC1_VECTOR_OFFSET);
+    io_wait();
+    outb(PIC2_DATA, PIC2_VECTOR_OFFSET);
+    io_wait();
+    outb(PIC1_DATA, 1u << PIC1_CASCADE_IRQ);
+    io_wait();
+    outb(PIC2_DATA, PIC1_CASCADE_IRQ); // the slave gets the cascade IRQ as a number, not as a bit
+    io_wait();
+    outb(PIC1_DATA, PIC_ICW4_8086);
+    io_wait();
+    outb(PIC2_DATA, PIC_ICW4_8086);
+    io_wait();
+
+    outb(PIC1_DATA, PIC_MASK_ALL);
+    outb(PIC2_DATA, PIC_MASK_ALL);
 }
 
-void idt_register_handler(const uint8_t interrupt, const uint32_t address) {
-    
+static void apic_error_interrupt(struct interrupt_frame *const frame) {
+    (void)frame;
+    char str_buf[32];
+
+    // the error status register only latches new errors on a write
+    wrmsr(X2APIC_ERROR_STATUS_MSR, 0u);
+    const uint64_t error_status = rdmsr(X2APIC_ERROR_STATUS_MSR);
+
+    serial_writestring("APIC error, status 0x");
+    serial_writestring(print_hex(error_status, str_buf));
+    serial_writestring("\n");
 }
 
-void idt_init(void) {
-    if(!is_x2apic_supported()) {
+void apic_init(void) {
+    if(!cpu_has(X86_FEATURE_X2APIC)) {
         halt_and_die("x2apic is unsupported.");
     }
 
+    remap_and_mask_pic_interrupts();
+    idt_register_handler(APIC_ERROR_VECTOR, apic_error_interrupt);
+    apic_init_cpu();
+}
+
+void apic_init_cpu(void) {
     enable_x2apic();
 
+    // NOTE: The timer LVT is set up by `timer_init()`, which only arms it once a timer is pending.
     mask_all_lvt_registers();
 
-    set_timer_to_tsc_deadline_mode();
-
-    write_deadline_value(TSC_DEADLINE_QUANTUM);
-
-    struct descriptor_table_pseudo_register descriptor_table;
-    descriptor_table.limit = sizeof(interrupt_descriptor_table) - 1;
-    descriptor_table.base = (uint64_t) interrupt_descriptor_table;
-
-    asm volatile("lidt %0" : : "m"(descriptor_table));
+    wrmsr(X2APIC_LVT_ERROR_MSR, APIC_ERROR_VECTOR);
+    wrmsr(X2APIC_SPURIOUS_INTERRUPT_VECTOR_MSR, APIC_SOFTWARE_ENABLE | SPURIOUS_INTERRUPT_VECTOR);
 }
-
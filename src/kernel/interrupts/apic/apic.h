@@ -3,35 +3,59 @@
 #include <stdint.h>
 #include <stddef.h>
 
-struct IDT_entry {
-    uint16_t offset_lower_bits;
-    uint16_t segment_selector;
-    uint8_t ist;
-    uint8_t type_attr;
-    uint16_t offset_mid_bits;
-    uint32_t offset_high_bits;
-    uint32_t reserved;
-} __attribute__ ((packed));
-
-struct descriptor_table_pseudo_register {
-    uint16_t limit;
-    uint64_t base;
-} __attribute__ ((packed));
-
-// For now we are hardcoding our times based on a clock rate of 3GHz.
-//  Thus, the below is equal to 1ms.
-// TODO: We should use cpuid leaf 0x15 or fallback to HPET calibration to
-//  determine the ticks to time rate (which varies by clock rate).
-#define TSC_DEADLINE_QUANTUM 3000000ULL
-
-// 1 = supported, 0 = unsupported
-extern uint64_t is_x2apic_supported(void);
+#include <kernel/cpu/cpu.h>
+
+// the highest vectors are used for IPIs and the local APIC
+#define LOCAL_TIMER_VECTOR 0xEFu
+#define TLB_SHOOTDOWN_VECTOR 0xF0u
+#define RESCHEDULE_VECTOR 0xF1u // wakes an idle CPU so that it looks for work, the handler itself does nothing
+#define APIC_ERROR_VECTOR 0xFEu
+#define SPURIOUS_INTERRUPT_VECTOR 0xFFu
+
+// The legacy 8259 PICs are remapped away from the exception vectors and then masked, since everything goes through the local APIC.
+//  Their vectors still have to be valid, since a PIC can raise a spurious IRQ 7/15 even while masked.
+#define PIC1_VECTOR_OFFSET 0x20u
+#define PIC2_VECTOR_OFFSET 0x28u
+
+// device interrupts routed through the I/O APIC, see ioapic.h
+#define SERIAL_VECTOR 0x30u
+
+// masks the PICs and calls `apic_init_cpu()`, only called on the bootstrap processor
+void apic_init(void);
+// enables the x2APIC of the current CPU (which everything else here depends on) and masks all its local interrupts but the error interrupt
+void apic_init_cpu(void);
+void remap_and_mask_pic_interrupts(void);
+
 extern void enable_x2apic(void);
 
 extern void mask_all_lvt_registers(void);
 extern void unmask_used_lvt_registers(void);
 
-extern void set_timer_to_tsc_deadline_mode(void);
-extern void write_deadline_value(uint64_t delta_ticks);
-
-
+#define X2APIC_EOI_MSR 0x80Bu
+#define X2APIC_SPURIOUS_INTERRUPT_VECTOR_MSR 0x80Fu
+#define X2APIC_ERROR_STATUS_MSR 0x828u
+#define X2APIC_LVT_TIMER_MSR 0x832u
+#define X2APIC_LVT_ERROR_MSR 0x837u
+#define APIC_SOFTWARE_ENABLE (1u << 8) // in the spurious interrupt vector register, without it every LVT stays masked
+#define LVT_TIMER_TSC_DEADLINE_MODE (2u << 17) // bits 18:17 = 10, the vector goes into bits 7:0 and the mask bit 16 stays clear
+// The timer fires once the TSC reaches the value written here, and writing 0 disarms it.
+#define IA32_TSC_DEADLINE_MSR 0x6E0u
+
+// fixed delivery to a single CPU, addressed by its x2APIC id
+extern void x2apic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+#define X2APIC_INTERRUPT_COMMAND_MSR 0x830u
+#define ICR_DELIVERY_MODE_INIT (5u << 8)
+#define ICR_DELIVERY_MODE_STARTUP (6u << 8) // the vector is the page number the CPU starts at
+#define ICR_LEVEL_ASSERT (1u << 14)
+
+// for IPIs other than fixed ones, e.g. INIT and SIPI
+static inline void x2apic_write_icr(const uint32_t apic_id, const uint32_t command) {
+    wrmsr(X2APIC_INTERRUPT_COMMAND_MSR, ((uint64_t)apic_id << 32) | command);
+}
+
+// In x2APIC mode the EOI register is an MSR, so this is a single `wrmsr` instead of an uncached MMIO write.
+//  NOTE: Any value other than 0 causes a general protection fault.
+static inline void x2apic_send_eoi(void) {
+    wrmsr(X2APIC_EOI_MSR, 0u);
+}
@@ -1,5 +1,3 @@
-CPUID_ECX_FEATURE_X2APIC_MODE equ 1 << 21
-
 IA32_APIC_BASE equ 0x1B
 
 XAPIC_GLOBAL_ENABLE equ 1 << 11
@@ -15,27 +13,11 @@ LVT_ERROR_REGISTER equ 0x837
 
 MASKING_BIT equ 1 << 16
 
-LVT_TIMER_MODE_MASK equ 3 << 17
-LVT_TIMER_TSC_DEADLINE_MODE equ 2 << 17 ; write 10 to bits 18:17
-IA32_TSC_DEADLINE_MSR_ADDRESS equ 0x6E0
+X2APIC_INTERRUPT_COMMAND_REGISTER equ 0x830
+ICR_LEVEL_ASSERT equ 1 << 14 ; delivery mode (bits 10:8) = 000 for fixed, destination mode (bit 11) = 0 for physical
 
 section .text
 
-global is_x2apic_supported
-is_x2apic_supported:
-    push rbx ; cpuid clobbers ebx, so we must save it
-
-    xor ecx, ecx
-    mov eax, 1
-    cpuid
-
-    test ecx, CPUID_ECX_FEATURE_X2APIC_MODE
-    setnz al        ; AL = 1 if supported, 0 otherwise
-    movzx rax, al   ; zero-extend to full RAX
-
-    pop rbx
-    ret
-
 global enable_x2apic
 enable_x2apic:
     ; we do not modify rbx, so don't need to save it
@@ -104,36 +86,20 @@ unmask_used_lvt_registers:
 
     ret
 
-global set_timer_to_tsc_deadline_mode
-set_timer_to_tsc_deadline_mode:
+global x2apic_send_ipi
+x2apic_send_ipi:
     ; we do not modify rbx, so don't need to save it
 
-    mov ecx, LVT_TIMER_REGISTER
-    rdmsr
-    and eax, ~LVT_TIMER_MODE_MASK ; clear bits 18:17
-    or eax, LVT_TIMER_TSC_DEADLINE_MODE ; set bits 18:17 to 10, which is the value for TSC-deadline
-    wrmsr
-
-    ret
-
-global write_deadline_value
-write_deadline_value:
-    ; we do not modify rbx, so don't need to save it
-
-    mov rdi, rax
-
-    ; TODO: Look into using rdtscp, especially when we do SMP
-    rdtsc ; EDX:EAX = current TSC
-
-    mov rdi, TSC_DEADLINE_QUANTUM
-
-    mov ecx, edi ; ECX = low 32 bits of delta
-    shr rdi, 32 ; RDI = high 32 bits of delta
-
-    add eax, ecx ; add low half
-    adc edx, edi ; add high half + carry
-
-    mov ecx, IA32_TSC_DEADLINE_MSR_ADDRESS
+    ; In x2APIC mode the ICR is a single 64-bit MSR, with the destination in the upper 32 bits.
+    ; Writing it sends the IPI, so unlike xAPIC mode there is no need to split the write or poll the delivery status.
+    movzx eax, sil ; EAX = vector
+    or eax, ICR_LEVEL_ASSERT
+    mov edx, edi ; EDX = destination x2APIC id
+    mov ecx, X2APIC_INTERRUPT_COMMAND_REGISTER
+    ; The WRMSR to the x2APIC ICR is not serializing, so without the fences the IPI can arrive before earlier stores
+    ; (e.g. a TLB shootdown request) are visible to the target. This is the same fence pair that Linux uses.
+    mfence
+    lfence
     wrmsr
 
     ret
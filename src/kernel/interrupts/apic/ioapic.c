@@ -0,0 +1,137 @@
+#include "ioapic.h"
+
+#include <stdbool.h>
+
+#include <kernel/error/error.h>
+#include <kernel/mem/map_mem.h>
+#include <kernel/mem/vm/vm_region.h>
+#include <kernel/sync/spinlock.h>
+
+// The registers are accessed indirectly: the index goes into IOREGSEL, and the register is then read or written through IOWIN.
+#define IOAPIC_IOREGSEL 0x00u
+#define IOAPIC_IOWIN 0x10u
+#define IOAPIC_REGISTERS_SIZE 0x20u
+
+#define IOAPIC_VERSION_REGISTER 0x01u
+#define IOAPIC_REDIRECTION_TABLE 0x10u // entry `i` is the register pair at 0x10 + 2*i
+
+#define REDIRECTION_ACTIVE_LOW (1u << 13)
+#define REDIRECTION_LEVEL_TRIGGERED (1u << 15)
+#define REDIRECTION_MASKED (1u << 16)
+#define REDIRECTION_DESTINATION_SHIFT 24u // in the high register, in physical destination mode
+
+// the polarity and trigger mode fields of `InterruptSourceOverrideStructure::Flags`, where 0 means "the default of the bus"
+#define MPS_INTI_ACTIVE_LOW 3u
+#define MPS_INTI_LEVEL_TRIGGERED (3u << 2)
+
+struct ioapic {
+    volatile uint32_t* registers;
+    uint32_t gsi_base;
+    uint32_t number_of_entries;
+};
+
+// ISA IRQ `i` is global system interrupt `i` (edge-triggered, active high), unless the MADT has an override for it
+struct isa_irq_route {
+    uint32_t gsi;
+    uint16_t flags; // MPS INTI flags
+};
+
+static struct ioapic ioapics[MAX_IOAPICS];
+static uint32_t number_of_ioapics;
+static struct isa_irq_route isa_irq_routes[NUMBER_OF_ISA_IRQS];
+
+// IOREGSEL and IOWIN of an I/O APIC are used as a pair
+static struct spinlock ioapic_lock = SPINLOCK_INIT;
+
+static uint32_t ioapic_read(const struct ioapic *const ioapic, const uint32_t reg) {
+    ioapic->registers[IOAPIC_IOREGSEL / sizeof(uint32_t)] = reg;
+    return ioapic->registers[IOAPIC_IOWIN / sizeof(uint32_t)];
+}
+
+static void ioapic_write(const struct ioapic *const ioapic, const uint32_t reg, const uint32_t value) {
+    ioapic->registers[IOAPIC_IOREGSEL / sizeof(uint32_t)] = reg;
+    ioapic->registers[IOAPIC_IOWIN / sizeof(uint32_t)] = value;
+}
+
+static void add_ioapic(const struct IO_APIC_Structure *const entry) {
+    if(number_of_ioapics == MAX_IOAPICS) {
+        return;
+    }
+
+    struct ioapic *const ioapic = &ioapics[number_of_ioapics];
+    ioapic->registers = vm_map_mmio(entry->IO_APIC_Address, IOAPIC_REGISTERS_SIZE, VM_WRITEABLE | VM_UNCACHED);
+    kassert(ioapic->registers != NULL, "Could not map the I/O APIC.");
+    ioapic->gsi_base = entry->GlobalSystemInterruptBase;
+    ioapic->number_of_entries = ((ioapic_read(ioapic, IOAPIC_VERSION_REGISTER) >> 16) & 0xFFu) + 1u;
+
+    for(uint32_t i = 0u; i < ioapic->number_of_entries; ++i) {
+        ioapic_write(ioapic, IOAPIC_REDIRECTION_TABLE + 2u*i, REDIRECTION_MASKED);
+    }
+    ++number_of_ioapics;
+}
+
+void ioapic_init(const struct MADT *const MADT_virt_addr) {
+    for(uint32_t irq = 0u; irq < NUMBER_OF_ISA_IRQS; ++irq) {
+        isa_irq_routes[irq] = (struct isa_irq_route){ irq, 0u };
+    }
+
+    const uint64_t total_len = MADT_virt_addr->header.Length;
+    uint64_t offset = sizeof(struct MADT);
+    const uint8_t* ptr = (const uint8_t*)MADT_virt_addr->InterruptControllerStructure;
+
+    while(offset + sizeof(struct InterruptEntryHeader) <= total_len) {
+        const struct InterruptEntryHeader *const current_header = (const struct InterruptEntryHeader*) ptr;
+        if(current_header->Length < sizeof(struct InterruptEntryHeader) || offset + current_header->Length > total_len) {
+            halt_and_die("MADT entry has invalid Length.");
+        }
+
+        if(current_header->Type == 1 && current_header->Length >= sizeof(struct IO_APIC_Structure)) {
+            add_ioapic((const struct IO_APIC_Structure*) ptr);
+        }
+        else if(current_header->Type == 2 && current_header->Length >= sizeof(struct InterruptSourceOverrideStructure)) {
+            const struct InterruptSourceOverrideStructure *const entry = (const struct InterruptSourceOverrideStructure*) ptr;
+            // bus 0 is ISA, which is the only bus overrides exist for
+            if(entry->Bus == 0u && entry->Source < NUMBER_OF_ISA_IRQS) {
+                isa_irq_routes[entry->Source] = (struct isa_irq_route){ entry->GlobalSystemInterrupt, entry->Flags };
+            }
+        }
+
+        offset += current_header->Length;
+        ptr += current_header->Length;
+    }
+
+    if(number_of_ioapics == 0u) {
+        halt_and_die("No I/O APIC in the MADT.");
+    }
+}
+
+void ioapic_route_isa_irq(const uint8_t irq, const uint8_t vector, const uint32_t apic_id) {
+    kassert(irq < NUMBER_OF_ISA_IRQS, "Not an ISA IRQ.");
+    // NOTE: Without interrupt remapping, an I/O APIC can only address the first 255 APIC ids.
+    kassert(apic_id < 0xFFu, "The APIC id is out of reach of the I/O APIC.");
+
+    const struct isa_irq_route route = isa_irq_routes[irq];
+    const struct ioapic* ioapic = NULL;
+    for(uint32_t i = 0u; i < number_of_ioapics; ++i) {
+        if(route.gsi >= ioapics[i].gsi_base && route.gsi < ioapics[i].gsi_base + ioapics[i].number_of_entries) {
+            ioapic = &ioapics[i];
+            break;
+        }
+    }
+    kassert(ioapic != NULL, "No I/O APIC handles the IRQ.");
+
+    uint32_t low = vector;
+    if((route.flags & MPS_INTI_ACTIVE_LOW) == MPS_INTI_ACTIVE_LOW) {
+        low |= REDIRECTION_ACTIVE_LOW;
+    }
+    if((route.flags & MPS_INTI_LEVEL_TRIGGERED) == MPS_INTI_LEVEL_TRIGGERED) {
+        low |= REDIRECTION_LEVEL_TRIGGERED;
+    }
+
+    const uint32_t entry = IOAPIC_REDIRECTION_TABLE + 2u*(route.gsi - ioapic->gsi_base);
+    const uint64_t rflags = spin_lock_irqsave(&ioapic_lock);
+    // the destination goes in first, so the entry is never unmasked with a stale one
+    ioapic_write(ioapic, entry + 1u, apic_id << REDIRECTION_DESTINATION_SHIFT);
+    ioapic_write(ioapic, entry, low);
+    spin_unlock_irqrestore(&ioapic_lock, rflags);
+}
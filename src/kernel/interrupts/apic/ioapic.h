@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <kernel/acpi/acpi_tables.h>
+
+// The I/O APICs deliver the external (device) interrupts. Every redirection entry starts out masked and only the entries
+//  that a driver asks for get routed, always with fixed delivery to a single CPU.
+
+#define MAX_IOAPICS 8u
+#define NUMBER_OF_ISA_IRQS 16u
+
+// Finds the I/O APICs and the ISA interrupt source overrides in the MADT, maps the I/O APICs and masks all their entries.
+//  Must be called after `vm_region_init()`.
+void ioapic_init(const struct MADT* MADT_virt_addr);
+
+// Routes ISA IRQ `irq` to `vector` on the CPU with the (x2)APIC id `apic_id` and unmasks it.
+//  The MADT's interrupt source overrides decide which global system interrupt that is, and its polarity and trigger mode.
+void ioapic_route_isa_irq(uint8_t irq, uint8_t vector, uint32_t apic_id);
@@ -0,0 +1,197 @@
+#include "idt.h"
+
+#include <libc/required_libc_functions.h>
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/percpu.h>
+#include <kernel/error/error.h>
+#include <kernel/interrupts/apic/apic.h>
+#include <kernel/mem/mem_constants.h>
+#include <kernel/mem/phys/phys_mem_allocator.h>
+#include <kernel/mem/vm/page_fault.h>
+#include <kernel/sched/sched.h>
+#include <kernel/time/clocksource.h>
+#include <kernel/trace/trace.h>
+
+#define IDT_INTERRUPT_GATE 0x8Eu // present, ring 0, 64-bit interrupt gate (so IF is cleared on entry)
+#define INTERRUPT_STATS_ORDER 1u // 256 `struct interrupt_stats` are 8KiB
+
+struct IDT_entry interrupt_descriptor_table[NUMBER_OF_INTERRUPT_VECTORS];
+
+static interrupt_handler interrupt_handlers[NUMBER_OF_INTERRUPT_VECTORS];
+
+struct interrupt_cpu_state {
+    struct interrupt_stats* stats; // indexed by vector, only written by the owning CPU
+    uint64_t entry_tsc; // when `irq_dispatch()` was entered for `vector`
+    uint64_t vector;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct interrupt_cpu_state interrupt_cpu_states[MAX_CPUS];
+
+extern const char interrupt_stubs[]; // NUMBER_OF_INTERRUPT_VECTORS stubs of INTERRUPT_STUB_SIZE bytes each
+
+static const char *const exception_names[FIRST_EXTERNAL_INTERRUPT] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow", "bound range exceeded", "invalid opcode", "device not available",
+    "double fault", "coprocessor segment overrun", "invalid TSS", "segment not present", "stack-segment fault", "general protection fault", "page fault", "reserved",
+    "x87 floating-point exception", "alignment check", "machine check", "SIMD floating-point exception", "virtualization exception", "control protection exception", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "reserved", "hypervisor injection exception", "VMM communication exception", "security exception", "reserved",
+};
+
+static void set_idt_entry(const uint32_t vector, const uint8_t ist) {
+    const uint64_t stub = (uint64_t)interrupt_stubs + vector*INTERRUPT_STUB_SIZE;
+    struct IDT_entry *const entry = &interrupt_descriptor_table[vector];
+
+    entry->offset_lower_bits = (uint16_t)stub;
+    entry->segment_selector = KERNEL_CODE_SELECTOR;
+    entry->ist = ist;
+    entry->type_attr = IDT_INTERRUPT_GATE;
+    entry->offset_mid_bits = (uint16_t)(stub >> 16);
+    entry->offset_high_bits = (uint32_t)(stub >> 32);
+    entry->reserved = 0u;
+}
+
+// NOTE: The report starts with `serial_panic_write()`, since the ring is drained by an interrupt and interrupts stay off from here on.
+//  Everything after it goes to the UART directly.
+static void report_exception(const struct interrupt_frame *const frame, const char *const reason) {
+    char str_buf[32];
+
+    serial_panic_write(reason);
+    serial_writestring(": ");
+    serial_writestring(exception_names[frame->vector]);
+    serial_writestring(" (vector ");
+    serial_writestring(print_digits(frame->vector, str_buf));
+    serial_writestring("), error code 0x");
+    serial_writestring(print_hex(frame->error_code, str_buf));
+    serial_writestring(", rip 0x");
+    serial_writestring(print_hex(frame->rip, str_buf));
+    serial_writestring(", rsp 0x");
+    serial_writestring(print_hex(frame->rsp, str_buf));
+    serial_writestring("\n");
+}
+
+static __attribute__((noreturn)) void die_on_exception(const struct interrupt_frame *const frame, const char *const reason) {
+    report_exception(frame, reason);
+    halt();
+}
+
+static void page_fault_exception(struct interrupt_frame *const frame) {
+    // NOTE: CR2 is read before anything else can fault and overwrite it.
+    const uint64_t fault_addr = read_cr2();
+
+    if(!handle_page_fault(fault_addr, frame->error_code)) {
+        char str_buf[32];
+        report_exception(frame, "Unhandled exception");
+        serial_writestring("Bad access to 0x");
+        serial_writestring(print_hex(fault_addr, str_buf));
+        serial_writestring("\n");
+        halt();
+    }
+}
+
+void idt_init(void) {
+    for(uint32_t vector = 0u; vector < NUMBER_OF_INTERRUPT_VECTORS; ++vector) {
+        set_idt_entry(vector, 0u);
+    }
+    set_idt_entry(EXCEPTION_NMI, IST_NMI);
+    set_idt_entry(EXCEPTION_DOUBLE_FAULT, IST_DOUBLE_FAULT);
+    set_idt_entry(EXCEPTION_MACHINE_CHECK, IST_MACHINE_CHECK);
+
+    idt_register_handler(EXCEPTION_PAGE_FAULT, page_fault_exception);
+}
+
+void idt_init_cpu(void) {
+    struct interrupt_cpu_state *const state = &interrupt_cpu_states[current_cpu_id()];
+    state->stats = (struct interrupt_stats*) GENERAL_MEM_P2V(phys_mem_allocate_pages(INTERRUPT_STATS_ORDER));
+    memset(state->stats, 0, NUMBER_OF_INTERRUPT_VECTORS * sizeof(struct interrupt_stats));
+
+    struct descriptor_table_pseudo_register descriptor_table;
+    descriptor_table.limit = sizeof(interrupt_descriptor_table) - 1;
+    descriptor_table.base = (uint64_t) interrupt_descriptor_table;
+
+    asm volatile("lidt %0" : : "m"(descriptor_table));
+}
+
+void idt_register_handler(const uint8_t vector, const interrupt_handler handler) {
+    interrupt_handlers[vector] = handler;
+}
+
+void exception_dispatch(struct interrupt_frame *const frame) {
+    ++interrupt_cpu_states[current_cpu_id()].stats[frame->vector].count;
+
+    if(interrupt_handlers[frame->vector] == NULL) {
+        die_on_exception(frame, "Unhandled exception");
+    }
+    interrupt_handlers[frame->vector](frame);
+}
+
+void irq_dispatch(const uint64_t vector) {
+    struct interrupt_cpu_state *const state = &interrupt_cpu_states[current_cpu_id()];
+    // plain `rdtsc()`, since waiting for earlier instructions would only add to the latency that is being measured
+    state->entry_tsc = rdtsc();
+    state->vector = vector;
+    ++state->stats[vector].count;
+    TRACE(TRACE_IRQ_ENTRY, vector, 0u);
+
+    if(interrupt_handlers[vector] != NULL) {
+        interrupt_handlers[vector](NULL);
+    }
+    TRACE(TRACE_IRQ_EXIT, vector, 0u);
+
+    // a spurious interrupt was never accepted by the local APIC, so it must not get an EOI
+    if(vector != SPURIOUS_INTERRUPT_VECTOR) {
+        x2apic_send_eoi();
+    }
+
+    // NOTE: This comes last, since the interrupted thread may continue on another CPU once it is switched back in.
+    sched_preempt_if_needed();
+}
+
+void interrupt_record_latency(const uint64_t raised_tsc) {
+    const struct interrupt_cpu_state *const state = &interrupt_cpu_states[current_cpu_id()];
+    struct interrupt_stats *const stats = &state->stats[state->vector];
+
+    // the TSCs of different CPUs can be slightly apart, so an IPI can seem to arrive before it was sent
+    const uint64_t latency = (state->entry_tsc > raised_tsc) ? state->entry_tsc - raised_tsc : 0u;
+    ++stats->latency_samples;
+    stats->total_latency_ticks += latency;
+    stats->max_latency_ticks = (latency > stats->max_latency_ticks) ? latency : stats->max_latency_ticks;
+}
+
+struct interrupt_stats interrupt_get_stats(const uint32_t cpu_id, const uint8_t vector) {
+    const struct interrupt_stats *const stats = interrupt_cpu_states[cpu_id].stats;
+    if(stats == NULL) {
+        return (struct interrupt_stats){ 0u, 0u, 0u, 0u };
+    }
+    return stats[vector];
+}
+
+void interrupt_print_stats(void) {
+    char str_buf[32];
+
+    serial_writestring("Interrupts (summed over all CPUs):\n");
+    for(uint32_t vector = 0u; vector < NUMBER_OF_INTERRUPT_VECTORS; ++vector) {
+        struct interrupt_stats total = { 0u, 0u, 0u, 0u };
+        for(uint32_t cpu = 0u; cpu < MAX_CPUS; ++cpu) {
+            const struct interrupt_stats stats = interrupt_get_stats(cpu, (uint8_t)vector);
+            total.count += stats.count;
+            total.latency_samples += stats.latency_samples;
+            total.total_latency_ticks += stats.total_latency_ticks;
+            total.max_latency_ticks = (stats.max_latency_ticks > total.max_latency_ticks) ? stats.max_latency_ticks : total.max_latency_ticks;
+        }
+        if(total.count == 0u) {
+            continue;
+        }
+
+        serial_writestring("  vector ");
+        serial_writestring(print_digits(vector, str_buf));
+        serial_writestring(": ");
+        serial_writestring(print_digits(total.count, str_buf));
+        if(total.latency_samples != 0u) {
+            serial_writestring(", latency avg ");
+            serial_writestring(print_digits(tsc_ticks_to_ns(total.total_latency_ticks / total.latency_samples), str_buf));
+            serial_writestring("ns, max ");
+            serial_writestring(print_digits(tsc_ticks_to_ns(total.max_latency_ticks), str_buf));
+            serial_writestring("ns");
+        }
+        serial_writestring("\n");
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <kernel/cpu/gdt.h>
+
+struct IDT_entry {
+    uint16_t offset_lower_bits;
+    uint16_t segment_selector;
+    uint8_t ist;
+    uint8_t type_attr;
+    uint16_t offset_mid_bits;
+    uint32_t offset_high_bits;
+    uint32_t reserved;
+} __attribute__ ((packed));
+
+#define NUMBER_OF_INTERRUPT_VECTORS 256u
+// vectors [0, 32) are exceptions, everything above is an external interrupt or an IPI and needs an EOI
+#define FIRST_EXTERNAL_INTERRUPT 32u
+
+#define EXCEPTION_NMI 2u
+#define EXCEPTION_DOUBLE_FAULT 8u
+#define EXCEPTION_PAGE_FAULT 14u
+#define EXCEPTION_MACHINE_CHECK 18u
+
+// Every vector has an entry stub of exactly this size in interrupt_stubs.asm, so the IDT is filled in by indexing into them.
+//  NOTE: This has to match `INTERRUPT_STUB_SIZE` in interrupt_stubs.asm.
+#define INTERRUPT_STUB_SIZE 16u
+
+// What the exception entry saves, from the lowest address up. The CPU pushes everything from `rip` on
+//  (and `error_code` for some exceptions, otherwise the stub pushes a 0).
+struct interrupt_frame {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t vector;
+    uint64_t error_code;
+    uint64_t rip, cs, rflags, rsp, ss;
+};
+
+// Exception handlers get the full frame and may change it, e.g. to skip the faulting instruction.
+//  NOTE: Handlers of vectors >= 32 get NULL. Their entry path only saves the caller-saved registers, since the handler is a C function that preserves the rest.
+typedef void (*interrupt_handler)(struct interrupt_frame* frame);
+
+struct interrupt_stats {
+    uint64_t count;
+    // Only filled in for vectors whose handlers know when the interrupt was raised, see `interrupt_record_latency()`.
+    uint64_t latency_samples;
+    uint64_t total_latency_ticks;
+    uint64_t max_latency_ticks;
+};
+
+// Fills in the IDT. Every vector gets its stub, and #DF, NMI and #MC run on their IST stacks.
+void idt_init(void);
+// Loads the IDT on the current CPU and allocates its interrupt statistics. Must be called after `gdt_init_cpu()`, since the IST stacks live in the TSS.
+void idt_init_cpu(void);
+
+void idt_register_handler(uint8_t vector, interrupt_handler handler);
+
+// Called by the entry stubs in interrupt_stubs.asm.
+void exception_dispatch(struct interrupt_frame* frame);
+// External interrupts and IPIs get their EOI once the handler returns. This is also where threads get preempted.
+void irq_dispatch(uint64_t vector);
+
+// Called from a handler of a vector >= 32 with the TSC value at which its interrupt was raised (a TSC deadline, or when an IPI was sent).
+//  Records how long it took from there until `irq_dispatch()` was entered.
+void interrupt_record_latency(uint64_t raised_tsc);
+
+struct interrupt_stats interrupt_get_stats(uint32_t cpu_id, uint8_t vector);
+void interrupt_print_stats(void);
@@ -0,0 +1,109 @@
+; One entry stub per vector, each exactly INTERRUPT_STUB_SIZE bytes so that `idt_init()` can find stub `i` at `interrupt_stubs + i*INTERRUPT_STUB_SIZE`.
+;  Exceptions save every register into a `struct interrupt_frame`, since their handlers may need to look at (or change) the interrupted state.
+;  External interrupts and IPIs take the fast path: only the caller-saved registers are saved, since the C handler preserves the rest anyway.
+
+INTERRUPT_STUB_SIZE equ 16 ; NOTE: This has to match `INTERRUPT_STUB_SIZE` in idt.h.
+FIRST_EXTERNAL_INTERRUPT equ 32
+
+extern exception_dispatch
+extern irq_dispatch
+
+section .text
+
+; the exceptions for which the CPU pushes an error code
+%define HAS_ERROR_CODE(vector) ((vector) == 8 || (vector) == 10 || (vector) == 11 || (vector) == 12 || (vector) == 13 || (vector) == 14 || (vector) == 17 || (vector) == 21 || (vector) == 29 || (vector) == 30)
+
+%macro INTERRUPT_STUB 1
+%%start:
+%if %1 < FIRST_EXTERNAL_INTERRUPT
+  %if HAS_ERROR_CODE(%1) == 0
+    push 0 ; so that every exception frame has the same layout
+  %endif
+    push %1
+    jmp near exception_entry
+%else
+    push %1
+    jmp near irq_entry
+%endif
+    ; fails to assemble if a stub ever gets too big
+    times INTERRUPT_STUB_SIZE - ($ - %%start) int3
+%endmacro
+
+global interrupt_stubs
+align 16
+interrupt_stubs:
+%assign vector 0
+%rep 256
+    INTERRUPT_STUB vector
+%assign vector vector + 1
+%endrep
+
+exception_entry:
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    ; The CPU aligns the stack to 16 bytes before pushing its frame, and the 22 qwords on top keep it aligned for the call.
+    ; The direction flag could be set if we interrupted a backwards copy, but the ABI requires it to be clear on function entry.
+    cld
+    mov rdi, rsp ; RDI = struct interrupt_frame*
+    call exception_dispatch
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+    add rsp, 16 ; vector and error code
+    iretq
+
+irq_entry:
+    push rax
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+
+    cld
+    mov rdi, [rsp + 9*8] ; RDI = vector
+    sub rsp, 8 ; the CPU frame, the vector and 9 registers are 15 qwords, so one more keeps the stack 16-byte aligned for the call
+    call irq_dispatch
+    add rsp, 8
+
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rax
+    add rsp, 8 ; vector
+    iretq
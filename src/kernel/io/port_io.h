@@ -13,3 +13,10 @@ static inline uint8_t inb(const uint16_t port) {
 static inline void outb(const uint16_t port, const uint8_t value) {
     asm volatile ("outb %b0,%w1": :"a" (value), "Nd" (port));
 }
+
+static inline uint32_t inl(const uint16_t port) {
+    uint32_t v;
+
+    asm volatile ("inl %w1,%0":"=a" (v):"Nd" (port));
+    return v;
+}
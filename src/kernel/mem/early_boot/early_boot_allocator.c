@@ -6,11 +6,11 @@ void early_boot_alloc_init(const uint64_t last_used_phys_addr) {
     current_start_addr = round_up_to_page(last_used_phys_addr);
 }
 
-uint64_t early_boot_alloc(const struct multiboot_tag_mmap *const mmap, const uint64_t requested_size) {
+uint64_t early_boot_alloc(const struct boot_info *const info, const uint64_t requested_size) {
     const uint64_t page_aligned_requested_size = round_up_to_page(requested_size);
 
-    for(uint32_t i = 0; i < (mmap->size - sizeof(struct multiboot_tag_mmap))/mmap->entry_size; ++i) {
-        const struct multiboot_mmap_entry current_entry = mmap->entries[i];
+    for(uint32_t i = 0; i < info->number_of_mmap_entries; ++i) {
+        const struct multiboot_mmap_entry current_entry = info->mmap[i];
 
         if(current_entry.type != MULTIBOOT_MEMORY_AVAILABLE) {
             continue;
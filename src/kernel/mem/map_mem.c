@@ -1,5 +1,10 @@
 #include "map_mem.h"
 
+#include <kernel/cpu/alternatives.h>
+#include <kernel/mem/phys/phys_mem_allocator.h>
+#include <kernel/mem/slab/slab.h>
+#include <kernel/mem/tlb/tlb_shootdown.h>
+
 void unconditional_map_page_in_first_2mib(const uint64_t physical_addr, const uint64_t virtual_addr) {
     const uint64_t page_aligned_physical_addr = round_down_to_page(physical_addr);
 
@@ -20,3 +25,586 @@ void unconditional_map_page_in_first_2mib(const uint64_t physical_addr, const ui
 
     flush_page_tlb_entry(virtual_addr);
 }
+
+#define PCID_GENERATION_PERMANENT UINT64_MAX // the kernel address space always keeps PCID 0
+#define NUMBER_OF_PCIDS 4096u
+
+struct address_space kernel_address_space = { 0u, SPINLOCK_INIT, SPINLOCK_INIT, NULL, 0u, PCID_GENERATION_PERMANENT, 0u, 0u };
+
+static struct address_space* loaded_address_spaces[MAX_CPUS]; // NULL means `kernel_address_space`
+
+static bool execute_disable_supported;
+static bool huge_1gib_pages_supported;
+static bool pcid_supported;
+static bool invpcid_supported;
+static bool pcid_enabled;
+
+// PCIDs are handed out in order and never freed. Once they run out a new generation starts, which retires every PCID handed out so far.
+//  Each CPU flushes all of its PCID tagged entries the first time it switches address spaces in a new generation,
+//  so a recycled PCID can never hit entries left behind by its previous owner.
+static struct spinlock pcid_lock = SPINLOCK_INIT;
+static uint64_t current_pcid_generation = 1u;
+static uint32_t next_pcid = 1u;
+static uint64_t pcid_generation_flushed_by_cpu[MAX_CPUS];
+
+#define ENTRIES_PER_TABLE 512u
+#define FIRST_KERNEL_HALF_INDEX 256u
+
+enum page_table_walk_kind {
+    PAGE_TABLE_WALK_MAP,
+    PAGE_TABLE_WALK_UNMAP,
+    PAGE_TABLE_WALK_PROTECT,
+};
+
+struct page_table_walk {
+    enum page_table_walk_kind kind;
+    uint64_t phys_addr; // only used for `PAGE_TABLE_WALK_MAP`, advanced as the walk goes
+    uint64_t leaf_flags; // every flag of a 4KiB leaf, huge leaves add `PDPTE_HUGE_PAGE` on top
+    bool user;
+    struct tlb_flush_batch* batch;
+};
+
+// level 1 = pt, level 2 = pdt, level 3 = pdpt, level 4 = pml4t, level 5 = pml5t
+static inline uint64_t level_page_size(const uint32_t level) {
+    return 1ULL << (12u + 9u*(level - 1u));
+}
+
+static inline uint32_t level_index(const uint64_t virt_addr, const uint32_t level) {
+    return (uint32_t)((virt_addr >> (12u + 9u*(level - 1u))) & (ENTRIES_PER_TABLE - 1u));
+}
+
+static inline uint64_t* table_virt_addr(const uint64_t entry) {
+    return (uint64_t*)GENERAL_MEM_P2V(entry & PHYSICAL_ADDRESS_MASK);
+}
+
+static inline bool is_huge_leaf(const uint64_t entry, const uint32_t level) {
+    return (level == 2u || level == 3u) && (entry & PDPTE_HUGE_PAGE);
+}
+
+static inline bool is_leaf(const uint64_t entry, const uint32_t level) {
+    return level == 1u || is_huge_leaf(entry, level);
+}
+
+static inline bool can_use_leaf_at_level(const uint32_t level) {
+    return level == 1u || level == 2u || (level == 3u && huge_1gib_pages_supported);
+}
+
+// The PAT bit lives at bit 7 of a 4KiB PTE but at bit 12 of a huge leaf, where bit 7 is the page size bit.
+static inline uint64_t huge_leaf_flags_from_pte_flags(const uint64_t pte_flags) {
+    uint64_t flags = (pte_flags & ~PT_PAT) | PDPTE_HUGE_PAGE;
+    if(pte_flags & PT_PAT) {
+        flags |= PT_HUGE_PAGE_PAT;
+    }
+    return flags;
+}
+
+static inline uint64_t leaf_phys_addr(const uint64_t entry, const uint32_t level) {
+    if(level == 1u) {
+        return entry & PHYSICAL_ADDRESS_MASK;
+    }
+    return entry & PHYSICAL_ADDRESS_MASK & ~(level_page_size(level) - 1u);
+}
+
+static inline uint64_t leaf_flags(const uint64_t entry, const uint32_t level) {
+    if(level == 1u) {
+        return entry & ~PHYSICAL_ADDRESS_MASK;
+    }
+    return (entry & ~PHYSICAL_ADDRESS_MASK) | (entry & PT_HUGE_PAGE_PAT);
+}
+
+static uint64_t vm_flags_to_pte_flags(const uint32_t flags) {
+    uint64_t pte_flags = PT_PRESENT;
+    if(flags & VM_WRITEABLE) {
+        pte_flags |= PT_WRITEABLE;
+    }
+    if(flags & VM_USER) {
+        pte_flags |= PT_USER;
+    }
+    if(flags & VM_GLOBAL) {
+        pte_flags |= PT_GLOBAL_PAGE;
+    }
+    if(flags & VM_UNCACHED) {
+        pte_flags |= PT_CACHE_DISABLE | PT_WRITE_THROUGH;
+    }
+    else if(flags & VM_WRITE_COMBINING) {
+        pte_flags |= PT_PAT | PT_WRITE_THROUGH;
+    }
+    if(!(flags & VM_EXECUTABLE) && execute_disable_supported) {
+        pte_flags |= PT_DISABLE_EXECUTE;
+    }
+    return pte_flags;
+}
+
+static void tlb_flush_batch_add(struct tlb_flush_batch *const batch, const uint64_t virt_addr, const uint64_t old_entry) {
+    if(old_entry & PT_GLOBAL_PAGE) {
+        batch->includes_global_pages = true;
+    }
+    if(batch->flush_everything) {
+        return;
+    }
+    if(batch->count == TLB_FLUSH_BATCH_CAPACITY) {
+        batch->flush_everything = true;
+        return;
+    }
+    batch->virt_addrs[batch->count++] = virt_addr;
+}
+
+static void retire_all_pcids_locked(void) {
+    ++current_pcid_generation;
+    next_pcid = 1u;
+}
+
+static void retire_all_pcids(void) {
+    spin_lock(&pcid_lock);
+    retire_all_pcids_locked();
+    spin_unlock(&pcid_lock);
+}
+
+void tlb_flush_batch_finish(struct address_space *const address_space, struct tlb_flush_batch *const batch) {
+    if(batch->count == 0u && !batch->flush_everything) {
+        return; // nothing was cached, since only present entries get recorded
+    }
+
+    // NOTE: `invlpg` and a cr3 reload only affect the current PCID (and global pages).
+    const uint32_t cpu = current_cpu_id();
+    const bool is_active = vm_current_address_space() == address_space;
+    uint64_t remote_cpus;
+    uint16_t pcid;
+
+    if(address_space == &kernel_address_space) {
+        // The kernel half is shared by every address space, so its entries can be cached under any PCID on any CPU.
+        //  Each CPU flushes its current PCID right away and the others are retired, which flushes them before their next use.
+        tlb_flush_local(batch);
+        if(pcid_enabled) {
+            retire_all_pcids();
+        }
+        remote_cpus = online_cpus_mask;
+        pcid = 0u;
+    } else {
+        spin_lock(&pcid_lock);
+        const bool has_pcid = pcid_enabled && address_space->pcid_generation == current_pcid_generation;
+        pcid = address_space->pcid;
+        remote_cpus = __atomic_load_n(&address_space->active_cpus_mask, __ATOMIC_SEQ_CST);
+        if(has_pcid && (address_space->pcid_cpus_mask & ~remote_cpus & ~(1ULL << cpu)) != 0u) {
+            // Other CPUs that used the address space before still have entries under its PCID, so it gets a fresh (and flushed) one.
+            address_space->pcid_generation = 0u;
+        }
+        spin_unlock(&pcid_lock);
+
+        if(is_active || batch->includes_global_pages) {
+            tlb_flush_local(batch);
+        } else if(has_pcid && (address_space->pcid_cpus_mask & (1ULL << cpu))) {
+            // NOTE: An inactive address space can still have entries cached under its PCID.
+            if(!invpcid_supported) {
+                address_space->pcid_generation = 0u;
+            } else if(!batch->flush_everything) {
+                for(uint32_t i = 0u; i < batch->count; ++i) {
+                    invpcid(INVPCID_INDIVIDUAL_ADDRESS, pcid, batch->virt_addrs[i]);
+                }
+            } else {
+                invpcid(INVPCID_SINGLE_CONTEXT, pcid, 0u);
+            }
+        }
+
+        if(batch->includes_global_pages) {
+            remote_cpus = online_cpus_mask;
+        }
+    }
+
+    tlb_shootdown(address_space, pcid, batch, remote_cpus);
+
+    batch->count = 0u;
+    batch->flush_everything = false;
+    batch->includes_global_pages = false;
+}
+
+static uint64_t allocate_zeroed_table(void) {
+    const uint64_t table_phys_addr = phys_mem_allocate_page();
+    memset((void*)GENERAL_MEM_P2V(table_phys_addr), 0, NORMAL_PAGE_SIZE);
+    return table_phys_addr;
+}
+
+// Replaces a huge leaf with a table of the next smaller page size that maps exactly the same memory.
+//  The translation does not change, but the TLB may still hold the huge entry, so it still needs to be invalidated.
+static void split_huge_leaf(uint64_t *const entry, const uint32_t level, const uint64_t entry_virt_addr, struct tlb_flush_batch *const batch) {
+    const uint64_t old_entry = *entry;
+    const uint64_t child_size = level_page_size(level - 1u);
+    const uint64_t base_phys_addr = leaf_phys_addr(old_entry, level);
+
+    uint64_t child_flags = leaf_flags(old_entry, level);
+    if(level - 1u == 1u) {
+        child_flags &= ~(PDPTE_HUGE_PAGE | PT_HUGE_PAGE_PAT);
+        if(old_entry & PT_HUGE_PAGE_PAT) {
+            child_flags |= PT_PAT;
+        }
+    }
+
+    const uint64_t table_phys_addr = allocate_zeroed_table();
+    uint64_t *const table = (uint64_t*)GENERAL_MEM_P2V(table_phys_addr);
+    for(uint32_t i = 0u; i < ENTRIES_PER_TABLE; ++i) {
+        table[i] = (base_phys_addr + i*child_size) | child_flags;
+    }
+
+    *entry = table_phys_addr | PT_PRESENT | PT_WRITEABLE | (old_entry & PT_USER);
+    tlb_flush_batch_add(batch, entry_virt_addr, old_entry);
+}
+
+// NOTE: Intermediate entries are always writeable and never execute-disable, so the leaves alone decide the permissions.
+static uint64_t* get_or_create_child_table(uint64_t *const entry, const uint32_t level, const uint64_t entry_virt_addr, struct page_table_walk *const walk) {
+    if(!(*entry & PT_PRESENT)) {
+        *entry = allocate_zeroed_table() | PT_PRESENT | PT_WRITEABLE | (walk->user ? PT_USER : 0u);
+    } else if(is_huge_leaf(*entry, level)) {
+        split_huge_leaf(entry, level, entry_virt_addr, walk->batch);
+    }
+
+    if(walk->user) {
+        *entry |= PT_USER;
+    }
+    return table_virt_addr(*entry);
+}
+
+// NOTE: Page tables that become empty are not freed, so a later mapping of the same range does not need to allocate them again.
+static void walk_table(uint64_t *const table, const uint32_t level, uint64_t virt_addr, uint64_t size, struct page_table_walk *const walk) {
+    const uint64_t page_size = level_page_size(level);
+
+    for(uint32_t i = level_index(virt_addr, level); size != 0u && i < ENTRIES_PER_TABLE; ++i) {
+        uint64_t *const entry = &table[i];
+        const uint64_t entry_virt_addr = round_down(virt_addr, page_size);
+        const uint64_t chunk_size = min(size, page_size - offset(virt_addr, page_size));
+        const bool covers_entry = chunk_size == page_size;
+        const uint64_t old_entry = *entry;
+
+        switch(walk->kind) {
+        case PAGE_TABLE_WALK_MAP:
+            if(covers_entry && can_use_leaf_at_level(level) && offset(walk->phys_addr, page_size) == 0u &&
+               (!(old_entry & PT_PRESENT) || is_leaf(old_entry, level))) {
+                *entry = walk->phys_addr | (level == 1u ? walk->leaf_flags : huge_leaf_flags_from_pte_flags(walk->leaf_flags));
+                if(old_entry & PT_PRESENT) {
+                    tlb_flush_batch_add(walk->batch, entry_virt_addr, old_entry);
+                }
+                walk->phys_addr += chunk_size;
+            } else {
+                // the lower levels advance `walk->phys_addr` themselves
+                walk_table(get_or_create_child_table(entry, level, entry_virt_addr, walk), level - 1u, virt_addr, chunk_size, walk);
+            }
+            break;
+
+        case PAGE_TABLE_WALK_UNMAP:
+            if(!(old_entry & PT_PRESENT)) {
+                break;
+            }
+            if(is_leaf(old_entry, level) && covers_entry) {
+                *entry = 0u;
+                tlb_flush_batch_add(walk->batch, entry_virt_addr, old_entry);
+            } else {
+                walk_table(get_or_create_child_table(entry, level, entry_virt_addr, walk), level - 1u, virt_addr, chunk_size, walk);
+            }
+            break;
+
+        case PAGE_TABLE_WALK_PROTECT:
+            if(!(old_entry & PT_PRESENT)) {
+                break;
+            }
+            if(is_leaf(old_entry, level) && covers_entry) {
+                const uint64_t changeable_flags = PT_WRITEABLE | PT_USER | PT_GLOBAL_PAGE | PT_DISABLE_EXECUTE;
+                const uint64_t new_entry = (old_entry & ~changeable_flags) | (walk->leaf_flags & changeable_flags);
+                if(new_entry != old_entry) {
+                    *entry = new_entry;
+                    tlb_flush_batch_add(walk->batch, entry_virt_addr, old_entry);
+                }
+            } else {
+                walk_table(get_or_create_child_table(entry, level, entry_virt_addr, walk), level - 1u, virt_addr, chunk_size, walk);
+            }
+            break;
+        }
+
+        virt_addr += chunk_size;
+        size -= chunk_size;
+    }
+}
+
+static void walk_range(struct address_space *const address_space, const uint64_t virt_addr, const uint64_t size, struct page_table_walk *const walk) {
+    kassert(offset_in_page(virt_addr) == 0u && offset_in_page(size) == 0u, "VM ranges must be page aligned.");
+    kassert(address_space->root_table_phys_addr != 0u, "Address space used before `vm_init()`.");
+
+    const uint64_t rflags = spin_lock_irqsave(&address_space->lock);
+    walk_table((uint64_t*)GENERAL_MEM_P2V(address_space->root_table_phys_addr), paging_levels, virt_addr, size, walk);
+    spin_unlock_irqrestore(&address_space->lock, rflags);
+}
+
+void vm_init(void) {
+    execute_disable_supported = cpu_has(X86_FEATURE_NX);
+    huge_1gib_pages_supported = cpu_has(X86_FEATURE_1GIB_PAGES);
+    pcid_supported = cpu_has(X86_FEATURE_PCID);
+    invpcid_supported = pcid_supported && cpu_has(X86_FEATURE_INVPCID);
+
+    kernel_address_space.root_table_phys_addr = kernel_root_page_table_phys_addr();
+
+    // Every top level entry of the kernel half gets its table now, since the other address spaces copy these entries when they are created
+    //  and would never see a top level table that is added later.
+    uint64_t *const root_table = (uint64_t*)GENERAL_MEM_P2V(kernel_address_space.root_table_phys_addr);
+    for(uint32_t i = FIRST_KERNEL_HALF_INDEX; i < ENTRIES_PER_TABLE; ++i) {
+        if(!(root_table[i] & PT_PRESENT)) {
+            root_table[i] = allocate_zeroed_table() | PT_PRESENT | PT_WRITEABLE;
+        }
+    }
+
+    if(pcid_supported) {
+        vm_set_pcid_enabled(true);
+    }
+}
+
+// NOTE: The flush happens after the page table lock is released, since waiting for a shootdown while holding it
+//  could deadlock with another CPU that spins on the lock with interrupts disabled.
+void map_range(struct address_space *const address_space, const uint64_t virt_addr, const uint64_t phys_addr, const uint64_t size, const uint32_t flags) {
+    kassert(offset_in_page(phys_addr) == 0u, "Physical address to map must be page aligned.");
+
+    struct tlb_flush_batch batch = { 0 };
+    struct page_table_walk walk = {
+        .kind = PAGE_TABLE_WALK_MAP,
+        .phys_addr = phys_addr,
+        .leaf_flags = vm_flags_to_pte_flags(flags),
+        .user = (flags & VM_USER) != 0u,
+        .batch = &batch,
+    };
+    walk_range(address_space, virt_addr, size, &walk);
+    tlb_flush_batch_finish(address_space, &batch);
+}
+
+void unmap_range_deferred(struct address_space *const address_space, const uint64_t virt_addr, const uint64_t size, struct tlb_flush_batch *const batch) {
+    struct page_table_walk walk = { .kind = PAGE_TABLE_WALK_UNMAP, .batch = batch };
+    walk_range(address_space, virt_addr, size, &walk);
+}
+
+void unmap_range(struct address_space *const address_space, const uint64_t virt_addr, const uint64_t size) {
+    struct tlb_flush_batch batch = { 0 };
+    unmap_range_deferred(address_space, virt_addr, size, &batch);
+    tlb_flush_batch_finish(address_space, &batch);
+}
+
+void protect_range_deferred(struct address_space *const address_space, const uint64_t virt_addr, const uint64_t size, const uint32_t flags, struct tlb_flush_batch *const batch) {
+    struct page_table_walk walk = {
+        .kind = PAGE_TABLE_WALK_PROTECT,
+        .leaf_flags = vm_flags_to_pte_flags(flags),
+        .user = (flags & VM_USER) != 0u,
+        .batch = batch,
+    };
+    walk_range(address_space, virt_addr, size, &walk);
+}
+
+void protect_range(struct address_space *const address_space, const uint64_t virt_addr, const uint64_t size, const uint32_t flags) {
+    struct tlb_flush_batch batch = { 0 };
+    protect_range_deferred(address_space, virt_addr, size, flags, &batch);
+    tlb_flush_batch_finish(address_space, &batch);
+}
+
+bool map_page_replacing(struct address_space *const address_space, const uint64_t virt_addr, const uint64_t phys_addr, const uint32_t flags, const uint64_t replaceable_phys_addr) {
+    kassert(offset_in_page(virt_addr) == 0u && offset_in_page(phys_addr) == 0u, "Pages to map must be page aligned.");
+
+    struct tlb_flush_batch batch = { 0 };
+    struct page_table_walk walk = {
+        .kind = PAGE_TABLE_WALK_MAP,
+        .phys_addr = phys_addr,
+        .leaf_flags = vm_flags_to_pte_flags(flags),
+        .user = (flags & VM_USER) != 0u,
+        .batch = &batch,
+    };
+    bool is_mapped = false;
+
+    const uint64_t rflags = spin_lock_irqsave(&address_space->lock);
+
+    uint64_t* table = (uint64_t*)GENERAL_MEM_P2V(address_space->root_table_phys_addr);
+    uint32_t level = paging_levels;
+    for(; level > 1u; --level) {
+        uint64_t *const entry = &table[level_index(virt_addr, level)];
+        if((*entry & PT_PRESENT) && is_huge_leaf(*entry, level)) {
+            break; // already mapped by a huge page, which is never replaceable
+        }
+        table = get_or_create_child_table(entry, level, round_down(virt_addr, level_page_size(level)), &walk);
+    }
+
+    if(level == 1u) {
+        uint64_t *const entry = &table[level_index(virt_addr, 1u)];
+        const uint64_t old_entry = *entry;
+        if(!(old_entry & PT_PRESENT) || leaf_phys_addr(old_entry, 1u) == replaceable_phys_addr) {
+            *entry = phys_addr | walk.leaf_flags;
+            if(old_entry & PT_PRESENT) {
+                tlb_flush_batch_add(&batch, virt_addr, old_entry);
+            }
+            is_mapped = true;
+        }
+    }
+
+    spin_unlock_irqrestore(&address_space->lock, rflags);
+
+    tlb_flush_batch_finish(address_space, &batch);
+    return is_mapped;
+}
+
+bool virt_to_phys(struct address_space *const address_space, const uint64_t virt_addr, uint64_t *const phys_addr) {
+    const uint64_t rflags = spin_lock_irqsave(&address_space->lock);
+
+    const uint64_t* table = (const uint64_t*)GENERAL_MEM_P2V(address_space->root_table_phys_addr);
+    bool is_mapped = false;
+    for(uint32_t level = paging_levels; level >= 1u; --level) {
+        const uint64_t entry = table[level_index(virt_addr, level)];
+        if(!(entry & PT_PRESENT)) {
+            break;
+        }
+        if(is_leaf(entry, level)) {
+            *phys_addr = leaf_phys_addr(entry, level) + offset(virt_addr, level_page_size(level));
+            is_mapped = true;
+            break;
+        }
+        table = table_virt_addr(entry);
+    }
+
+    spin_unlock_irqrestore(&address_space->lock, rflags);
+    return is_mapped;
+}
+
+struct address_space* address_space_create(void) {
+    struct address_space *const address_space = kmalloc(sizeof(struct address_space));
+    address_space->root_table_phys_addr = allocate_zeroed_table();
+    address_space->lock = (struct spinlock)SPINLOCK_INIT;
+    address_space->regions_lock = (struct spinlock)SPINLOCK_INIT;
+    address_space->regions = NULL;
+    address_space->pcid = 0u;
+    address_space->pcid_generation = 0u;
+    address_space->pcid_cpus_mask = 0u;
+    address_space->active_cpus_mask = 0u;
+
+    const uint64_t *const kernel_root_table = (const uint64_t*)GENERAL_MEM_P2V(kernel_address_space.root_table_phys_addr);
+    uint64_t *const root_table = (uint64_t*)GENERAL_MEM_P2V(address_space->root_table_phys_addr);
+    memcpy(&root_table[FIRST_KERNEL_HALF_INDEX], &kernel_root_table[FIRST_KERNEL_HALF_INDEX], (ENTRIES_PER_TABLE - FIRST_KERNEL_HALF_INDEX)*sizeof(uint64_t));
+
+    return address_space;
+}
+
+static void free_table_and_children(const uint64_t table_phys_addr, const uint32_t level) {
+    const uint64_t *const table = (const uint64_t*)GENERAL_MEM_P2V(table_phys_addr);
+    if(level > 1u) {
+        for(uint32_t i = 0u; i < ENTRIES_PER_TABLE; ++i) {
+            if((table[i] & PT_PRESENT) && !is_leaf(table[i], level)) {
+                free_table_and_children(table[i] & PHYSICAL_ADDRESS_MASK, level - 1u);
+            }
+        }
+    }
+    phys_mem_free_page(table_phys_addr);
+}
+
+void address_space_destroy(struct address_space *const address_space) {
+    kassert(address_space != &kernel_address_space, "Destroying the kernel address space.");
+    kassert(address_space->active_cpus_mask == 0u, "Destroying an address space that is still loaded.");
+    kassert(address_space->regions == NULL, "Destroying an address space that still has regions.");
+
+    const uint64_t *const root_table = (const uint64_t*)GENERAL_MEM_P2V(address_space->root_table_phys_addr);
+    for(uint32_t i = 0u; i < FIRST_KERNEL_HALF_INDEX; ++i) {
+        if(root_table[i] & PT_PRESENT) {
+            free_table_and_children(root_table[i] & PHYSICAL_ADDRESS_MASK, paging_levels - 1u);
+        }
+    }
+    phys_mem_free_page(address_space->root_table_phys_addr);
+    kfree(address_space);
+}
+
+struct address_space* vm_current_address_space(void) {
+    struct address_space *const address_space = loaded_address_spaces[current_cpu_id()];
+    return address_space != NULL ? address_space : &kernel_address_space;
+}
+
+void switch_address_space(struct address_space *const address_space) {
+    const uint64_t rflags = interrupts_save_and_disable();
+    const uint32_t cpu = current_cpu_id();
+
+    tlb_leave_lazy_mode();
+
+    // NOTE: The CPU has to show up in `active_cpus_mask` before it loads cr3, so that a concurrent unmap either sees it or finishes editing the tables first.
+    struct address_space *const previous_address_space = vm_current_address_space();
+    if(previous_address_space != address_space) {
+        __atomic_and_fetch(&previous_address_space->active_cpus_mask, ~(1ULL << cpu), __ATOMIC_SEQ_CST);
+        __atomic_or_fetch(&address_space->active_cpus_mask, 1ULL << cpu, __ATOMIC_SEQ_CST);
+        loaded_address_spaces[cpu] = address_space;
+    }
+
+    if(!pcid_enabled) {
+        reload_cr3(address_space->root_table_phys_addr);
+        interrupts_restore(rflags);
+        return;
+    }
+
+    spin_lock(&pcid_lock);
+    if(address_space->pcid_generation != PCID_GENERATION_PERMANENT && address_space->pcid_generation != current_pcid_generation) {
+        if(next_pcid == NUMBER_OF_PCIDS) {
+            retire_all_pcids_locked();
+        }
+        address_space->pcid = (uint16_t)next_pcid++;
+        address_space->pcid_generation = current_pcid_generation;
+        address_space->pcid_cpus_mask = 0u;
+    }
+    address_space->pcid_cpus_mask |= 1ULL << cpu;
+    const bool flush_all_pcids = pcid_generation_flushed_by_cpu[cpu] != current_pcid_generation;
+    pcid_generation_flushed_by_cpu[cpu] = current_pcid_generation;
+    spin_unlock(&pcid_lock);
+
+    if(flush_all_pcids) {
+        vm_flush_all_address_spaces_local();
+    }
+    reload_cr3(address_space->root_table_phys_addr | address_space->pcid | CR3_NO_FLUSH);
+
+    interrupts_restore(rflags);
+}
+
+// `invpcid` on CPUs that have it, otherwise a cr4.PGE toggle, which flushes more but works everywhere. `apply_alternatives()` picks one at boot.
+// NOTE: Only valid while PCIDs are enabled, since `pcid_enabled` implies PCID support and `invpcid` is only used with PCID support.
+static inline void invpcid_or_flush_everything(const enum invpcid_type type, const uint64_t pcid) {
+    const struct {
+        uint64_t pcid;
+        uint64_t virt_addr;
+    } descriptor = { pcid, 0u };
+    uint64_t cr4;
+    asm volatile(ALTERNATIVE("movq %%cr4, %[cr4]\n\t"
+                             "xorq %[pge], %[cr4]\n\t"
+                             "movq %[cr4], %%cr4\n\t"
+                             "xorq %[pge], %[cr4]\n\t"
+                             "movq %[cr4], %%cr4",
+                             "invpcid %[descriptor], %[type]", X86_FEATURE_INVPCID)
+                 : [cr4] "=&r" (cr4)
+                 : [pge] "i" (CR4_GLOBAL_PAGE_ENABLE), [descriptor] "m" (descriptor), [type] "r" ((uint64_t)type)
+                 : "memory");
+}
+
+void vm_flush_pcid_local(const uint16_t pcid) {
+    if(!pcid_enabled) {
+        return; // switching away already flushed everything
+    }
+    invpcid_or_flush_everything(INVPCID_SINGLE_CONTEXT, pcid);
+}
+
+void vm_flush_all_address_spaces_local(void) {
+    if(!pcid_enabled) {
+        reload_cr3(read_cr3());
+    } else {
+        // NOTE: Toggling cr4.PGE flushes every PCID, which `invpcid` can only do on CPUs that support it.
+        invpcid_or_flush_everything(INVPCID_ALL_CONTEXTS, 0u);
+    }
+}
+
+bool vm_pcid_supported(void) {
+    return pcid_supported;
+}
+
+void vm_set_pcid_enabled(const bool enable) {
+    kassert(!enable || pcid_supported, "PCIDs are unsupported.");
+
+    const uint64_t rflags = interrupts_save_and_disable();
+
+    // the kernel address space uses PCID 0, which is required for changing cr4.PCIDE
+    switch_address_space(&kernel_address_space);
+    const uint64_t cr4 = read_cr4();
+    write_cr4(enable ? (cr4 | CR4_PCID_ENABLE) : (cr4 & ~CR4_PCID_ENABLE));
+    pcid_enabled = enable;
+    retire_all_pcids();
+
+    interrupts_restore(rflags);
+}
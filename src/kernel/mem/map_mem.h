@@ -1,7 +1,15 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include <libc/required_libc_functions.h>
+#include <kernel/error/error.h>
+
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/percpu.h>
+#include <kernel/sync/spinlock.h>
+
 #include "mem_constants.h"
 
 // NOTE: Only used for memory mapping prior to getting the memory and/or setting up linear shifted RAM address space
@@ -16,6 +24,132 @@ static inline void reload_cr3(const uint64_t pml4_phys_addr) {
     asm volatile("movq %0, %%cr3" :: "r" (pml4_phys_addr) : "memory");
 }
 
+static inline uint64_t read_cr3(void) {
+    uint64_t cr3;
+    asm volatile("movq %%cr3, %0" : "=r" (cr3));
+    return cr3;
+}
+
+static inline uint64_t read_cr4(void) {
+    uint64_t cr4;
+    asm volatile("movq %%cr4, %0" : "=r" (cr4));
+    return cr4;
+}
+
+static inline void write_cr4(const uint64_t cr4) {
+    asm volatile("movq %0, %%cr4" :: "r" (cr4) : "memory");
+}
+
+#define CR4_GLOBAL_PAGE_ENABLE (1ULL << 7)
+#define CR4_PCID_ENABLE (1ULL << 17) // can only be set while cr3[11:0] is 0
+
+// With cr4.PCIDE set, cr3[11:0] holds the PCID that tags every TLB entry created under that cr3.
+//  Setting bit 63 when writing cr3 keeps the TLB entries of the new PCID instead of flushing them. It always reads back as 0.
+#define CR3_PCID_MASK 0xFFFULL
+#define CR3_NO_FLUSH (1ULL << 63)
+
+enum invpcid_type {
+    INVPCID_INDIVIDUAL_ADDRESS = 0,
+    INVPCID_SINGLE_CONTEXT = 1,
+    INVPCID_ALL_CONTEXTS_INCLUDING_GLOBAL = 2,
+    INVPCID_ALL_CONTEXTS = 3,
+};
+
+static inline void invpcid(const enum invpcid_type type, const uint64_t pcid, const uint64_t virt_addr) {
+    const struct {
+        uint64_t pcid;
+        uint64_t virt_addr;
+    } descriptor = { pcid, virt_addr };
+    asm volatile("invpcid %0, %1" :: "m" (descriptor), "r" ((uint64_t)type) : "memory");
+}
+
+// A cr3 reload keeps global pages, so toggling cr4.PGE is the only way to flush everything.
+static inline void flush_all_tlb_entries_including_global(void) {
+    const uint64_t cr4 = read_cr4();
+    write_cr4(cr4 & ~CR4_GLOBAL_PAGE_ENABLE);
+    write_cr4(cr4);
+}
+
+static inline uint64_t kernel_root_page_table_phys_addr(void) {
+    return (paging_levels == 5u) ? PML5T_PHYS_ADDR : PM4LT_PHYS_ADDR;
+}
+
 static inline void early_single_page_virt_page_init(void) {
     early_single_page_virt_page_addr = round_up_to_page((uint64_t)&kernel_end);
 }
+
+struct vm_region;
+
+struct address_space {
+    uint64_t root_table_phys_addr; // the pml4t, or the pml5t with 5-level paging
+    struct spinlock lock; // protects the page tables below the root
+    struct spinlock regions_lock;
+    struct vm_region* regions; // sorted by start address
+    uint16_t pcid;
+    uint64_t pcid_generation; // `pcid` is only valid while this matches the current PCID generation
+    uint64_t pcid_cpus_mask; // CPUs that have used `pcid`, and so can have entries cached under it
+    volatile uint64_t active_cpus_mask; // CPUs that have this address space loaded right now
+};
+
+extern struct address_space kernel_address_space;
+
+// flags for `map_range()` and `protect_range()`, where a mapping is always readable and present
+#define VM_WRITEABLE (1u << 0)
+#define VM_EXECUTABLE (1u << 1)
+#define VM_USER (1u << 2)
+#define VM_GLOBAL (1u << 3)
+#define VM_UNCACHED (1u << 4) // PAT entry 3, which is UC. Needed for device registers, since reads have side effects.
+#define VM_WRITE_COMBINING (1u << 5) // PAT entry 5, which the boot stub sets to WC. For framebuffers, where the stores can be merged into bursts.
+
+// Invalidations are gathered while the page tables are edited and flushed in one step at the end, on every CPU that needs it.
+//  Up to `TLB_FLUSH_BATCH_CAPACITY` pages are flushed one by one with `invlpg`, past that it is cheaper to flush the whole TLB.
+//  A batch must be zero initialized.
+#define TLB_FLUSH_BATCH_CAPACITY 32u
+
+struct tlb_flush_batch {
+    uint64_t virt_addrs[TLB_FLUSH_BATCH_CAPACITY];
+    uint32_t count;
+    bool flush_everything;
+    bool includes_global_pages;
+};
+
+// Must be called once the linear map and the physical allocator are set up.
+void vm_init(void);
+
+// All of these work on page granularity and pick 1GiB or 2MiB pages whenever the alignment and size allow it.
+//  Intermediate tables are allocated on demand, and huge pages that are only partially covered get split.
+void map_range(struct address_space* address_space, uint64_t virt_addr, uint64_t phys_addr, uint64_t size, uint32_t flags);
+void unmap_range(struct address_space* address_space, uint64_t virt_addr, uint64_t size);
+void protect_range(struct address_space* address_space, uint64_t virt_addr, uint64_t size, uint32_t flags);
+
+// These gather the invalidations into `batch` instead of flushing right away, so several calls on the same address space cost a single shootdown.
+//  The unmapped memory must not be reused before `tlb_flush_batch_finish()`.
+void unmap_range_deferred(struct address_space* address_space, uint64_t virt_addr, uint64_t size, struct tlb_flush_batch* batch);
+void protect_range_deferred(struct address_space* address_space, uint64_t virt_addr, uint64_t size, uint32_t flags, struct tlb_flush_batch* batch);
+void tlb_flush_batch_finish(struct address_space* address_space, struct tlb_flush_batch* batch);
+
+// Maps a single 4KiB page, unless it is already mapped to anything other than `replaceable_phys_addr` (`VM_NO_REPLACEABLE_PAGE` for nothing).
+//  The check and the update happen under the page table lock, so it returns false to the loser of two racing callers.
+#define VM_NO_REPLACEABLE_PAGE UINT64_MAX
+bool map_page_replacing(struct address_space* address_space, uint64_t virt_addr, uint64_t phys_addr, uint32_t flags, uint64_t replaceable_phys_addr);
+
+// returns false if `virt_addr` is not mapped
+bool virt_to_phys(struct address_space* address_space, uint64_t virt_addr, uint64_t* phys_addr);
+
+// Every address space shares the kernel half of `kernel_address_space`, and starts with an empty user half.
+struct address_space* address_space_create(void);
+// Frees the page tables of the user half, but not the pages they map. Must not be the active address space, and must not have any regions left.
+void address_space_destroy(struct address_space* address_space);
+
+// Loads `address_space` into cr3. With PCIDs the TLB entries of the address space survive switching away and back.
+void switch_address_space(struct address_space* address_space);
+
+struct address_space* vm_current_address_space(void);
+
+// used by TLB shootdowns
+void vm_flush_pcid_local(uint16_t pcid);
+void vm_flush_all_address_spaces_local(void);
+
+bool vm_pcid_supported(void);
+// Mostly for benchmarking. Enabled by default when the CPU supports it, and switches to `kernel_address_space`.
+void vm_set_pcid_enabled(bool enable);
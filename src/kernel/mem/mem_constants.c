@@ -1,4 +1,5 @@
 #include "mem_constants.h"
 
-uint32_t multiboot_total_size;
 uint64_t early_single_page_virt_page_addr;
+uint32_t paging_levels;
+uint64_t direct_map_offset = DIRECT_MAP_OFFSET_4_LEVEL;
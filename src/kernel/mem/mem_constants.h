@@ -3,18 +3,34 @@
 #include <stdint.h>
 
 #define KERNEL_VIRT_OFFSET 0xFFFFFFFF80000000ULL // beginning of highest 2GiB
-#define DIRECT_MAP_OFFSET  0xFFFF800000000000ULL // this is the halfway point of the 4-level virtual address space. This is 2^48 with 1's sign extended into the preceding 16 "fake" bits
+#define DIRECT_MAP_OFFSET_4_LEVEL 0xFFFF800000000000ULL // this is the halfway point of the 4-level virtual address space. This is 2^48 with 1's sign extended into the preceding 16 "fake" bits
+#define DIRECT_MAP_OFFSET_5_LEVEL 0xFF00000000000000ULL // this is the halfway point of the 5-level virtual address space. This is 2^57 with 1's sign extended into the preceding 7 "fake" bits
+
+// The direct map starts at entry 256 of the top level table and can use every entry up to (but not including) 510.
+//  Entry 510 is the window for kernel regions (see vm_region.c) and 511 holds the kernel image.
+#define DIRECT_MAP_FIRST_TOP_LEVEL_INDEX 256u
+#define KERNEL_REGIONS_TOP_LEVEL_INDEX 510u
+#define DIRECT_MAP_MAX_TOP_LEVEL_ENTRIES (KERNEL_REGIONS_TOP_LEVEL_INDEX - DIRECT_MAP_FIRST_TOP_LEVEL_INDEX)
 
 #define PT_ADDR_MASK 0xFFFFFFFFFF000ULL
 
 #define KERNEL_V2P(x) ((x) - KERNEL_VIRT_OFFSET)
 #define KERNEL_P2V(x) ((x) + KERNEL_VIRT_OFFSET)
 
-#define GENERAL_MEM_V2P(x) ((x) - DIRECT_MAP_OFFSET)
-#define GENERAL_MEM_P2V(x) ((x) + DIRECT_MAP_OFFSET)
+#define GENERAL_MEM_V2P(x) ((x) - direct_map_offset)
+#define GENERAL_MEM_P2V(x) ((x) + direct_map_offset)
 
 #define PT_PRESENT 1
 #define PT_WRITEABLE 2
+#define PT_USER (1ULL << 2)
+#define PT_WRITE_THROUGH (1ULL << 3)
+#define PT_CACHE_DISABLE (1ULL << 4)
+#define PT_ACCESSED (1ULL << 5)
+#define PT_DIRTY (1ULL << 6)
+#define PT_PAT (1ULL << 7) // only for a PTE that maps a 4KiB page, in a PDE/PDPTE this is the page size bit
+#define PT_GLOBAL_PAGE (1ULL << 8)
+#define PT_DISABLE_EXECUTE (1ULL << 63)
+#define PT_HUGE_PAGE_PAT (1ULL << 12) // the PAT bit of a PDE/PDPTE that maps a 2MiB/1GiB page
 
 #define PHYSICAL_ADDRESS_MASK (0xFFFFFFFFFFULL << 12)
 
@@ -45,15 +61,21 @@
 #define PDPTE_HUGE_PAGE (1ULL << 7)
 #define PDPTE_GLOBAL_PAGE (1ULL << 8)
 #define PDPTE_DISABLE_EXECUTE (1ULL << 63)
+// NOTE: A PDE that maps a 2MiB page uses the same bit layout as above (except that the physical address starts at bit 21), so the PDPTE_* flags are used for both.
 
 extern char kernel_end; // &kernel_end = kernel end addr
 
 extern char pml4t; // &pml4t = higher half kernel virtual address mapping of the pml4t
 #define PM4LT_PHYS_ADDR KERNEL_V2P((uint64_t)&pml4t)
 
-extern uint32_t multiboot_total_size; // This is set in the boot stub since it is easier than mapping a page just to read the multiboot structure size.
+extern char pml5t; // &pml5t = higher half kernel virtual address mapping of the pml5t, which is only used with 5-level paging
+#define PML5T_PHYS_ADDR KERNEL_V2P((uint64_t)&pml5t)
+
+extern uint32_t paging_levels; // Either 4 or 5. This is set in the boot stub since 5-level paging can only be enabled before entering long mode.
+
+extern uint64_t direct_map_offset; // Either `DIRECT_MAP_OFFSET_4_LEVEL` or `DIRECT_MAP_OFFSET_5_LEVEL`, depending on `paging_levels`.
 
-extern uint64_t early_single_page_virt_page_addr; // This is the virtual page right after `&kernel_end` and is used in order to traverse through the multiboot structure and read the memory map
+extern uint64_t early_single_page_virt_page_addr; // This is the virtual page right after `&kernel_end` and is used in order to read the multiboot structure (see boot_info.h)
 
 static inline uint64_t round_up(const uint64_t unrounded_val, const uint64_t desired_factor) {
     return (unrounded_val + desired_factor - 1ULL) & ~(desired_factor - 1ULL);
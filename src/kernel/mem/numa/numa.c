@@ -0,0 +1,260 @@
+#include "numa.h"
+
+struct numa_memory_range {
+    uint64_t base;
+    uint64_t end; // exclusive
+    uint32_t node;
+};
+
+struct numa_processor_affinity {
+    uint32_t apic_id;
+    uint32_t node;
+};
+
+static uint32_t numa_node_count = 1u;
+static uint32_t numa_node_proximity_domains[MAX_NUMA_NODES];
+
+static struct numa_memory_range numa_memory_ranges[MAX_NUMA_MEMORY_RANGES]; // sorted by base address
+static uint32_t numa_memory_range_count;
+
+static struct numa_processor_affinity numa_processor_affinities[MAX_NUMA_PROCESSOR_AFFINITIES];
+static uint32_t numa_processor_affinity_count;
+
+static uint8_t numa_distances[MAX_NUMA_NODES][MAX_NUMA_NODES];
+static uint32_t numa_fallback_orders[MAX_NUMA_NODES][MAX_NUMA_NODES];
+
+static uint32_t numa_cpu_nodes[MAX_CPUS];
+
+static uint32_t get_or_add_node(const uint32_t proximity_domain) {
+    for(uint32_t node = 0u; node < numa_node_count; ++node) {
+        if(numa_node_proximity_domains[node] == proximity_domain) {
+            return node;
+        }
+    }
+
+    if(numa_node_count == MAX_NUMA_NODES) {
+        halt_and_die("Too many NUMA nodes.");
+    }
+
+    numa_node_proximity_domains[numa_node_count] = proximity_domain;
+    return numa_node_count++;
+}
+
+static void add_memory_range(const uint64_t base, const uint64_t length, const uint32_t node) {
+    if(length == 0u) return;
+
+    if(numa_memory_range_count == MAX_NUMA_MEMORY_RANGES) {
+        halt_and_die("Too many NUMA memory ranges.");
+    }
+
+    // insertion sort, since there are only a handful of ranges
+    uint32_t i = numa_memory_range_count++;
+    while(i > 0u && numa_memory_ranges[i - 1u].base > base) {
+        numa_memory_ranges[i] = numa_memory_ranges[i - 1u];
+        --i;
+    }
+    numa_memory_ranges[i] = (struct numa_memory_range) { base, base + length, node };
+}
+
+static void add_processor_affinity(const uint32_t apic_id, const uint32_t node) {
+    if(numa_processor_affinity_count == MAX_NUMA_PROCESSOR_AFFINITIES) return; // we cannot start that many CPUs anyways
+
+    numa_processor_affinities[numa_processor_affinity_count++] = (struct numa_processor_affinity) { apic_id, node };
+}
+
+static void parse_srat(const struct SRAT *const SRAT_virt_addr) {
+    // the first proximity domain we see is not necessarily 0, so we start from an empty node list
+    numa_node_count = 0u;
+
+    const uint64_t total_len = SRAT_virt_addr->header.Length;
+    uint64_t offset = sizeof(struct SRAT);
+    const uint8_t* ptr = (const uint8_t*)SRAT_virt_addr->StaticResourceAllocationStructure;
+
+    while(offset + sizeof(struct InterruptEntryHeader) <= total_len) {
+        const struct InterruptEntryHeader *const current_header = (const struct InterruptEntryHeader*) ptr;
+
+        if(current_header->Length < sizeof(struct InterruptEntryHeader) || offset + current_header->Length > total_len) {
+            halt_and_die("SRAT entry has invalid Length.");
+        }
+
+        if(current_header->Type == 0 && current_header->Length >= sizeof(struct ProcessorLocal_APIC_AffinityStructure)) {
+            const struct ProcessorLocal_APIC_AffinityStructure *const entry = (const struct ProcessorLocal_APIC_AffinityStructure*) ptr;
+            if(entry->Flags & AffinityEnabled) {
+                const uint32_t proximity_domain = entry->ProximityDomain_7_0 | ((uint32_t)entry->ProximityDomain_31_8[0] << 8) | ((uint32_t)entry->ProximityDomain_31_8[1] << 16) | ((uint32_t)entry->ProximityDomain_31_8[2] << 24);
+                add_processor_affinity(entry->APIC_ID, get_or_add_node(proximity_domain));
+            }
+        }
+        else if(current_header->Type == 1 && current_header->Length >= sizeof(struct MemoryAffinityStructure)) {
+            const struct MemoryAffinityStructure *const entry = (const struct MemoryAffinityStructure*) ptr;
+            if(entry->Flags & AffinityEnabled) {
+                add_memory_range(entry->BaseAddress, entry->Length, get_or_add_node(entry->ProximityDomain));
+            }
+        }
+        else if(current_header->Type == 2 && current_header->Length >= sizeof(struct ProcessorLocalx2APIC_AffinityStructure)) {
+            const struct ProcessorLocalx2APIC_AffinityStructure *const entry = (const struct ProcessorLocalx2APIC_AffinityStructure*) ptr;
+            if(entry->Flags & AffinityEnabled) {
+                add_processor_affinity(entry->X2APIC_ID, get_or_add_node(entry->ProximityDomain));
+            }
+        }
+
+        offset += current_header->Length;
+        ptr += current_header->Length;
+    }
+
+    if(numa_node_count == 0u) {
+        numa_node_count = 1u; // an SRAT without any enabled entries
+    }
+}
+
+static void fill_distances(const struct SLIT *const SLIT_virt_addr) {
+    for(uint32_t from = 0u; from < numa_node_count; ++from) {
+        for(uint32_t to = 0u; to < numa_node_count; ++to) {
+            uint8_t distance = (from == to) ? NUMA_LOCAL_DISTANCE : NUMA_DEFAULT_REMOTE_DISTANCE;
+
+            if(SLIT_virt_addr != NULL) {
+                const uint64_t number_of_localities = SLIT_virt_addr->NumberOfSystemLocalities;
+                const uint64_t from_domain = numa_node_proximity_domains[from];
+                const uint64_t to_domain = numa_node_proximity_domains[to];
+                const uint64_t entry_offset = sizeof(struct SLIT) + from_domain*number_of_localities + to_domain;
+
+                if(from_domain < number_of_localities && to_domain < number_of_localities && entry_offset < SLIT_virt_addr->header.Length) {
+                    distance = SLIT_virt_addr->Entry[from_domain*number_of_localities + to_domain];
+                }
+            }
+
+            numa_distances[from][to] = distance;
+        }
+    }
+}
+
+static void fill_fallback_orders(void) {
+    for(uint32_t node = 0u; node < numa_node_count; ++node) {
+        uint32_t *const order = numa_fallback_orders[node];
+
+        // insertion sort by distance, with the node itself always first (even if the firmware claims another node is just as close)
+        order[0] = node;
+        uint32_t count = 1u;
+        for(uint32_t other = 0u; other < numa_node_count; ++other) {
+            if(other == node) continue;
+
+            uint32_t i = count++;
+            while(i > 1u && numa_distances[node][order[i - 1u]] > numa_distances[node][other]) {
+                order[i] = order[i - 1u];
+                --i;
+            }
+            order[i] = other;
+        }
+    }
+}
+
+void numa_init(const struct SRAT *const SRAT_virt_addr, const struct SLIT *const SLIT_virt_addr) {
+    if(SRAT_virt_addr != NULL) {
+        parse_srat(SRAT_virt_addr);
+    }
+
+    fill_distances(SRAT_virt_addr != NULL ? SLIT_virt_addr : NULL);
+    fill_fallback_orders();
+
+    numa_set_cpu_apic_id(current_cpu_id(), read_initial_apic_id());
+}
+
+uint32_t numa_number_of_nodes(void) {
+    return numa_node_count;
+}
+
+// returns the index of the last range whose base is <= `phys_addr`, or -1 if there is none
+static int64_t find_memory_range(const uint64_t phys_addr) {
+    int64_t low = 0;
+    int64_t high = (int64_t)numa_memory_range_count - 1;
+    int64_t found = -1;
+
+    while(low <= high) {
+        const int64_t middle = low + (high - low)/2;
+        if(numa_memory_ranges[middle].base <= phys_addr) {
+            found = middle;
+            low = middle + 1;
+        }
+        else {
+            high = middle - 1;
+        }
+    }
+
+    return found;
+}
+
+uint32_t numa_node_of_phys_addr(const uint64_t phys_addr) {
+    const int64_t i = find_memory_range(phys_addr);
+    if(i >= 0 && phys_addr < numa_memory_ranges[i].end) {
+        return numa_memory_ranges[i].node;
+    }
+    return 0u;
+}
+
+uint64_t numa_end_of_node_range(const uint64_t phys_addr) {
+    const int64_t i = find_memory_range(phys_addr);
+    if(i >= 0 && phys_addr < numa_memory_ranges[i].end) {
+        return numa_memory_ranges[i].end;
+    }
+
+    // not covered by any range, so it is node 0 up until the next range
+    if((uint64_t)(i + 1) < numa_memory_range_count) {
+        return numa_memory_ranges[i + 1].base;
+    }
+    return (uint64_t) -1;
+}
+
+uint8_t numa_distance(const uint32_t from_node, const uint32_t to_node) {
+    kassert(from_node < numa_node_count && to_node < numa_node_count, "NUMA node is out of bounds.");
+    return numa_distances[from_node][to_node];
+}
+
+const uint32_t* numa_fallback_order(const uint32_t node) {
+    kassert(node < numa_node_count, "NUMA node is out of bounds.");
+    return numa_fallback_orders[node];
+}
+
+void numa_set_cpu_apic_id(const uint32_t cpu_id, const uint32_t apic_id) {
+    kassert(cpu_id < MAX_CPUS, "CPU id is out of bounds.");
+
+    numa_cpu_nodes[cpu_id] = 0u;
+    for(uint32_t i = 0u; i < numa_processor_affinity_count; ++i) {
+        if(numa_processor_affinities[i].apic_id == apic_id) {
+            numa_cpu_nodes[cpu_id] = numa_processor_affinities[i].node;
+            break;
+        }
+    }
+}
+
+uint32_t numa_node_of_cpu(const uint32_t cpu_id) {
+    kassert(cpu_id < MAX_CPUS, "CPU id is out of bounds.");
+    return numa_cpu_nodes[cpu_id];
+}
+
+void numa_print_topology(void) {
+    char str_buf[32];
+
+    serial_writestring("NUMA nodes: ");
+    serial_writestring(print_digits(numa_node_count, str_buf));
+    serial_writestring("\n");
+
+    for(uint32_t i = 0u; i < numa_memory_range_count; ++i) {
+        serial_writestring("numa_memory_range : { [");
+        serial_writestring(print_hex(numa_memory_ranges[i].base, str_buf));
+        serial_writestring("--");
+        serial_writestring(print_hex(numa_memory_ranges[i].end - 1u, str_buf));
+        serial_writestring("], node: ");
+        serial_writestring(print_digits(numa_memory_ranges[i].node, str_buf));
+        serial_writestring("}\n");
+    }
+
+    for(uint32_t from = 0u; from < numa_node_count; ++from) {
+        serial_writestring("node ");
+        serial_writestring(print_digits(from, str_buf));
+        serial_writestring(" distances:");
+        for(uint32_t to = 0u; to < numa_node_count; ++to) {
+            serial_writestring(" ");
+            serial_writestring(print_digits(numa_distances[from][to], str_buf));
+        }
+        serial_writestring("\n");
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libc/required_libc_functions.h>
+#include <kernel/error/error.h>
+
+#include <kernel/acpi/acpi_tables.h>
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/percpu.h>
+
+#define MAX_NUMA_NODES 16u
+#define MAX_NUMA_MEMORY_RANGES 64u
+#define MAX_NUMA_PROCESSOR_AFFINITIES 256u
+
+// SLIT distances are relative, where 10 is the distance from a node to itself.
+#define NUMA_LOCAL_DISTANCE 10u
+#define NUMA_DEFAULT_REMOTE_DISTANCE 20u // used when there is no SLIT
+
+// Proximity domains from the SRAT are renumbered into dense node ids in [0, numa_number_of_nodes()).
+//  If there is no SRAT (or it is NULL), everything is treated as a single node 0.
+//  Memory that is not covered by any SRAT memory affinity structure is treated as belonging to node 0.
+// NOTE: This must be called before `phys_mem_buddy_init()`, since the buddy allocator keeps a separate zone per node.
+void numa_init(const struct SRAT* SRAT_virt_addr, const struct SLIT* SLIT_virt_addr);
+
+uint32_t numa_number_of_nodes(void);
+
+uint32_t numa_node_of_phys_addr(uint64_t phys_addr);
+// returns the (exclusive) end of the memory starting at `phys_addr` that is guaranteed to belong to the same node as `phys_addr`
+uint64_t numa_end_of_node_range(uint64_t phys_addr);
+
+uint8_t numa_distance(uint32_t from_node, uint32_t to_node);
+// returns all the nodes ordered by increasing distance from `node`, which always starts with `node` itself
+const uint32_t* numa_fallback_order(uint32_t node);
+
+// records which node a CPU belongs to, based on the SRAT processor affinity of its APIC id
+void numa_set_cpu_apic_id(uint32_t cpu_id, uint32_t apic_id);
+uint32_t numa_node_of_cpu(uint32_t cpu_id);
+
+void numa_print_topology(void);
@@ -0,0 +1,113 @@
+#include "page_cache.h"
+
+#include <kernel/drivers/serial/serial.h>
+
+struct page_magazine {
+    uint64_t pages[PAGE_CACHE_CAPACITY];
+    uint32_t count;
+    struct page_cache_stats stats;
+} __attribute__ ((aligned(CACHE_LINE_SIZE))); // no two CPUs share a cache line
+
+static struct page_magazine page_magazines[MAX_CPUS];
+static uint32_t page_cache_batch_size = PAGE_CACHE_DEFAULT_BATCH_SIZE;
+
+void page_cache_set_batch_size(const uint32_t batch_size) {
+    kassert(batch_size != 0u && batch_size <= PAGE_CACHE_CAPACITY, "Invalid page cache batch size.");
+    page_cache_batch_size = batch_size;
+}
+
+uint64_t phys_mem_allocate_page(void) {
+    const uint64_t rflags = interrupts_save_and_disable(); // the magazine is only ever touched by its own CPU, so disabling interrupts is enough
+    struct page_magazine *const magazine = &page_magazines[current_cpu_id()];
+
+    ++magazine->stats.allocations;
+    if(magazine->count == 0u) {
+        phys_mem_allocate_page_batch(magazine->pages, page_cache_batch_size);
+        magazine->count = page_cache_batch_size;
+        ++magazine->stats.refills;
+    }
+    else {
+        ++magazine->stats.allocation_hits;
+    }
+
+    const uint64_t page_addr = magazine->pages[--magazine->count];
+
+    interrupts_restore(rflags);
+    return page_addr;
+}
+
+void phys_mem_free_page(const uint64_t page_addr) {
+    kassert(offset_in_page(page_addr) == 0ULL, "Freeing a misaligned page.");
+
+    const uint64_t rflags = interrupts_save_and_disable();
+    struct page_magazine *const magazine = &page_magazines[current_cpu_id()];
+
+    ++magazine->stats.frees;
+    if(magazine->count == PAGE_CACHE_CAPACITY) {
+        // drain the oldest pages at the bottom of the stack, since the ones on top are the most likely to still be cache hot
+        phys_mem_free_page_batch(magazine->pages, page_cache_batch_size);
+        magazine->count -= page_cache_batch_size;
+        memmove(magazine->pages, &magazine->pages[page_cache_batch_size], magazine->count*sizeof(uint64_t));
+        ++magazine->stats.drains;
+    }
+    else {
+        ++magazine->stats.free_hits;
+    }
+
+    magazine->pages[magazine->count++] = page_addr;
+
+    interrupts_restore(rflags);
+}
+
+void page_cache_drain_current_cpu(void) {
+    const uint64_t rflags = interrupts_save_and_disable();
+    struct page_magazine *const magazine = &page_magazines[current_cpu_id()];
+
+    if(magazine->count != 0u) {
+        phys_mem_free_page_batch(magazine->pages, magazine->count);
+        magazine->count = 0u;
+        ++magazine->stats.drains;
+    }
+
+    interrupts_restore(rflags);
+}
+
+struct page_cache_stats page_cache_get_stats(const uint32_t cpu_id) {
+    kassert(cpu_id < MAX_CPUS, "CPU id is out of bounds.");
+    return page_magazines[cpu_id].stats;
+}
+
+void page_cache_reset_stats(void) {
+    for(uint32_t cpu_id = 0u; cpu_id < MAX_CPUS; ++cpu_id) {
+        page_magazines[cpu_id].stats = (struct page_cache_stats) { 0 };
+    }
+}
+
+void page_cache_print_stats(void) {
+    char str_buf[32];
+
+    serial_writestring("Page cache stats (batch size ");
+    serial_writestring(print_digits(page_cache_batch_size, str_buf));
+    serial_writestring("):\n");
+    for(uint32_t cpu_id = 0u; cpu_id < MAX_CPUS; ++cpu_id) {
+        const struct page_cache_stats stats = page_magazines[cpu_id].stats;
+        if(stats.allocations == 0u && stats.frees == 0u) continue;
+
+        const uint64_t total_ops = stats.allocations + stats.frees;
+        const uint64_t hit_rate_percent = (stats.allocation_hits + stats.free_hits)*100u/total_ops;
+
+        serial_writestring("cpu ");
+        serial_writestring(print_digits(cpu_id, str_buf));
+        serial_writestring(": allocations: ");
+        serial_writestring(print_digits(stats.allocations, str_buf));
+        serial_writestring(", frees: ");
+        serial_writestring(print_digits(stats.frees, str_buf));
+        serial_writestring(", hit rate: ");
+        serial_writestring(print_digits(hit_rate_percent, str_buf));
+        serial_writestring("%, refills: ");
+        serial_writestring(print_digits(stats.refills, str_buf));
+        serial_writestring(", drains: ");
+        serial_writestring(print_digits(stats.drains, str_buf));
+        serial_writestring("\n");
+    }
+}
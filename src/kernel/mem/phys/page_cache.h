@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <kernel/cpu/percpu.h>
+
+#include "phys_mem_allocator.h"
+
+// Each CPU keeps a small LIFO stack ("magazine") of free page frames in front of the buddy allocator.
+//  An empty magazine is refilled with `batch_size` pages and a full one drains `batch_size` pages back, in both cases under a single acquisition of the global lock.
+#define PAGE_CACHE_CAPACITY 64u
+#define PAGE_CACHE_DEFAULT_BATCH_SIZE 16u
+
+struct page_cache_stats {
+    uint64_t allocations;
+    uint64_t allocation_hits; // allocations that were served without touching the global allocator
+    uint64_t frees;
+    uint64_t free_hits; // frees that were absorbed without touching the global allocator
+    uint64_t refills;
+    uint64_t drains;
+};
+
+// `batch_size` must be in [1, PAGE_CACHE_CAPACITY]
+void page_cache_set_batch_size(uint32_t batch_size);
+
+struct page_cache_stats page_cache_get_stats(uint32_t cpu_id);
+void page_cache_reset_stats(void);
+void page_cache_print_stats(void);
+
+// gives all cached pages of the current CPU back to the global allocator
+void page_cache_drain_current_cpu(void);
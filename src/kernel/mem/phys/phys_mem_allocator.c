@@ -1,12 +1,40 @@
 #include "phys_mem_allocator.h"
 
+#include <kernel/trace/trace.h>
+
 static uint64_t* phys_mem_meta_data;
 static uint64_t phys_mem_number_of_uint64t_entries; // if the total number of pages is not a multiple of 64, we just reserve the excess bits in the last entry using `reserve_page()`
 
-void phys_mem_alloc_init(uint64_t *const metadata, const uint64_t number_of_uint64t_entries) {
+// Buddy allocator state:
+//  There is one zone per NUMA node, and every free block is on the free list of its order in the zone of its node.
+//  The list links are stored inside the free block itself (through the linear map).
+//  For each page, `buddy_page_orders` holds the order of the free block starting at that page, or `BUDDY_NOT_A_FREE_BLOCK` if no free block starts there.
+//  That is all we need for merging, since a block can only merge with its buddy if the buddy is a free block of the same order.
+#define BUDDY_NOT_A_FREE_BLOCK 0xFFu
+
+struct buddy_free_block {
+    struct buddy_free_block* next;
+    struct buddy_free_block* prev;
+};
+
+struct phys_mem_zone {
+    struct spinlock lock;
+    uint32_t non_empty_orders; // bit `k` is set iff `free_lists[k]` is non-empty
+    uint64_t number_of_free_pages;
+    struct buddy_free_block* free_lists[PHYS_MEM_MAX_ORDER + 1u];
+} __attribute__ ((aligned(CACHE_LINE_SIZE)));
+
+static uint8_t* buddy_page_orders;
+static struct phys_mem_zone phys_mem_zones[MAX_NUMA_NODES];
+static bool buddy_ready;
+
+void phys_mem_alloc_init(uint64_t *const metadata, const uint64_t number_of_uint64t_entries, uint8_t *const page_orders) {
     phys_mem_meta_data = metadata;
     phys_mem_number_of_uint64t_entries = number_of_uint64t_entries;
     memset(phys_mem_meta_data, 0, phys_mem_number_of_uint64t_entries*sizeof(uint64_t));
+
+    buddy_page_orders = page_orders;
+    memset(buddy_page_orders, BUDDY_NOT_A_FREE_BLOCK, phys_mem_number_of_uint64t_entries*64ULL);
 }
 
 static void set_bit(const uint64_t bit_index, const bool value) {
@@ -28,6 +56,7 @@ static bool is_bit_set(const uint64_t bit_index) {
 
 void phys_mem_reserve_pages(const uint64_t first_page_addr, const uint64_t sizeof_region_to_reserve) {
     kassert(phys_mem_meta_data != NULL, "phys_mem_alloc_init() was not called.");
+    kassert(buddy_ready == false, "Reserving pages after phys_mem_buddy_init().");
 
     if(sizeof_region_to_reserve == 0ULL) return;
 
@@ -61,8 +90,9 @@ void phys_mem_reserve_pages(const uint64_t first_page_addr, const uint64_t sizeo
     }
 }
 
-uint64_t phys_mem_allocate_page(void) {
+uint64_t phys_mem_bitmap_allocate_page(void) {
     kassert(phys_mem_meta_data != NULL, "phys_mem_alloc_init() was not called.");
+    kassert(buddy_ready == false, "The bitmap allocator is stale after phys_mem_buddy_init().");
 
     for(uint64_t i = 0ULL; i < phys_mem_number_of_uint64t_entries; ++i) {
         if(phys_mem_meta_data[i] != (uint64_t) -1) {
@@ -78,8 +108,9 @@ uint64_t phys_mem_allocate_page(void) {
     halt_and_die("Out of physical memory.");
 }
 
-void phys_mem_free_page(const uint64_t page_addr) {
+void phys_mem_bitmap_free_page(const uint64_t page_addr) {
     kassert(phys_mem_meta_data != NULL, "phys_mem_alloc_init() was not called.");
+    kassert(buddy_ready == false, "The bitmap allocator is stale after phys_mem_buddy_init().");
 
     const uint64_t page_index = page_addr/NORMAL_PAGE_SIZE; // no need to `round_down_to_page()` since integer division already implicitly does this for us
 
@@ -89,3 +120,248 @@ void phys_mem_free_page(const uint64_t page_addr) {
 
     set_bit(page_index, 0);
 }
+
+static struct buddy_free_block* page_index_to_free_block(const uint64_t page_index) {
+    return (struct buddy_free_block*) GENERAL_MEM_P2V(page_index*NORMAL_PAGE_SIZE);
+}
+
+static uint64_t free_block_to_page_index(const struct buddy_free_block *const block) {
+    return GENERAL_MEM_V2P((uint64_t)block)/NORMAL_PAGE_SIZE;
+}
+
+static uint32_t node_of_page_index(const uint64_t page_index) {
+    return numa_node_of_phys_addr(page_index*NORMAL_PAGE_SIZE);
+}
+
+static void push_free_block(struct phys_mem_zone *const zone, const uint64_t page_index, const uint32_t order) {
+    struct buddy_free_block *const block = page_index_to_free_block(page_index);
+
+    block->prev = NULL;
+    block->next = zone->free_lists[order];
+    if(block->next != NULL) {
+        block->next->prev = block;
+    }
+    zone->free_lists[order] = block;
+
+    zone->non_empty_orders |= 1u << order;
+    zone->number_of_free_pages += 1ULL << order;
+    buddy_page_orders[page_index] = (uint8_t) order;
+}
+
+static void remove_free_block(struct phys_mem_zone *const zone, const uint64_t page_index, const uint32_t order) {
+    struct buddy_free_block *const block = page_index_to_free_block(page_index);
+
+    if(block->prev != NULL) {
+        block->prev->next = block->next;
+    }
+    else {
+        zone->free_lists[order] = block->next;
+    }
+    if(block->next != NULL) {
+        block->next->prev = block->prev;
+    }
+
+    if(zone->free_lists[order] == NULL) {
+        zone->non_empty_orders &= ~(1u << order);
+    }
+    zone->number_of_free_pages -= 1ULL << order;
+    buddy_page_orders[page_index] = BUDDY_NOT_A_FREE_BLOCK;
+}
+
+// adds the free pages [first_page_index, end_page_index) to the free lists using the largest naturally aligned blocks that fit
+static void add_free_range(struct phys_mem_zone *const zone, uint64_t first_page_index, const uint64_t end_page_index) {
+    while(first_page_index < end_page_index) {
+        uint32_t order = PHYS_MEM_MAX_ORDER;
+        if(first_page_index != 0ULL) {
+            order = min((uint64_t)__builtin_ctzll(first_page_index), order);
+        }
+        order = min(63u - (uint64_t)__builtin_clzll(end_page_index - first_page_index), order);
+
+        push_free_block(zone, first_page_index, order);
+        first_page_index += 1ULL << order;
+    }
+}
+
+// returns the index of the first page at or after `page_index` whose bitmap bit equals `value`, or the total number of pages if there is none
+static uint64_t find_next_page_with_bit(uint64_t page_index, const bool value) {
+    const uint64_t total_number_of_pages = phys_mem_number_of_uint64t_entries*64ULL;
+
+    while(page_index < total_number_of_pages) {
+        uint64_t word = phys_mem_meta_data[page_index/64ULL];
+        if(!value) {
+            word = ~word;
+        }
+        word &= (uint64_t)-1 << (page_index%64ULL);
+
+        if(word != 0ULL) {
+            return round_down(page_index, 64ULL) + (uint64_t)__builtin_ctzll(word);
+        }
+        page_index = round_down(page_index, 64ULL) + 64ULL;
+    }
+
+    return total_number_of_pages;
+}
+
+void phys_mem_buddy_init(void) {
+    kassert(phys_mem_meta_data != NULL, "phys_mem_alloc_init() was not called.");
+    kassert(buddy_ready == false, "phys_mem_buddy_init() was called twice.");
+
+    for(uint32_t node = 0u; node < MAX_NUMA_NODES; ++node) {
+        phys_mem_zones[node].lock = (struct spinlock) SPINLOCK_INIT;
+    }
+
+    const uint64_t total_number_of_pages = phys_mem_number_of_uint64t_entries*64ULL;
+
+    // every maximal run of clear bits in the bitmap becomes a set of free blocks, split wherever the run crosses into another node
+    uint64_t page_index = find_next_page_with_bit(0ULL, false);
+    while(page_index < total_number_of_pages) {
+        const uint64_t end_of_run = find_next_page_with_bit(page_index, true);
+
+        while(page_index < end_of_run) {
+            // SRAT ranges are page aligned in practice, but a misaligned end must still not stall the loop
+            const uint64_t end_of_node = max(numa_end_of_node_range(page_index*NORMAL_PAGE_SIZE)/NORMAL_PAGE_SIZE, page_index + 1ULL);
+            const uint64_t end_of_range = min(end_of_run, end_of_node);
+
+            add_free_range(&phys_mem_zones[node_of_page_index(page_index)], page_index, end_of_range);
+            page_index = end_of_range;
+        }
+
+        page_index = find_next_page_with_bit(end_of_run, false);
+    }
+
+    buddy_ready = true;
+}
+
+// NOTE: The caller must hold `zone->lock`.
+static bool zone_allocate(struct phys_mem_zone *const zone, const uint32_t order, uint64_t *const first_page_addr) {
+    const uint32_t large_enough_orders = zone->non_empty_orders & ~((1u << order) - 1u);
+    if(large_enough_orders == 0u) {
+        return false;
+    }
+
+    uint32_t current_order = (uint32_t)__builtin_ctz(large_enough_orders);
+    const uint64_t page_index = free_block_to_page_index(zone->free_lists[current_order]);
+    remove_free_block(zone, page_index, current_order);
+
+    // split the block in half until it is the requested size, giving back the upper halves
+    while(current_order > order) {
+        --current_order;
+        push_free_block(zone, page_index + (1ULL << current_order), current_order);
+    }
+
+    *first_page_addr = page_index*NORMAL_PAGE_SIZE;
+    return true;
+}
+
+// NOTE: The caller must hold `zone->lock`, where `zone` is the zone of `first_page_addr`.
+static void zone_free(struct phys_mem_zone *const zone, const uint32_t node, const uint64_t first_page_addr, uint32_t order) {
+    const uint64_t total_number_of_pages = phys_mem_number_of_uint64t_entries*64ULL;
+    uint64_t page_index = first_page_addr/NORMAL_PAGE_SIZE;
+
+    kassert(offset(page_index, 1ULL << order) == 0ULL, "Freeing a misaligned block.");
+    kassert(page_index + (1ULL << order) <= total_number_of_pages, "Free address is out of bounds.");
+    kassert(buddy_page_orders[page_index] == BUDDY_NOT_A_FREE_BLOCK, "Freeing an already free physical block.");
+
+    // keep merging with our buddy for as long as the buddy is a free block of the same size in the same zone
+    while(order < PHYS_MEM_MAX_ORDER) {
+        const uint64_t buddy_page_index = page_index ^ (1ULL << order);
+        if(buddy_page_index >= total_number_of_pages || buddy_page_orders[buddy_page_index] != order || node_of_page_index(buddy_page_index) != node) {
+            break;
+        }
+
+        remove_free_block(zone, buddy_page_index, order);
+        page_index &= ~(1ULL << order);
+        ++order;
+    }
+
+    push_free_block(zone, page_index, order);
+}
+
+uint64_t phys_mem_allocate_pages_node(const uint32_t preferred_node, const uint32_t order) {
+    kassert(buddy_ready, "phys_mem_buddy_init() was not called.");
+    kassert(order <= PHYS_MEM_MAX_ORDER, "Allocation order is too large.");
+
+    const uint32_t *const fallback_order = numa_fallback_order(preferred_node);
+    for(uint32_t i = 0u; i < numa_number_of_nodes(); ++i) {
+        struct phys_mem_zone *const zone = &phys_mem_zones[fallback_order[i]];
+
+        uint64_t first_page_addr;
+        const uint64_t rflags = spin_lock_irqsave(&zone->lock);
+        const bool allocated = zone_allocate(zone, order, &first_page_addr);
+        spin_unlock_irqrestore(&zone->lock, rflags);
+
+        if(allocated) {
+            TRACE(TRACE_PAGES_ALLOCATE, first_page_addr, order);
+            return first_page_addr;
+        }
+    }
+
+    halt_and_die("Out of physical memory.");
+}
+
+uint64_t phys_mem_allocate_pages(const uint32_t order) {
+    return phys_mem_allocate_pages_node(numa_node_of_cpu(current_cpu_id()), order);
+}
+
+void phys_mem_free_pages(const uint64_t first_page_addr, const uint32_t order) {
+    kassert(buddy_ready, "phys_mem_buddy_init() was not called.");
+    kassert(order <= PHYS_MEM_MAX_ORDER, "Free order is too large.");
+
+    TRACE(TRACE_PAGES_FREE, first_page_addr, order);
+    const uint32_t node = numa_node_of_phys_addr(first_page_addr);
+    struct phys_mem_zone *const zone = &phys_mem_zones[node];
+
+    const uint64_t rflags = spin_lock_irqsave(&zone->lock);
+    zone_free(zone, node, first_page_addr, order);
+    spin_unlock_irqrestore(&zone->lock, rflags);
+}
+
+void phys_mem_allocate_page_batch(uint64_t *const pages, const uint32_t count) {
+    kassert(buddy_ready, "phys_mem_buddy_init() was not called.");
+
+    uint32_t number_allocated = 0u;
+    const uint32_t *const fallback_order = numa_fallback_order(numa_node_of_cpu(current_cpu_id()));
+    for(uint32_t i = 0u; i < numa_number_of_nodes() && number_allocated < count; ++i) {
+        struct phys_mem_zone *const zone = &phys_mem_zones[fallback_order[i]];
+
+        const uint64_t rflags = spin_lock_irqsave(&zone->lock);
+        while(number_allocated < count && zone_allocate(zone, 0u, &pages[number_allocated])) {
+            ++number_allocated;
+        }
+        spin_unlock_irqrestore(&zone->lock, rflags);
+    }
+
+    if(number_allocated != count) {
+        halt_and_die("Out of physical memory.");
+    }
+}
+
+void phys_mem_free_page_batch(const uint64_t *const pages, const uint32_t count) {
+    kassert(buddy_ready, "phys_mem_buddy_init() was not called.");
+
+    // the pages almost always come from the same node, so only switch locks when the node changes
+    uint32_t i = 0u;
+    while(i < count) {
+        const uint32_t node = numa_node_of_phys_addr(pages[i]);
+        struct phys_mem_zone *const zone = &phys_mem_zones[node];
+
+        const uint64_t rflags = spin_lock_irqsave(&zone->lock);
+        do {
+            zone_free(zone, node, pages[i], 0u);
+            ++i;
+        } while(i < count && numa_node_of_phys_addr(pages[i]) == node);
+        spin_unlock_irqrestore(&zone->lock, rflags);
+    }
+}
+
+void phys_mem_print_zones(void) {
+    char str_buf[32];
+
+    for(uint32_t node = 0u; node < numa_number_of_nodes(); ++node) {
+        serial_writestring("phys_mem_zone ");
+        serial_writestring(print_digits(node, str_buf));
+        serial_writestring(": free pages: ");
+        serial_writestring(print_digits(phys_mem_zones[node].number_of_free_pages, str_buf));
+        serial_writestring("\n");
+    }
+}
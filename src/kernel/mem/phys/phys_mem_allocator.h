@@ -7,11 +7,41 @@
 #include <libc/required_libc_functions.h>
 #include <kernel/error/error.h>
 
+#include <kernel/drivers/serial/serial.h>
+#include <kernel/cpu/percpu.h>
 #include <kernel/mem/mem_constants.h>
+#include <kernel/mem/numa/numa.h>
+#include <kernel/sync/spinlock.h>
 
-void phys_mem_alloc_init(uint64_t* metadata, uint64_t number_of_uint64t_entries);
+// The largest buddy block is 2^PHYS_MEM_MAX_ORDER pages (i.e. 1GiB), which is also the largest page size we can map.
+#define PHYS_MEM_MAX_ORDER 18u
 
+// `buddy_page_orders` needs one byte per page tracked by the bitmap (i.e. `number_of_uint64t_entries*64` bytes).
+void phys_mem_alloc_init(uint64_t* metadata, uint64_t number_of_uint64t_entries, uint8_t* buddy_page_orders);
+
+// NOTE: Reservations are only allowed before `phys_mem_buddy_init()`, since that is when the bitmap is used to seed the buddy free lists.
 void phys_mem_reserve_pages(uint64_t first_page_addr, uint64_t sizeof_region_to_reserve);
 
+// NOTE: `numa_init()` must be called first, since every node gets its own zone.
+void phys_mem_buddy_init(void);
+
+// Allocates 2^order physically contiguous pages, aligned to their own size, from `preferred_node`.
+//  If that node is out of memory, the other nodes are tried in order of increasing distance.
+uint64_t phys_mem_allocate_pages_node(uint32_t preferred_node, uint32_t order);
+// same as above with the node of the current CPU
+uint64_t phys_mem_allocate_pages(uint32_t order);
+void phys_mem_free_pages(uint64_t first_page_addr, uint32_t order);
+
+// Takes the global lock once for the whole batch of single pages. This is what the per-CPU page caches use to refill and drain.
+void phys_mem_allocate_page_batch(uint64_t* pages, uint32_t count);
+void phys_mem_free_page_batch(const uint64_t* pages, uint32_t count);
+
+void phys_mem_print_zones(void);
+
+// NOTE: Single pages are served from the per-CPU page caches (see `page_cache.c`) and only hit the global lock on a refill or drain.
 uint64_t phys_mem_allocate_page(void);
 void phys_mem_free_page(uint64_t page_addr);
+
+// The original linear-scan bitmap path. It is only valid before `phys_mem_buddy_init()` and is kept around for comparing against the buddy allocator.
+uint64_t phys_mem_bitmap_allocate_page(void);
+void phys_mem_bitmap_free_page(uint64_t page_addr);
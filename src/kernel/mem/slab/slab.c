@@ -0,0 +1,231 @@
+#include "slab.h"
+
+struct slab {
+    struct kmem_cache* cache;
+    struct slab* next;
+    struct slab* prev;
+    void* free_objects;
+    uint32_t in_use;
+} __attribute__ ((aligned(CACHE_LINE_SIZE)));
+
+static struct kmem_cache kmem_cache_cache; // the cache that every other `struct kmem_cache` is allocated from
+static struct kmem_cache* kmalloc_caches[KMALLOC_NUMBER_OF_SIZE_CLASSES];
+
+static const char *const kmalloc_cache_names[KMALLOC_NUMBER_OF_SIZE_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128", "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048",
+};
+
+static void** free_link(const struct kmem_cache *const cache, void *const object) {
+    return (void**)((uint8_t*)object + cache->free_link_offset);
+}
+
+static struct slab* slab_of_object(const void *const object) {
+    return (struct slab*) round_down((uint64_t)object, SLAB_SIZE);
+}
+
+static void slab_list_push(struct kmem_cache *const cache, struct slab *const slab) {
+    slab->prev = NULL;
+    slab->next = cache->partial_slabs;
+    if(slab->next != NULL) {
+        slab->next->prev = slab;
+    }
+    cache->partial_slabs = slab;
+}
+
+static void slab_list_remove(struct kmem_cache *const cache, struct slab *const slab) {
+    if(slab->prev != NULL) {
+        slab->prev->next = slab->next;
+    }
+    else {
+        cache->partial_slabs = slab->next;
+    }
+    if(slab->next != NULL) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+// NOTE: The caller must hold `cache->lock`.
+static void slab_create(struct kmem_cache *const cache) {
+    struct slab *const slab = (struct slab*) GENERAL_MEM_P2V(phys_mem_allocate_pages(SLAB_ORDER));
+
+    slab->cache = cache;
+    slab->in_use = 0u;
+    slab->free_objects = NULL;
+
+    // thread the free list backwards so that objects are handed out in address order
+    uint8_t *const first_object = (uint8_t*)slab + cache->first_object_offset;
+    for(uint32_t i = cache->objects_per_slab; i > 0u; --i) {
+        void *const object = first_object + (uint64_t)(i - 1u)*cache->stride;
+        if(cache->ctor != NULL) {
+            cache->ctor(object);
+        }
+        *free_link(cache, object) = slab->free_objects;
+        slab->free_objects = object;
+    }
+
+    slab_list_push(cache, slab);
+    ++cache->number_of_empty_slabs;
+    ++cache->number_of_slabs;
+}
+
+// NOTE: The caller must hold `cache->lock`.
+static void* slab_take_object(struct kmem_cache *const cache) {
+    if(cache->partial_slabs == NULL) {
+        slab_create(cache);
+    }
+
+    struct slab *const slab = cache->partial_slabs;
+    if(slab->in_use == 0u) {
+        --cache->number_of_empty_slabs;
+    }
+
+    void *const object = slab->free_objects;
+    slab->free_objects = *free_link(cache, object);
+    ++slab->in_use;
+
+    if(slab->in_use == cache->objects_per_slab) {
+        slab_list_remove(cache, slab); // full slabs are not on any list until one of their objects is freed
+    }
+
+    return object;
+}
+
+// NOTE: The caller must hold `cache->lock`.
+static void slab_return_object(struct kmem_cache *const cache, void *const object) {
+    struct slab *const slab = slab_of_object(object);
+    kassert(slab->cache == cache, "Freeing an object to the wrong cache.");
+
+    if(slab->in_use == cache->objects_per_slab) {
+        slab_list_push(cache, slab);
+    }
+
+    *free_link(cache, object) = slab->free_objects;
+    slab->free_objects = object;
+    --slab->in_use;
+
+    if(slab->in_use == 0u) {
+        // keep a single empty slab around so that a cache hovering around a slab boundary does not keep hitting the buddy allocator
+        if(cache->number_of_empty_slabs != 0u) {
+            slab_list_remove(cache, slab);
+            --cache->number_of_slabs;
+            phys_mem_free_pages(GENERAL_MEM_V2P((uint64_t)slab), SLAB_ORDER);
+        }
+        else {
+            ++cache->number_of_empty_slabs;
+        }
+    }
+}
+
+static struct kmem_cpu_cache* allocate_cpu_caches(void) {
+    uint32_t order = 0u;
+    while((NORMAL_PAGE_SIZE << order) < MAX_CPUS*sizeof(struct kmem_cpu_cache)) {
+        ++order;
+    }
+
+    struct kmem_cpu_cache *const cpu_caches = (struct kmem_cpu_cache*) GENERAL_MEM_P2V(phys_mem_allocate_pages(order));
+    memset(cpu_caches, 0, MAX_CPUS*sizeof(struct kmem_cpu_cache));
+    return cpu_caches;
+}
+
+static void kmem_cache_setup(struct kmem_cache *const cache, const char *const name, const size_t object_size, size_t align, void (*const ctor)(void*)) {
+    kassert(object_size != 0u, "Empty slab objects.");
+
+    if(align == 0u) {
+        align = sizeof(void*);
+        while(align < object_size && align < CACHE_LINE_SIZE) {
+            align *= 2u;
+        }
+    }
+    kassert((align & (align - 1u)) == 0u && align >= sizeof(void*), "Slab alignment must be a power of two of at least 8.");
+
+    // constructed objects must keep their state while they are free, so their free list link goes into an extra word past the end of the object
+    const uint64_t free_link_offset = (ctor != NULL) ? round_up(object_size, sizeof(void*)) : 0u;
+    const uint64_t stride = round_up(max(object_size, free_link_offset + sizeof(void*)), align);
+    const uint64_t first_object_offset = round_up(sizeof(struct slab), max(align, CACHE_LINE_SIZE));
+
+    kassert(first_object_offset + stride <= SLAB_SIZE, "Slab objects are too large.");
+
+    *cache = (struct kmem_cache) {
+        .name = name,
+        .object_size = (uint32_t) object_size,
+        .stride = (uint32_t) stride,
+        .free_link_offset = (uint32_t) free_link_offset,
+        .first_object_offset = (uint32_t) first_object_offset,
+        .objects_per_slab = (uint32_t) ((SLAB_SIZE - first_object_offset)/stride),
+        .ctor = ctor,
+        .cpu_caches = allocate_cpu_caches(),
+        .lock = SPINLOCK_INIT,
+        .partial_slabs = NULL,
+        .number_of_empty_slabs = 0u,
+        .number_of_slabs = 0u,
+    };
+}
+
+struct kmem_cache* kmem_cache_create(const char *const name, const size_t object_size, const size_t align, void (*const ctor)(void*)) {
+    struct kmem_cache *const cache = kmem_cache_alloc(&kmem_cache_cache);
+    kmem_cache_setup(cache, name, object_size, align, ctor);
+    return cache;
+}
+
+void* kmem_cache_alloc(struct kmem_cache *const cache) {
+    const uint64_t rflags = interrupts_save_and_disable(); // the CPU cache is only ever touched by its own CPU
+    struct kmem_cpu_cache *const cpu_cache = &cache->cpu_caches[current_cpu_id()];
+
+    if(cpu_cache->count == 0u) {
+        spin_lock(&cache->lock);
+        while(cpu_cache->count < KMEM_CPU_CACHE_BATCH_SIZE) {
+            cpu_cache->objects[cpu_cache->count++] = slab_take_object(cache);
+        }
+        spin_unlock(&cache->lock);
+    }
+
+    void *const object = cpu_cache->objects[--cpu_cache->count];
+
+    interrupts_restore(rflags);
+    return object;
+}
+
+void kmem_cache_free(struct kmem_cache *const cache, void *const object) {
+    kassert(object != NULL, "Freeing a null slab object.");
+
+    const uint64_t rflags = interrupts_save_and_disable();
+    struct kmem_cpu_cache *const cpu_cache = &cache->cpu_caches[current_cpu_id()];
+
+    if(cpu_cache->count == KMEM_CPU_CACHE_CAPACITY) {
+        // give back the oldest objects at the bottom of the stack, since the ones on top are the most likely to still be cache hot
+        spin_lock(&cache->lock);
+        for(uint32_t i = 0u; i < KMEM_CPU_CACHE_BATCH_SIZE; ++i) {
+            slab_return_object(cache, cpu_cache->objects[i]);
+        }
+        spin_unlock(&cache->lock);
+
+        cpu_cache->count -= KMEM_CPU_CACHE_BATCH_SIZE;
+        memmove(cpu_cache->objects, &cpu_cache->objects[KMEM_CPU_CACHE_BATCH_SIZE], cpu_cache->count*sizeof(void*));
+    }
+
+    cpu_cache->objects[cpu_cache->count++] = object;
+
+    interrupts_restore(rflags);
+}
+
+void slab_init(void) {
+    kmem_cache_setup(&kmem_cache_cache, "kmem_cache", sizeof(struct kmem_cache), 0u, NULL);
+
+    for(uint32_t i = 0u; i < KMALLOC_NUMBER_OF_SIZE_CLASSES; ++i) {
+        kmalloc_caches[i] = kmem_cache_create(kmalloc_cache_names[i], KMALLOC_MIN_SIZE << i, 0u, NULL);
+    }
+}
+
+void* kmalloc(const size_t size) {
+    kassert(size <= KMALLOC_MAX_SIZE, "kmalloc() size is too large, use phys_mem_allocate_pages() instead.");
+
+    // index of the smallest power of two size class that fits `size`
+    const uint32_t size_class = (size <= KMALLOC_MIN_SIZE) ? 0u : (uint32_t)(64 - __builtin_clzll(size - 1u)) - 4u;
+    return kmem_cache_alloc(kmalloc_caches[size_class]);
+}
+
+void kfree(void *const object) {
+    if(object == NULL) return;
+
+    kmem_cache_free(slab_of_object(object)->cache, object);
+}
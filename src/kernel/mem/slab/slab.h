@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <libc/required_libc_functions.h>
+#include <kernel/error/error.h>
+
+#include <kernel/cpu/percpu.h>
+#include <kernel/mem/mem_constants.h>
+#include <kernel/mem/phys/phys_mem_allocator.h>
+#include <kernel/sync/spinlock.h>
+
+// Every slab is a naturally aligned buddy block of 2^SLAB_ORDER pages accessed through the linear map,
+//  so the slab header of any object is found by rounding the object address down to `SLAB_SIZE`.
+#define SLAB_ORDER 2u
+#define SLAB_SIZE (NORMAL_PAGE_SIZE << SLAB_ORDER)
+
+#define KMALLOC_MIN_SIZE 16u
+#define KMALLOC_MAX_SIZE 2048u
+#define KMALLOC_NUMBER_OF_SIZE_CLASSES 8u // 16, 32, ..., 2048
+
+// Each CPU cache is exactly one cache line: a count plus a small LIFO stack of objects.
+#define KMEM_CPU_CACHE_CAPACITY 7u
+#define KMEM_CPU_CACHE_BATCH_SIZE 4u
+
+struct kmem_cpu_cache {
+    uint32_t count;
+    void* objects[KMEM_CPU_CACHE_CAPACITY];
+} __attribute__ ((aligned(CACHE_LINE_SIZE)));
+
+struct slab;
+
+struct kmem_cache {
+    const char* name;
+    uint32_t object_size;
+    uint32_t stride; // distance between two consecutive objects in a slab
+    uint32_t free_link_offset; // where the free list link is stored inside a free object
+    uint32_t first_object_offset;
+    uint32_t objects_per_slab;
+    void (*ctor)(void* object);
+
+    struct kmem_cpu_cache* cpu_caches; // indexed by cpu id
+
+    struct spinlock lock; // protects everything below
+    struct slab* partial_slabs; // slabs with at least one free object
+    uint64_t number_of_empty_slabs; // slabs on `partial_slabs` with no objects in use
+    uint64_t number_of_slabs;
+};
+
+void slab_init(void);
+
+// `ctor` (if not NULL) is run once on every object when its slab is created, and objects must be returned to the cache in their constructed state.
+//  `align` of 0 means the natural alignment of `object_size`, capped at a cache line.
+struct kmem_cache* kmem_cache_create(const char* name, size_t object_size, size_t align, void (*ctor)(void* object));
+void* kmem_cache_alloc(struct kmem_cache* cache);
+void kmem_cache_free(struct kmem_cache* cache, void* object);
+
+void* kmalloc(size_t size);
+void kfree(void* object);
@@ -0,0 +1,180 @@
+#include "tlb_shootdown.h"
+
+#include <kernel/interrupts/idt.h>
+#include <kernel/interrupts/apic/apic.h>
+
+struct tlb_shootdown_request {
+    const struct address_space* address_space;
+    uint16_t pcid; // the PCID of `address_space` when the shootdown was sent
+    const struct tlb_flush_batch* batch;
+    volatile uint32_t pending_acks;
+};
+
+struct tlb_shootdown_cpu_state {
+    struct tlb_shootdown_request *volatile request;
+    volatile bool lazy;
+    volatile bool deferred_flush;
+    struct tlb_shootdown_stats stats; // only written by the owning CPU
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct tlb_shootdown_cpu_state tlb_shootdown_cpu_states[MAX_CPUS];
+
+// NOTE: Only one shootdown is in flight at a time, so a single request slot per CPU is enough.
+static struct spinlock tlb_shootdown_lock = SPINLOCK_INIT;
+
+void tlb_flush_local(const struct tlb_flush_batch *const batch) {
+    struct tlb_shootdown_stats *const stats = &tlb_shootdown_cpu_states[current_cpu_id()].stats;
+
+    if(!batch->flush_everything) {
+        for(uint32_t i = 0u; i < batch->count; ++i) {
+            flush_page_tlb_entry(batch->virt_addrs[i]);
+        }
+        stats->pages_flushed += batch->count;
+    } else {
+        if(batch->includes_global_pages) {
+            flush_all_tlb_entries_including_global();
+        } else {
+            reload_cr3(read_cr3());
+        }
+        ++stats->full_flushes;
+    }
+}
+
+static void handle_pending_shootdown(void) {
+    struct tlb_shootdown_cpu_state *const state = &tlb_shootdown_cpu_states[current_cpu_id()];
+    struct tlb_shootdown_request *const request = __atomic_load_n(&state->request, __ATOMIC_ACQUIRE);
+    if(request == NULL) {
+        return;
+    }
+    ++state->stats.ipis_received;
+
+    if(request->address_space == &kernel_address_space || vm_current_address_space() == request->address_space) {
+        tlb_flush_local(request->batch);
+    } else {
+        // switched away after being picked as a target, but the entries can still be cached under the old PCID
+        vm_flush_pcid_local(request->pcid);
+    }
+
+    __atomic_store_n(&state->request, NULL, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&request->pending_acks, 1u, __ATOMIC_RELEASE);
+}
+
+static void tlb_shootdown_interrupt(struct interrupt_frame *const frame) {
+    (void)frame;
+    handle_pending_shootdown();
+}
+
+void tlb_shootdown_init(void) {
+    idt_register_handler(TLB_SHOOTDOWN_VECTOR, tlb_shootdown_interrupt);
+}
+
+void tlb_shootdown(const struct address_space *const address_space, const uint16_t pcid, const struct tlb_flush_batch *const batch, uint64_t target_cpus) {
+    const uint32_t cpu = current_cpu_id();
+    target_cpus &= __atomic_load_n(&online_cpus_mask, __ATOMIC_ACQUIRE) & ~(1ULL << cpu);
+    if(target_cpus == 0u) {
+        return;
+    }
+
+    const uint64_t rflags = interrupts_save_and_disable();
+    while(!spin_trylock(&tlb_shootdown_lock)) {
+        handle_pending_shootdown();
+        cpu_relax();
+    }
+
+    struct tlb_shootdown_stats *const stats = &tlb_shootdown_cpu_states[cpu].stats;
+    const bool can_defer = address_space != &kernel_address_space && !batch->includes_global_pages;
+
+    uint64_t ipi_targets = 0u;
+    for(uint64_t remaining = target_cpus; remaining != 0u; remaining &= remaining - 1u) {
+        const uint32_t target = (uint32_t)__builtin_ctzll(remaining);
+        struct tlb_shootdown_cpu_state *const target_state = &tlb_shootdown_cpu_states[target];
+
+        if(can_defer && __atomic_load_n(&target_state->lazy, __ATOMIC_SEQ_CST)) {
+            __atomic_store_n(&target_state->deferred_flush, true, __ATOMIC_SEQ_CST);
+            // The target might have left lazy TLB mode before it could see the deferred flush, in which case it still needs the IPI.
+            //  This pairs with the store to `lazy` followed by the load of `deferred_flush` in `tlb_leave_lazy_mode()`.
+            if(__atomic_load_n(&target_state->lazy, __ATOMIC_SEQ_CST)) {
+                ++stats->deferred_flushes;
+                continue;
+            }
+        }
+        ipi_targets |= 1ULL << target;
+    }
+
+    if(ipi_targets != 0u) {
+        struct tlb_shootdown_request request = { address_space, pcid, batch, popcount64(ipi_targets) };
+
+        const uint64_t start = rdtsc();
+        for(uint64_t remaining = ipi_targets; remaining != 0u; remaining &= remaining - 1u) {
+            const uint32_t target = (uint32_t)__builtin_ctzll(remaining);
+            __atomic_store_n(&tlb_shootdown_cpu_states[target].request, &request, __ATOMIC_RELEASE);
+            x2apic_send_ipi(cpu_apic_ids[target], TLB_SHOOTDOWN_VECTOR);
+        }
+        while(__atomic_load_n(&request.pending_acks, __ATOMIC_ACQUIRE) != 0u) {
+            handle_pending_shootdown();
+            cpu_relax();
+        }
+        const uint64_t latency = rdtsc() - start;
+
+        ++stats->shootdowns_sent;
+        stats->ipis_sent += popcount64(ipi_targets);
+        stats->total_ipi_latency_ticks += latency;
+        stats->max_ipi_latency_ticks = max(stats->max_ipi_latency_ticks, latency);
+    }
+
+    spin_unlock(&tlb_shootdown_lock);
+    interrupts_restore(rflags);
+}
+
+void tlb_enter_lazy_mode(void) {
+    __atomic_store_n(&tlb_shootdown_cpu_states[current_cpu_id()].lazy, true, __ATOMIC_SEQ_CST);
+}
+
+void tlb_leave_lazy_mode(void) {
+    struct tlb_shootdown_cpu_state *const state = &tlb_shootdown_cpu_states[current_cpu_id()];
+    if(!state->lazy) {
+        return;
+    }
+
+    __atomic_store_n(&state->lazy, false, __ATOMIC_SEQ_CST);
+    if(__atomic_exchange_n(&state->deferred_flush, false, __ATOMIC_SEQ_CST)) {
+        // NOTE: The deferred flushes might belong to any address space this CPU has used, so every PCID gets flushed.
+        vm_flush_all_address_spaces_local();
+        ++state->stats.full_flushes;
+    }
+}
+
+struct tlb_shootdown_stats tlb_shootdown_get_stats(const uint32_t cpu_id) {
+    kassert(cpu_id < MAX_CPUS, "CPU id is out of bounds.");
+    return tlb_shootdown_cpu_states[cpu_id].stats;
+}
+
+void tlb_shootdown_print_stats(void) {
+    char str_buf[32];
+
+    serial_writestring("TLB shootdown stats:\n");
+    for(uint32_t cpu_id = 0u; cpu_id < MAX_CPUS; ++cpu_id) {
+        const struct tlb_shootdown_stats stats = tlb_shootdown_cpu_states[cpu_id].stats;
+        if(!(online_cpus_mask & (1ULL << cpu_id))) continue;
+
+        serial_writestring("cpu ");
+        serial_writestring(print_digits(cpu_id, str_buf));
+        serial_writestring(": shootdowns sent: ");
+        serial_writestring(print_digits(stats.shootdowns_sent, str_buf));
+        serial_writestring(", IPIs sent: ");
+        serial_writestring(print_digits(stats.ipis_sent, str_buf));
+        serial_writestring(", IPIs received: ");
+        serial_writestring(print_digits(stats.ipis_received, str_buf));
+        serial_writestring(", deferred: ");
+        serial_writestring(print_digits(stats.deferred_flushes, str_buf));
+        serial_writestring(", pages flushed: ");
+        serial_writestring(print_digits(stats.pages_flushed, str_buf));
+        serial_writestring(", full flushes: ");
+        serial_writestring(print_digits(stats.full_flushes, str_buf));
+        serial_writestring(", avg IPI latency: ");
+        serial_writestring(print_digits(stats.shootdowns_sent != 0u ? stats.total_ipi_latency_ticks/stats.shootdowns_sent : 0u, str_buf));
+        serial_writestring(" ticks, max IPI latency: ");
+        serial_writestring(print_digits(stats.max_ipi_latency_ticks, str_buf));
+        serial_writestring(" ticks\n");
+    }
+}
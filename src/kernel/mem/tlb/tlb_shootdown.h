@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <kernel/cpu/percpu.h>
+#include <kernel/mem/map_mem.h>
+
+// Page table changes are invalidated on other CPUs by sending them a `TLB_SHOOTDOWN_VECTOR` IPI and waiting until each of them has flushed.
+//  Only CPUs that have the address space loaded get an IPI (every online CPU for the kernel half), and a whole `tlb_flush_batch` goes out as one shootdown.
+//  A CPU in lazy TLB mode (e.g. idling) still has the last address space loaded, but does not touch its user mappings.
+//  Instead of an IPI it gets a deferred flush, which it does when it leaves lazy TLB mode.
+
+struct tlb_shootdown_stats {
+    uint64_t shootdowns_sent;
+    uint64_t ipis_sent;
+    uint64_t ipis_received;
+    uint64_t deferred_flushes; // IPIs that were skipped because the target was in lazy TLB mode
+    uint64_t pages_flushed; // pages flushed one by one, both locally and on behalf of other CPUs
+    uint64_t full_flushes;
+    uint64_t total_ipi_latency_ticks; // from sending the first IPI of a shootdown until the last CPU acknowledged it
+    uint64_t max_ipi_latency_ticks;
+};
+
+void tlb_shootdown_init(void);
+
+// flushes the current CPU (and counts it in the stats)
+void tlb_flush_local(const struct tlb_flush_batch* batch);
+
+// Blocks until every CPU in `target_cpus` (except the current one) has flushed `batch`.
+//  NOTE: While waiting, the current CPU keeps answering shootdowns sent to it, so two CPUs can shoot each other down even with interrupts disabled.
+void tlb_shootdown(const struct address_space* address_space, uint16_t pcid, const struct tlb_flush_batch* batch, uint64_t target_cpus);
+
+void tlb_enter_lazy_mode(void);
+// Does the deferred flush if there is one. Must be called with interrupts disabled.
+void tlb_leave_lazy_mode(void);
+
+struct tlb_shootdown_stats tlb_shootdown_get_stats(uint32_t cpu_id);
+void tlb_shootdown_print_stats(void);
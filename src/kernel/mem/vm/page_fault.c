@@ -0,0 +1,53 @@
+#include "page_fault.h"
+
+#include <kernel/mem/phys/phys_mem_allocator.h>
+
+#include "vm_region.h"
+
+static struct page_fault_stats page_fault_stats;
+
+static void count_fault(uint64_t *const counter) {
+    __atomic_add_fetch(counter, 1u, __ATOMIC_RELAXED);
+}
+
+// NOTE: Not-present entries are never cached in the TLB, so a fault that lost a race against another CPU mapping the same page
+//  can simply return and let the access retry. The CPU already dropped the stale entry that caused the fault.
+bool handle_page_fault(const uint64_t fault_addr, const uint64_t error_code) {
+    struct address_space *const address_space = (fault_addr >> 63) ? &kernel_address_space : vm_current_address_space();
+    const uint64_t page = round_down_to_page(fault_addr);
+    const bool is_write = (error_code & PAGE_FAULT_WRITE) != 0u;
+    const bool is_present = (error_code & PAGE_FAULT_PRESENT) != 0u;
+
+    struct vm_region region;
+    if((error_code & PAGE_FAULT_RESERVED_BIT) || !vm_region_find(address_space, fault_addr, &region)) {
+        count_fault(&page_fault_stats.bad_faults);
+        return false;
+    }
+
+    const bool is_allowed = (!(error_code & PAGE_FAULT_USER) || (region.flags & VM_USER)) &&
+                            (!is_write || (region.flags & VM_WRITEABLE)) &&
+                            (!(error_code & PAGE_FAULT_INSTRUCTION_FETCH) || (region.flags & VM_EXECUTABLE));
+    // a present page only faults on a write to the read-only zero page, anything else is a real protection violation
+    if(!is_allowed || (is_present && !is_write)) {
+        count_fault(&page_fault_stats.bad_faults);
+        return false;
+    }
+
+    if(!is_write) {
+        map_page_replacing(address_space, page, zero_page_phys_addr(), region.flags & ~VM_WRITEABLE, VM_NO_REPLACEABLE_PAGE);
+        count_fault(&page_fault_stats.zero_page_faults);
+        return true;
+    }
+
+    const uint64_t frame = phys_mem_allocate_page();
+    memset((void*)GENERAL_MEM_P2V(frame), 0, NORMAL_PAGE_SIZE);
+    if(!map_page_replacing(address_space, page, frame, region.flags, zero_page_phys_addr())) {
+        phys_mem_free_page(frame); // another CPU already gave the page its own frame
+    }
+    count_fault(&page_fault_stats.demand_zero_faults);
+    return true;
+}
+
+struct page_fault_stats page_fault_get_stats(void) {
+    return page_fault_stats;
+}
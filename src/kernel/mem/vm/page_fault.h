@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// bits of the error code that the CPU pushes for a #PF
+#define PAGE_FAULT_PRESENT (1u << 0) // the page was present, so this is a protection violation
+#define PAGE_FAULT_WRITE (1u << 1)
+#define PAGE_FAULT_USER (1u << 2)
+#define PAGE_FAULT_RESERVED_BIT (1u << 3)
+#define PAGE_FAULT_INSTRUCTION_FETCH (1u << 4)
+
+struct page_fault_stats {
+    uint64_t zero_page_faults; // reads that mapped the shared zero page
+    uint64_t demand_zero_faults; // writes that got a freshly zeroed frame
+    uint64_t bad_faults; // faults outside of any region or against its permissions
+};
+
+static inline uint64_t read_cr2(void) {
+    uint64_t cr2;
+    asm volatile("movq %%cr2, %0" : "=r" (cr2));
+    return cr2;
+}
+
+// Returns false if the fault is not a demand-zero fault in a region, in which case it is a real error.
+bool handle_page_fault(uint64_t fault_addr, uint64_t error_code);
+
+struct page_fault_stats page_fault_get_stats(void);
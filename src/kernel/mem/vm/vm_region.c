@@ -0,0 +1,166 @@
+#include "vm_region.h"
+
+#include <kernel/mem/phys/phys_mem_allocator.h>
+#include <kernel/mem/slab/slab.h>
+
+// Kernel regions get the second to last top level entry (`KERNEL_REGIONS_TOP_LEVEL_INDEX`), right below the kernel image.
+//  The direct map is capped so that it ends right before it.
+#define KERNEL_REGION_GUARD_SIZE NORMAL_PAGE_SIZE // left unmapped between kernel regions, so running off the end of one faults
+
+// destroying a region frees its frames in chunks, so that the TLB flush for a whole chunk is done before any of them is reused
+#define VM_REGION_DESTROY_CHUNK_PAGES 64u
+
+static struct kmem_cache* vm_region_cache;
+static uint64_t zero_page;
+
+static struct spinlock kernel_regions_lock = SPINLOCK_INIT;
+static uint64_t next_kernel_region_addr;
+static uint64_t kernel_regions_end;
+
+// the sign extended virtual address that a top level entry starts at
+static uint64_t top_level_entry_virt_addr(const uint32_t index) {
+    const uint32_t shift = 12u + 9u*(paging_levels - 1u);
+    uint64_t virt_addr = (uint64_t)index << shift;
+    if(index >= 256u) {
+        virt_addr |= ~0ULL << (shift + 9u);
+    }
+    return virt_addr;
+}
+
+void vm_region_init(void) {
+    vm_region_cache = kmem_cache_create("vm_region", sizeof(struct vm_region), 0u, NULL);
+
+    zero_page = phys_mem_allocate_page();
+    memset((void*)GENERAL_MEM_P2V(zero_page), 0, NORMAL_PAGE_SIZE);
+
+    next_kernel_region_addr = top_level_entry_virt_addr(KERNEL_REGIONS_TOP_LEVEL_INDEX);
+    kernel_regions_end = top_level_entry_virt_addr(KERNEL_REGIONS_TOP_LEVEL_INDEX + 1u);
+}
+
+uint64_t zero_page_phys_addr(void) {
+    return zero_page;
+}
+
+bool vm_region_create(struct address_space *const address_space, const uint64_t start, const uint64_t size, const uint32_t flags) {
+    kassert(offset_in_page(start) == 0u && offset_in_page(size) == 0u && size != 0u, "VM regions must be page aligned and non-empty.");
+
+    struct vm_region *const new_region = kmem_cache_alloc(vm_region_cache);
+    new_region->start = start;
+    new_region->end = start + size;
+    new_region->flags = flags;
+
+    const uint64_t rflags = spin_lock_irqsave(&address_space->regions_lock);
+
+    struct vm_region** link = &address_space->regions;
+    while(*link != NULL && (*link)->end <= start) {
+        link = &(*link)->next;
+    }
+    const bool overlaps = *link != NULL && (*link)->start < new_region->end;
+    if(!overlaps) {
+        new_region->next = *link;
+        *link = new_region;
+    }
+
+    spin_unlock_irqrestore(&address_space->regions_lock, rflags);
+
+    if(overlaps) {
+        kmem_cache_free(vm_region_cache, new_region);
+    }
+    return !overlaps;
+}
+
+static void free_frames(const uint64_t *const frames, const uint32_t count) {
+    for(uint32_t i = 0u; i < count; ++i) {
+        phys_mem_free_page(frames[i]);
+    }
+}
+
+void vm_region_destroy(struct address_space *const address_space, const uint64_t start) {
+    const uint64_t rflags = spin_lock_irqsave(&address_space->regions_lock);
+
+    struct vm_region** link = &address_space->regions;
+    while(*link != NULL && (*link)->start != start) {
+        link = &(*link)->next;
+    }
+    struct vm_region *const region = *link;
+    kassert(region != NULL, "Destroying a VM region that does not exist.");
+    *link = region->next;
+
+    spin_unlock_irqrestore(&address_space->regions_lock, rflags);
+
+    // the pages were all mapped one by one by faults, so every present page is a 4KiB page that is either the zero page or its own frame
+    uint64_t frames[VM_REGION_DESTROY_CHUNK_PAGES];
+    uint32_t number_of_frames = 0u;
+    struct tlb_flush_batch batch = { 0 };
+
+    for(uint64_t virt_addr = region->start; virt_addr < region->end; virt_addr += NORMAL_PAGE_SIZE) {
+        uint64_t phys_addr;
+        if(!virt_to_phys(address_space, virt_addr, &phys_addr)) continue;
+
+        unmap_range_deferred(address_space, virt_addr, NORMAL_PAGE_SIZE, &batch);
+        if(phys_addr != zero_page) {
+            frames[number_of_frames++] = phys_addr;
+        }
+
+        if(number_of_frames == VM_REGION_DESTROY_CHUNK_PAGES) {
+            tlb_flush_batch_finish(address_space, &batch);
+            free_frames(frames, number_of_frames);
+            number_of_frames = 0u;
+        }
+    }
+    tlb_flush_batch_finish(address_space, &batch);
+    free_frames(frames, number_of_frames);
+
+    kmem_cache_free(vm_region_cache, region);
+}
+
+// returns 0 if the window is used up
+static uint64_t reserve_kernel_window_range(const uint64_t rounded_size) {
+    const uint64_t rflags = spin_lock_irqsave(&kernel_regions_lock);
+    const uint64_t start = next_kernel_region_addr;
+    const bool fits = rounded_size != 0u && rounded_size <= kernel_regions_end - start - KERNEL_REGION_GUARD_SIZE;
+    if(fits) {
+        next_kernel_region_addr += rounded_size + KERNEL_REGION_GUARD_SIZE;
+    }
+    spin_unlock_irqrestore(&kernel_regions_lock, rflags);
+
+    return fits ? start : 0u;
+}
+
+void* vm_region_create_kernel(const uint64_t size, const uint32_t flags) {
+    const uint64_t rounded_size = round_up_to_page(size);
+    const uint64_t start = reserve_kernel_window_range(rounded_size);
+
+    if(start == 0u || !vm_region_create(&kernel_address_space, start, rounded_size, flags)) {
+        return NULL;
+    }
+    return (void*)start;
+}
+
+void* vm_map_mmio(const uint64_t phys_addr, const uint64_t size, const uint32_t flags) {
+    const uint64_t first_page = round_down_to_page(phys_addr);
+    const uint64_t rounded_size = round_up_to_page(phys_addr + size) - first_page;
+    const uint64_t start = reserve_kernel_window_range(rounded_size);
+    if(start == 0u) {
+        return NULL;
+    }
+
+    map_range(&kernel_address_space, start, first_page, rounded_size, flags | VM_GLOBAL);
+    return (void*)(start + (phys_addr - first_page));
+}
+
+bool vm_region_find(struct address_space *const address_space, const uint64_t virt_addr, struct vm_region *const region) {
+    bool found = false;
+
+    const uint64_t rflags = spin_lock_irqsave(&address_space->regions_lock);
+    for(const struct vm_region* current = address_space->regions; current != NULL && current->start <= virt_addr; current = current->next) {
+        if(virt_addr < current->end) {
+            *region = *current;
+            found = true;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&address_space->regions_lock, rflags);
+
+    return found;
+}
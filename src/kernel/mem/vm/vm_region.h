@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <kernel/mem/map_mem.h>
+
+// A region reserves a page aligned range of an address space for anonymous memory, but nothing gets mapped up front.
+//  The first read of a page maps the shared zero page read-only and the first write gives it its own zeroed frame,
+//  so a region only costs memory in proportion to the pages that were actually touched.
+struct vm_region {
+    uint64_t start;
+    uint64_t end; // exclusive
+    uint32_t flags; // `VM_*` flags the pages get once they are written to
+    struct vm_region* next;
+};
+
+// must be called after `vm_init()` and `slab_init()`
+void vm_region_init(void);
+
+uint64_t zero_page_phys_addr(void);
+
+// returns false if the range overlaps an existing region
+bool vm_region_create(struct address_space* address_space, uint64_t start, uint64_t size, uint32_t flags);
+// Unmaps the region that starts at `start` and frees every frame it got from write faults.
+//  NOTE: Nothing may still be using the region, since a fault that races with the destroy could map a page after it is gone.
+void vm_region_destroy(struct address_space* address_space, uint64_t start);
+
+// Reserves a range of the kernel half for a region in `kernel_address_space`, for big and sparsely used kernel tables.
+//  Returns NULL if the window for these is used up. The virtual range is never reused.
+void* vm_region_create_kernel(uint64_t size, uint32_t flags);
+// Maps device memory (which the direct map only covers if it is below the end of RAM) into the same window.
+//  `flags` should include `VM_UNCACHED` for registers. Returns NULL if the window is used up.
+void* vm_map_mmio(uint64_t phys_addr, uint64_t size, uint32_t flags);
+
+// copies the region out so that it can be used without holding the region lock, returns false if `virt_addr` is not in any region
+bool vm_region_find(struct address_space* address_space, uint64_t virt_addr, struct vm_region* region);
+
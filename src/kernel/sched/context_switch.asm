@@ -0,0 +1,33 @@
+; Switching threads only has to save the callee-saved registers: `context_switch()` is an ordinary call, so the compiler
+;  already saved everything else. Interrupts are disabled around every switch, so RFLAGS doesn't change either.
+
+extern thread_start
+
+section .text
+
+; void context_switch(uint64_t* previous_saved_rsp, uint64_t next_saved_rsp)
+global context_switch
+context_switch:
+    push rbp
+    push rbx
+    push r12
+    push r13
+    push r14
+    push r15
+    mov [rdi], rsp
+
+    mov rsp, rsi
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbx
+    pop rbp
+    ret
+
+; A new thread's first switch "returns" here, with its `struct thread*` in r12 and the stack 16-byte aligned (see `thread_create()`).
+global thread_entry_trampoline
+thread_entry_trampoline:
+    mov rdi, r12
+    call thread_start ; never returns
+    ud2
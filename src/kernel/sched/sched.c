@@ -0,0 +1,439 @@
+#include "sched.h"
+
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/percpu.h>
+#include <kernel/error/error.h>
+#include <kernel/interrupts/idt.h>
+#include <kernel/interrupts/apic/apic.h>
+#include <kernel/mem/mem_constants.h>
+#include <kernel/mem/phys/phys_mem_allocator.h>
+#include <kernel/mem/slab/slab.h>
+#include <kernel/mem/tlb/tlb_shootdown.h>
+#include <kernel/sched/work_deque.h>
+#include <kernel/time/clocksource.h>
+#include <kernel/time/timer.h>
+#include <kernel/trace/trace.h>
+
+// NOTE: Everything in here runs with interrupts disabled. A thread can only be preempted by an interrupt, so that also
+//  keeps it on its CPU, which is what makes `current_cpu_id()` and the per-CPU state below stable.
+
+struct sched_cpu {
+    struct work_deque run_queue;
+    // Threads woken onto this CPU by other CPUs. It is a stack that anyone can push onto, and only the owner empties it
+    //  (into `run_queue`), since only the owner may push onto its own deque.
+    struct thread* volatile inbox;
+    struct thread* current;
+    struct thread* idle;
+    struct thread* previous; // what `context_switch()` just switched away from, for `finish_switch()`
+    bool requeue_previous; // `previous` was preempted or yielded, so `finish_switch()` queues it again
+    struct timer slice_timer;
+    uint32_t next_victim; // where the next steal starts looking, so that thieves spread out instead of all hitting the same CPU
+    struct sched_stats stats; // only written by the owning CPU
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct sched_cpu sched_cpus[MAX_CPUS];
+
+// bit `i` is set while CPU `i` is halted in its idle loop
+static volatile uint64_t idle_cpus_mask;
+
+extern void context_switch(uint64_t* previous_saved_rsp, uint64_t next_saved_rsp);
+extern const char thread_entry_trampoline[];
+
+__attribute__((noreturn)) void thread_start(struct thread* thread);
+
+static struct thread* allocate_thread(const char *const name, const thread_function function, void *const arg) {
+    struct thread *const thread = (struct thread*) kmalloc(sizeof(struct thread));
+    kassert(thread != NULL, "Out of memory for threads.");
+    thread->saved_rsp = 0u;
+    thread->on_cpu = 0u;
+    thread->state = THREAD_RUNNABLE;
+    thread->unpark_token = 0u;
+    thread->last_cpu = current_cpu_id();
+    thread->inbox_next = NULL;
+    thread->stack_bottom = 0u;
+    thread->function = function;
+    thread->arg = arg;
+    thread->name = name;
+    return thread;
+}
+
+static struct thread* new_thread(const char *const name, const thread_function function, void *const arg) {
+    struct thread *const thread = allocate_thread(name, function, arg);
+    thread->stack_bottom = GENERAL_MEM_P2V(phys_mem_allocate_pages(THREAD_STACK_ORDER));
+    const uint64_t stack_top = thread->stack_bottom + (NORMAL_PAGE_SIZE << THREAD_STACK_ORDER);
+
+    // What `context_switch()` pops: r15, r14, r13, r12, rbx, rbp and the return address.
+    //  Once the trampoline is "returned" to, the stack is 16 bytes below the top, which is aligned for its call.
+    uint64_t *const frame = (uint64_t*)(stack_top - 9u*sizeof(uint64_t));
+    for(uint32_t i = 0u; i < 6u; ++i) {
+        frame[i] = 0u;
+    }
+    frame[3] = (uint64_t)thread; // r12
+    frame[6] = (uint64_t)thread_entry_trampoline;
+    thread->saved_rsp = (uint64_t)frame;
+    return thread;
+}
+
+// turns whatever is running on the current CPU (a boot stack) into a thread
+static struct thread* adopt_current_context(const char *const name) {
+    struct thread *const thread = allocate_thread(name, NULL, NULL);
+    thread->on_cpu = 1u;
+    thread->state = THREAD_RUNNING;
+    return thread;
+}
+
+static void free_thread(struct thread *const thread) {
+    if(thread->stack_bottom != 0u) {
+        phys_mem_free_pages(GENERAL_MEM_V2P(thread->stack_bottom), THREAD_STACK_ORDER);
+    }
+    kfree(thread);
+}
+
+// Wakes one idle CPU, so that it can steal the work that was just queued here.
+//  Its idle bit is cleared right away, which keeps a burst of new threads from sending it one IPI each.
+static void kick_idle_cpu(const uint32_t cpu_id) {
+    // pairs with the idle loop setting its bit before looking at the queues one last time
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    const uint64_t idle_cpus = __atomic_load_n(&idle_cpus_mask, __ATOMIC_RELAXED) & ~(1ULL << cpu_id);
+    if(idle_cpus == 0u) {
+        return;
+    }
+    const uint32_t target = (uint32_t)__builtin_ctzll(idle_cpus);
+    if(__atomic_fetch_and(&idle_cpus_mask, ~(1ULL << target), __ATOMIC_SEQ_CST) & (1ULL << target)) {
+        x2apic_send_ipi(cpu_apic_ids[target], RESCHEDULE_VECTOR);
+    }
+}
+
+static void enqueue_local(struct sched_cpu *const cpu, struct thread *const thread) {
+    kassert(work_deque_push(&cpu->run_queue, thread), "The run queue is full.");
+    kick_idle_cpu(current_cpu_id());
+}
+
+static void drain_inbox(struct sched_cpu *const cpu) {
+    if(__atomic_load_n(&cpu->inbox, __ATOMIC_RELAXED) == NULL) {
+        return;
+    }
+
+    // the inbox is a stack, so it gets reversed to queue the threads in the order they were woken
+    struct thread* woken = __atomic_exchange_n(&cpu->inbox, NULL, __ATOMIC_ACQUIRE);
+    struct thread* in_order = NULL;
+    while(woken != NULL) {
+        struct thread *const next = woken->inbox_next;
+        woken->inbox_next = in_order;
+        in_order = woken;
+        woken = next;
+    }
+    while(in_order != NULL) {
+        // NOTE: The link is read first, since a queued thread can be stolen, run and woken into another inbox right away.
+        struct thread *const next = in_order->inbox_next;
+        kassert(work_deque_push(&cpu->run_queue, in_order), "The run queue is full.");
+        in_order = next;
+    }
+}
+
+static struct thread* steal_thread(struct sched_cpu *const cpu) {
+    const uint32_t cpu_id = current_cpu_id();
+    const uint64_t victims = __atomic_load_n(&online_cpus_mask, __ATOMIC_ACQUIRE) & ~(1ULL << cpu_id);
+    if(victims == 0u) {
+        return NULL;
+    }
+
+    for(uint32_t i = 0u; i < MAX_CPUS; ++i) {
+        const uint32_t victim = (cpu->next_victim + i) % MAX_CPUS;
+        if(!(victims & (1ULL << victim))) {
+            continue;
+        }
+        struct thread *const thread = work_deque_take(&sched_cpus[victim].run_queue);
+        if(thread != NULL) {
+            cpu->next_victim = victim + 1u;
+            ++cpu->stats.steals;
+            return thread;
+        }
+    }
+    return NULL;
+}
+
+static struct thread* pick_next_thread(struct sched_cpu *const cpu) {
+    drain_inbox(cpu);
+    while(!work_deque_is_empty(&cpu->run_queue)) {
+        struct thread *const thread = work_deque_take(&cpu->run_queue);
+        if(thread != NULL) {
+            return thread;
+        }
+    }
+    return steal_thread(cpu);
+}
+
+static void restart_time_slice(struct sched_cpu *const cpu) {
+    this_cpu()->need_resched = false;
+    timer_cancel(&cpu->slice_timer);
+    timer_add(&cpu->slice_timer, ktime_get() + SCHED_TIME_SLICE_NS);
+}
+
+// Runs on the thread that was just switched to, right after `context_switch()`.
+//  A preempted thread is only queued again here, once its context is saved, so that no CPU can pick it while it is still switching away.
+//  Waiting for that in `switch_to()` instead could deadlock, e.g. two CPUs that each picked the thread the other one is switching away from.
+static void finish_switch(void) {
+    // NOTE: This can be a different CPU than the one the thread switched out on, so the state is looked up again.
+    struct sched_cpu *const cpu = &sched_cpus[current_cpu_id()];
+    struct thread *const previous = cpu->previous;
+    if(previous->state == THREAD_DEAD) {
+        free_thread(previous);
+        return;
+    }
+    __atomic_store_n(&previous->on_cpu, 0u, __ATOMIC_RELEASE);
+    if(cpu->requeue_previous) {
+        enqueue_local(cpu, previous);
+    }
+}
+
+static void switch_to(struct sched_cpu *const cpu, struct thread *const previous, struct thread *const next, const bool requeue_previous) {
+    // only threads that are done switching away are ever queued (see `finish_switch()` and `thread_unpark()`)
+    kassert(__atomic_load_n(&next->on_cpu, __ATOMIC_ACQUIRE) == 0u, "A thread was picked while it was still running.");
+    next->on_cpu = 1u;
+    next->state = THREAD_RUNNING;
+    next->last_cpu = current_cpu_id();
+    cpu->current = next;
+    cpu->previous = previous;
+    cpu->requeue_previous = requeue_previous;
+    ++cpu->stats.context_switches;
+    TRACE(TRACE_CONTEXT_SWITCH, previous, next);
+
+    if(next != cpu->idle) {
+        restart_time_slice(cpu);
+    } else {
+        timer_cancel(&cpu->slice_timer);
+    }
+
+    context_switch(&previous->saved_rsp, next->saved_rsp);
+    finish_switch();
+}
+
+// Switches away from the current thread, which is queued again if it is still running (i.e. it yielded or was preempted).
+static void schedule(void) {
+    struct sched_cpu *const cpu = &sched_cpus[current_cpu_id()];
+    struct thread *const previous = cpu->current;
+    struct thread* next = pick_next_thread(cpu);
+
+    const bool still_runnable = previous->state == THREAD_RUNNING;
+    if(next == NULL) {
+        if(still_runnable) {
+            restart_time_slice(cpu);
+            return;
+        }
+        next = cpu->idle;
+    }
+    if(still_runnable) {
+        previous->state = THREAD_RUNNABLE;
+    }
+    switch_to(cpu, previous, next, still_runnable);
+}
+
+static __attribute__((noreturn)) void idle_loop(void) {
+    const uint32_t cpu_id = current_cpu_id(); // the idle thread never migrates
+    struct sched_cpu *const cpu = &sched_cpus[cpu_id];
+
+    for(;;) {
+        (void)interrupts_save_and_disable();
+        struct thread* next = pick_next_thread(cpu);
+        if(next == NULL) {
+            // The idle bit is set before the last look at the queues, so a CPU that queues a thread after that look sees it and sends an IPI.
+            __atomic_or_fetch(&idle_cpus_mask, 1ULL << cpu_id, __ATOMIC_SEQ_CST);
+            tlb_enter_lazy_mode();
+            next = pick_next_thread(cpu);
+            if(next == NULL) {
+                ++cpu->stats.idle_halts;
+                // an interrupt that comes in between the `sti` and the `hlt` still ends the `hlt`, since `sti` only takes effect after the next instruction
+                asm volatile("sti\n\thlt\n\tcli" ::: "memory");
+            }
+            __atomic_and_fetch(&idle_cpus_mask, ~(1ULL << cpu_id), __ATOMIC_SEQ_CST);
+            tlb_leave_lazy_mode();
+        }
+        if(next != NULL) {
+            switch_to(cpu, cpu->idle, next, false);
+        }
+    }
+}
+
+static void idle_thread_function(void *const arg) {
+    (void)arg;
+    idle_loop();
+}
+
+static void time_slice_expired(struct timer *const timer, void *const context) {
+    (void)context;
+    this_cpu()->need_resched = true;
+    // the interrupted thread holds a spinlock, so it can only be preempted once it dropped it
+    if(preempt_count() != 0u) {
+        timer_add(timer, ktime_get() + SCHED_PREEMPT_RETRY_NS);
+    }
+}
+
+static void reschedule_interrupt(struct interrupt_frame *const frame) {
+    (void)frame;
+}
+
+void thread_start(struct thread *const thread) {
+    finish_switch();
+    interrupts_enable();
+    thread->function(thread->arg);
+    thread_exit();
+}
+
+void sched_init(void) {
+    idt_register_handler(RESCHEDULE_VECTOR, reschedule_interrupt);
+    sched_init_cpu();
+
+    struct sched_cpu *const cpu = &sched_cpus[current_cpu_id()];
+    cpu->current = adopt_current_context("main");
+    cpu->idle = new_thread("idle", idle_thread_function, NULL);
+}
+
+void sched_init_cpu(void) {
+    const uint32_t cpu_id = current_cpu_id();
+    struct sched_cpu *const cpu = &sched_cpus[cpu_id];
+
+    struct thread **const run_queue_buffer = (struct thread**) GENERAL_MEM_P2V(phys_mem_allocate_pages(SCHED_RUN_QUEUE_ORDER));
+    work_deque_init(&cpu->run_queue, run_queue_buffer, (NORMAL_PAGE_SIZE << SCHED_RUN_QUEUE_ORDER) / sizeof(struct thread*));
+    cpu->inbox = NULL;
+    timer_setup(&cpu->slice_timer, time_slice_expired, NULL);
+    cpu->next_victim = cpu_id + 1u;
+}
+
+void sched_idle(void) {
+    (void)interrupts_save_and_disable();
+    struct sched_cpu *const cpu = &sched_cpus[current_cpu_id()];
+    cpu->idle = adopt_current_context("idle");
+    cpu->current = cpu->idle;
+    idle_loop();
+}
+
+struct thread* thread_create(const char *const name, const thread_function function, void *const arg) {
+    struct thread *const thread = new_thread(name, function, arg);
+
+    const uint64_t rflags = interrupts_save_and_disable();
+    enqueue_local(&sched_cpus[current_cpu_id()], thread);
+    interrupts_restore(rflags);
+    return thread;
+}
+
+struct thread* thread_current(void) {
+    const uint64_t rflags = interrupts_save_and_disable();
+    struct thread *const thread = sched_cpus[current_cpu_id()].current;
+    interrupts_restore(rflags);
+    return thread;
+}
+
+void thread_yield(void) {
+    const uint64_t rflags = interrupts_save_and_disable();
+    schedule();
+    interrupts_restore(rflags);
+}
+
+// NOTE: The state and the token together make a wakeup that races with `thread_park()` safe:
+//  either `thread_park()` sees the token and keeps running, or `thread_unpark()` sees the thread parked and queues it.
+//  If both happen, `thread_unpark()` waits for the thread to finish switching away before it queues it.
+void thread_park(void) {
+    const uint64_t rflags = interrupts_save_and_disable();
+    struct thread *const self = sched_cpus[current_cpu_id()].current;
+
+    __atomic_store_n(&self->state, THREAD_PARKED, __ATOMIC_SEQ_CST);
+    if(__atomic_exchange_n(&self->unpark_token, 0u, __ATOMIC_SEQ_CST) != 0u) {
+        uint32_t expected = THREAD_PARKED;
+        if(__atomic_compare_exchange_n(&self->state, &expected, THREAD_RUNNING, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            interrupts_restore(rflags);
+            return;
+        }
+        // otherwise `thread_unpark()` already queued this thread
+    }
+    schedule();
+    interrupts_restore(rflags);
+}
+
+void thread_unpark(struct thread *const thread) {
+    if(__atomic_exchange_n(&thread->unpark_token, 1u, __ATOMIC_SEQ_CST) != 0u) {
+        return; // an earlier unpark is still pending
+    }
+    uint32_t expected = THREAD_PARKED;
+    if(!__atomic_compare_exchange_n(&thread->state, &expected, THREAD_RUNNABLE, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return; // not parked (yet), so the token is left for `thread_park()`
+    }
+    __atomic_store_n(&thread->unpark_token, 0u, __ATOMIC_SEQ_CST);
+
+    // The thread can still be saving its context on the CPU it parked on. That CPU never waits for anything in between,
+    //  so this is short, and it keeps the thread out of every queue until any CPU can run it right away.
+    while(__atomic_load_n(&thread->on_cpu, __ATOMIC_ACQUIRE) != 0u) {
+        cpu_relax();
+    }
+
+    const uint64_t rflags = interrupts_save_and_disable();
+    const uint32_t cpu_id = current_cpu_id();
+    struct sched_cpu *const cpu = &sched_cpus[cpu_id];
+    const uint32_t target = thread->last_cpu;
+    // Only an idle CPU gets the thread back, since a busy one would make it wait while this CPU (or a thief) could run it now.
+    //  Clearing the idle bit claims the CPU, so no other waker sends it a second IPI.
+    if(target != cpu_id && (__atomic_fetch_and(&idle_cpus_mask, ~(1ULL << target), __ATOMIC_SEQ_CST) & (1ULL << target))) {
+        struct sched_cpu *const target_cpu = &sched_cpus[target];
+        struct thread* head = __atomic_load_n(&target_cpu->inbox, __ATOMIC_RELAXED);
+        do {
+            thread->inbox_next = head;
+        } while(!__atomic_compare_exchange_n(&target_cpu->inbox, &head, thread, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+        ++cpu->stats.remote_wakeups;
+        x2apic_send_ipi(cpu_apic_ids[target], RESCHEDULE_VECTOR);
+    } else {
+        enqueue_local(cpu, thread);
+    }
+    interrupts_restore(rflags);
+}
+
+void thread_exit(void) {
+    (void)interrupts_save_and_disable();
+    sched_cpus[current_cpu_id()].current->state = THREAD_DEAD;
+    schedule();
+    halt_and_die("A dead thread was scheduled again.");
+}
+
+void sched_preempt_if_needed(void) {
+    struct percpu *const percpu = this_cpu();
+    if(!percpu->need_resched || percpu->preempt_count != 0u) {
+        return;
+    }
+    percpu->need_resched = false;
+
+    struct sched_cpu *const cpu = &sched_cpus[percpu->cpu_id];
+    // the idle thread looks for work by itself once the interrupt returns
+    if(cpu->current == cpu->idle) {
+        return;
+    }
+    ++cpu->stats.preemptions;
+    schedule();
+}
+
+struct sched_stats sched_get_stats(const uint32_t cpu_id) {
+    kassert(cpu_id < MAX_CPUS, "CPU id is out of bounds.");
+    return sched_cpus[cpu_id].stats;
+}
+
+void sched_print_stats(void) {
+    char str_buf[32];
+
+    serial_writestring("Scheduler stats:\n");
+    for(uint32_t cpu_id = 0u; cpu_id < MAX_CPUS; ++cpu_id) {
+        const struct sched_stats stats = sched_cpus[cpu_id].stats;
+        if(!(online_cpus_mask & (1ULL << cpu_id))) continue;
+
+        serial_writestring("cpu ");
+        serial_writestring(print_digits(cpu_id, str_buf));
+        serial_writestring(": context switches: ");
+        serial_writestring(print_digits(stats.context_switches, str_buf));
+        serial_writestring(", preemptions: ");
+        serial_writestring(print_digits(stats.preemptions, str_buf));
+        serial_writestring(", steals: ");
+        serial_writestring(print_digits(stats.steals, str_buf));
+        serial_writestring(", remote wakeups: ");
+        serial_writestring(print_digits(stats.remote_wakeups, str_buf));
+        serial_writestring(", idle halts: ");
+        serial_writestring(print_digits(stats.idle_halts, str_buf));
+        serial_writestring("\n");
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Kernel threads with one run queue per CPU (see work_deque.h). A CPU runs the threads of its own queue round-robin,
+//  and once that is empty it steals from the queues of the other CPUs before going idle.
+//  A woken thread goes back to the CPU it last ran on if that CPU is idle (its caches likely still hold the thread's data), and otherwise
+//  to the waking CPU, from which an idle CPU can steal it.
+//  Threads are preempted by a per-CPU time slice timer on the TSC deadline, but only while they hold no spinlock.
+
+#define THREAD_STACK_ORDER 2u // 16KiB
+#define SCHED_TIME_SLICE_NS 4000000ULL
+// how soon the slice timer checks again when the thread held a spinlock as its slice ran out
+#define SCHED_PREEMPT_RETRY_NS 100000ULL
+#define SCHED_RUN_QUEUE_ORDER 3u // a 32KiB buffer, so 4096 threads per queue
+
+typedef void (*thread_function)(void* arg);
+
+enum thread_state {
+    THREAD_RUNNING,
+    THREAD_RUNNABLE, // in a run queue
+    THREAD_PARKED,
+    THREAD_DEAD,
+};
+
+struct thread {
+    uint64_t saved_rsp; // while the thread is switched out, see context_switch.asm
+    // Set from when a CPU picks the thread until that CPU has saved its context. A thread is only queued once this is
+    //  clear, so a CPU that picks it never has to wait for another one to finish switching away from it.
+    volatile uint32_t on_cpu;
+    volatile uint32_t state; // `enum thread_state`
+    volatile uint32_t unpark_token; // an unpark that came in before the thread parked, so that wakeups are never lost
+    uint32_t last_cpu;
+    struct thread* volatile inbox_next; // for the wakeup inbox of a remote CPU
+    uint64_t stack_bottom; // 0 if the stack is not owned by the thread (the boot stacks)
+    thread_function function;
+    void* arg;
+    const char* name;
+};
+
+struct sched_stats {
+    uint64_t context_switches;
+    uint64_t preemptions;
+    uint64_t steals; // threads this CPU took from the queue of another one
+    uint64_t remote_wakeups; // threads woken onto the idle CPU they last ran on
+    uint64_t idle_halts;
+};
+
+// Only called on the bootstrap processor, after `timer_init()` and before `smp_init()`. From here on `kernel_main()` runs as a thread.
+void sched_init(void);
+// Called on each application processor after `timer_init()` and before it is marked online.
+void sched_init_cpu(void);
+// The calling context becomes the idle thread of its CPU. Only called by the application processors once they are set up.
+__attribute__((noreturn)) void sched_idle(void);
+
+// The new thread is queued on the current CPU.
+struct thread* thread_create(const char* name, thread_function function, void* arg);
+struct thread* thread_current(void);
+void thread_yield(void);
+// Blocks until `thread_unpark()` is called on this thread. An unpark that comes first makes the next park return right away.
+void thread_park(void);
+void thread_unpark(struct thread* thread);
+__attribute__((noreturn)) void thread_exit(void);
+
+// Called by `irq_dispatch()` after the EOI, with interrupts disabled.
+void sched_preempt_if_needed(void);
+
+struct sched_stats sched_get_stats(uint32_t cpu_id);
+void sched_print_stats(void);
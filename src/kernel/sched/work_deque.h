@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <kernel/cpu/percpu.h>
+
+struct thread;
+
+// A lock-free run queue in the style of the Chase-Lev work-stealing deque: only the owning CPU pushes (at the bottom),
+//  while any CPU can take from the top with a single CAS.
+//  NOTE: Unlike the original, the owner also takes from the top instead of popping from the bottom.
+//  A preempted thread goes back in at the bottom, so popping there would keep running the same few threads and starve the rest;
+//  taking from the top makes every queue round-robin. The capacity is fixed, which is also what makes the steal below safe:
+//  the owner can't reuse the slot of `top` before the CAS that takes it succeeded.
+struct work_deque {
+    volatile int64_t top; // advanced by whoever takes a thread
+    uint8_t padding[CACHE_LINE_SIZE - sizeof(int64_t)]; // keeps the thieves off the owner's cache line
+    volatile int64_t bottom; // only written by the owner
+    struct thread** buffer;
+    uint64_t mask; // capacity - 1, the capacity is a power of 2
+};
+
+static inline void work_deque_init(struct work_deque *const deque, struct thread **const buffer, const uint64_t capacity) {
+    deque->top = 0;
+    deque->bottom = 0;
+    deque->buffer = buffer;
+    deque->mask = capacity - 1u;
+}
+
+// Owner only, with interrupts disabled. Returns false if the deque is full.
+static inline bool work_deque_push(struct work_deque *const deque, struct thread *const thread) {
+    const int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    const int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if((uint64_t)(bottom - top) > deque->mask) {
+        return false;
+    }
+    __atomic_store_n(&deque->buffer[(uint64_t)bottom & deque->mask], thread, __ATOMIC_RELAXED);
+    // publishes the slot before the new bottom makes it visible to a thief
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Any CPU. Returns NULL if the deque is empty or another CPU took the thread first.
+static inline struct thread* work_deque_take(struct work_deque *const deque) {
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    const int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if(top >= bottom) {
+        return NULL;
+    }
+    struct thread *const thread = __atomic_load_n(&deque->buffer[(uint64_t)top & deque->mask], __ATOMIC_RELAXED);
+    if(!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return thread;
+}
+
+static inline bool work_deque_is_empty(const struct work_deque *const deque) {
+    return __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE) >= __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/percpu.h>
+
+struct spinlock {
+    volatile uint32_t locked;
+};
+
+#define SPINLOCK_INIT { 0u }
+
+// NOTE: Holding a spinlock disables preemption (not interrupts), see `struct percpu`.
+static inline void spin_lock(struct spinlock *const lock) {
+    preempt_disable();
+    while(__atomic_exchange_n(&lock->locked, 1u, __ATOMIC_ACQUIRE) != 0u) {
+        // spin on a plain load so that waiting CPUs do not keep stealing the cache line from the owner
+        while(__atomic_load_n(&lock->locked, __ATOMIC_RELAXED) != 0u) {
+            cpu_relax();
+        }
+    }
+}
+
+static inline bool spin_trylock(struct spinlock *const lock) {
+    preempt_disable();
+    if(__atomic_load_n(&lock->locked, __ATOMIC_RELAXED) == 0u && __atomic_exchange_n(&lock->locked, 1u, __ATOMIC_ACQUIRE) == 0u) {
+        return true;
+    }
+    preempt_enable();
+    return false;
+}
+
+static inline void spin_unlock(struct spinlock *const lock) {
+    __atomic_store_n(&lock->locked, 0u, __ATOMIC_RELEASE);
+    preempt_enable();
+}
+
+static inline uint64_t spin_lock_irqsave(struct spinlock *const lock) {
+    const uint64_t rflags = interrupts_save_and_disable();
+    spin_lock(lock);
+    return rflags;
+}
+
+static inline void spin_unlock_irqrestore(struct spinlock *const lock, const uint64_t rflags) {
+    spin_unlock(lock);
+    interrupts_restore(rflags);
+}
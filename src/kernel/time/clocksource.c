@@ -0,0 +1,251 @@
+#include "clocksource.h"
+
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/cpu_features.h>
+#include <kernel/io/port_io.h>
+#include <kernel/mem/vm/vm_region.h>
+
+#define CPUID_LEAF_TSC_CRYSTAL 0x15U
+#define CPUID_LEAF_PROCESSOR_FREQUENCY 0x16U
+
+#define PM_TIMER_HZ 3579545ULL
+
+#define HPET_GENERAL_CAPABILITIES 0x000u
+#define HPET_GENERAL_CONFIGURATION 0x010u
+#define HPET_MAIN_COUNTER 0x0F0u
+#define HPET_REGISTERS_SIZE 0x400u
+#define HPET_CAPABILITIES_64_BIT_COUNTER (1ULL << 13)
+#define HPET_CONFIGURATION_ENABLE 1ULL
+#define HPET_MAX_PERIOD_FEMTOSECONDS 100000000ULL // the spec requires at least 10MHz
+#define FEMTOSECONDS_PER_SECOND 1000000000000000ULL
+
+#define CALIBRATION_ROUNDS 5u
+#define CALIBRATION_INTERVAL_NS 10000000ULL // 10ms per round, long enough to make a read's jitter negligible
+#define CALIBRATION_READ_ATTEMPTS 8u
+
+#define FIXED_POINT_SHIFT 32u
+
+static struct clocksource_info info;
+static uint64_t ns_per_tick_fixed; // 32.32
+static uint64_t ticks_per_ns_fixed; // 32.32
+static uint64_t boot_tsc;
+
+// A reference clock is a free running counter that wraps at `mask`.
+struct reference_clock {
+    uint64_t (*read)(void);
+    uint64_t hz;
+    uint64_t mask;
+};
+
+static uint16_t pm_timer_port;
+static volatile const uint32_t* pm_timer_mmio;
+static volatile uint64_t* hpet_registers;
+
+static uint64_t pm_timer_read(void) {
+    return (pm_timer_mmio != NULL) ? *pm_timer_mmio : inl(pm_timer_port);
+}
+
+static uint64_t hpet_read(void) {
+    return hpet_registers[HPET_MAIN_COUNTER / sizeof(uint64_t)];
+}
+
+static bool pm_timer_setup(const struct FADT *const FADT_virt_addr, struct reference_clock *const clock) {
+    // X_PM_TMR_BLK only exists since ACPI 2.0, and takes precedence over PM_TMR_BLK if it is set
+    const uint64_t x_pm_timer_end = __builtin_offsetof(struct FADT, X_PM_TMR_BLK) + sizeof(struct GAS);
+    const struct GAS *const x_pm_timer = (FADT_virt_addr->header.Length >= x_pm_timer_end) ? &FADT_virt_addr->X_PM_TMR_BLK : NULL;
+
+    if(x_pm_timer != NULL && x_pm_timer->Address != 0u && x_pm_timer->AddressSpaceID == GAS_SystemMemory) {
+        pm_timer_mmio = vm_map_mmio(x_pm_timer->Address, sizeof(uint32_t), VM_UNCACHED);
+        if(pm_timer_mmio == NULL) {
+            return false;
+        }
+    } else if(x_pm_timer != NULL && x_pm_timer->Address != 0u && x_pm_timer->AddressSpaceID == GAS_SystemIO) {
+        pm_timer_port = (uint16_t)x_pm_timer->Address;
+    } else if(FADT_virt_addr->PM_TMR_BLK != 0u && FADT_virt_addr->PM_TMR_LEN == sizeof(uint32_t)) {
+        pm_timer_port = (uint16_t)FADT_virt_addr->PM_TMR_BLK;
+    } else {
+        return false;
+    }
+
+    clock->read = pm_timer_read;
+    clock->hz = PM_TIMER_HZ;
+    clock->mask = (FADT_virt_addr->Flags & TMR_VAL_EXT) ? 0xFFFFFFFFULL : 0xFFFFFFULL;
+    return true;
+}
+
+static bool hpet_setup(const struct HPET *const HPET_virt_addr, struct reference_clock *const clock) {
+    if(HPET_virt_addr == NULL || HPET_virt_addr->BaseAddress.AddressSpaceID != GAS_SystemMemory) {
+        return false;
+    }
+
+    hpet_registers = vm_map_mmio(HPET_virt_addr->BaseAddress.Address, HPET_REGISTERS_SIZE, VM_WRITEABLE | VM_UNCACHED);
+    if(hpet_registers == NULL) {
+        return false;
+    }
+
+    const uint64_t capabilities = hpet_registers[HPET_GENERAL_CAPABILITIES / sizeof(uint64_t)];
+    const uint64_t period_femtoseconds = capabilities >> 32;
+    if(period_femtoseconds == 0u || period_femtoseconds > HPET_MAX_PERIOD_FEMTOSECONDS) {
+        return false;
+    }
+
+    // the main counter only runs while the HPET is enabled
+    hpet_registers[HPET_GENERAL_CONFIGURATION / sizeof(uint64_t)] |= HPET_CONFIGURATION_ENABLE;
+
+    clock->read = hpet_read;
+    clock->hz = FEMTOSECONDS_PER_SECOND / period_femtoseconds;
+    clock->mask = (capabilities & HPET_CAPABILITIES_64_BIT_COUNTER) ? UINT64_MAX : 0xFFFFFFFFULL;
+    return true;
+}
+
+// Reads the reference clock together with the TSC. The TSC is read right before and after, and the attempt with the smallest
+//  window between the two wins, since a slow read (an SMI, or a VM exit for an emulated timer) would skew the result.
+static uint64_t read_reference_with_tsc(const struct reference_clock *const clock, uint64_t *const tsc) {
+    uint64_t best_window = UINT64_MAX;
+    uint64_t best_reference = 0u;
+
+    for(uint32_t attempt = 0u; attempt < CALIBRATION_READ_ATTEMPTS; ++attempt) {
+        const uint64_t before = rdtsc_ordered();
+        const uint64_t reference = clock->read();
+        const uint64_t after = rdtsc_ordered();
+        if(after - before < best_window) {
+            best_window = after - before;
+            best_reference = reference;
+            *tsc = before + (after - before)/2u;
+        }
+    }
+
+    return best_reference;
+}
+
+static uint64_t calibrate_tsc(const struct reference_clock *const clock) {
+    const uint64_t interval_ticks = clock->hz * CALIBRATION_INTERVAL_NS / NANOSECONDS_PER_SECOND;
+    uint64_t results[CALIBRATION_ROUNDS];
+
+    for(uint32_t round = 0u; round < CALIBRATION_ROUNDS; ++round) {
+        uint64_t tsc_start, tsc_end;
+        const uint64_t reference_start = read_reference_with_tsc(clock, &tsc_start);
+        while(((clock->read() - reference_start) & clock->mask) < interval_ticks) {
+            cpu_relax();
+        }
+        const uint64_t reference_ticks = (read_reference_with_tsc(clock, &tsc_end) - reference_start) & clock->mask;
+
+        // NOTE: This can't overflow, since 10ms of TSC ticks times a reference frequency of even 1GHz is way below 2^64.
+        results[round] = (tsc_end - tsc_start) * clock->hz / reference_ticks;
+    }
+
+    // the median ignores a round that got interrupted by something slow
+    for(uint32_t i = 1u; i < CALIBRATION_ROUNDS; ++i) {
+        for(uint32_t j = i; j > 0u && results[j - 1u] > results[j]; --j) {
+            const uint64_t tmp = results[j];
+            results[j] = results[j - 1u];
+            results[j - 1u] = tmp;
+        }
+    }
+    return results[CALIBRATION_ROUNDS / 2u];
+}
+
+// Leaf 0x15 gives the TSC/crystal ratio and, on most CPUs since Skylake server, the crystal frequency.
+//  Leaf 0x16 only has the base frequency in MHz, which is what the TSC runs at on every CPU that has the leaf.
+static uint64_t tsc_hz_from_cpuid(enum tsc_frequency_source *const source) {
+    if(boot_cpu_info.max_basic_leaf >= CPUID_LEAF_TSC_CRYSTAL) {
+        const struct cpuid_result tsc_crystal = cpuid(CPUID_LEAF_TSC_CRYSTAL, 0u);
+        if(tsc_crystal.eax != 0u && tsc_crystal.ebx != 0u && tsc_crystal.ecx != 0u) {
+            *source = TSC_FREQUENCY_CPUID_CRYSTAL;
+            return (uint64_t)tsc_crystal.ecx * tsc_crystal.ebx / tsc_crystal.eax;
+        }
+    }
+
+    if(boot_cpu_info.max_basic_leaf >= CPUID_LEAF_PROCESSOR_FREQUENCY) {
+        const uint32_t base_mhz = cpuid(CPUID_LEAF_PROCESSOR_FREQUENCY, 0u).eax & 0xFFFFu;
+        if(base_mhz != 0u) {
+            *source = TSC_FREQUENCY_CPUID_BASE;
+            return base_mhz * 1000000ULL;
+        }
+    }
+
+    return 0u;
+}
+
+// `(numerator << 32)/denominator` as a long division, since a 128-bit division would need libgcc
+static uint64_t fixed_point_ratio(const uint64_t numerator, const uint64_t denominator) {
+    uint64_t result = numerator / denominator;
+    uint64_t remainder = numerator % denominator;
+    for(uint32_t bit = 0u; bit < FIXED_POINT_SHIFT; ++bit) {
+        remainder <<= 1; // can't overflow, since `remainder < denominator` and both are far below 2^63
+        result <<= 1;
+        if(remainder >= denominator) {
+            remainder -= denominator;
+            result |= 1u;
+        }
+    }
+    return result;
+}
+
+void clocksource_init(const struct FADT *const FADT_virt_addr, const struct HPET *const HPET_virt_addr) {
+    info.invariant_tsc = cpu_has(X86_FEATURE_INVARIANT_TSC);
+    info.tsc_hz = tsc_hz_from_cpuid(&info.source);
+
+    struct reference_clock clock;
+    if(info.tsc_hz == 0u && pm_timer_setup(FADT_virt_addr, &clock)) {
+        info.tsc_hz = calibrate_tsc(&clock);
+        info.source = TSC_FREQUENCY_PM_TIMER;
+    }
+    if(info.tsc_hz == 0u && hpet_setup(HPET_virt_addr, &clock)) {
+        info.tsc_hz = calibrate_tsc(&clock);
+        info.source = TSC_FREQUENCY_HPET;
+    }
+    if(info.tsc_hz == 0u) {
+        halt_and_die("No way to determine the TSC frequency.");
+    }
+
+    ns_per_tick_fixed = fixed_point_ratio(NANOSECONDS_PER_SECOND, info.tsc_hz);
+    ticks_per_ns_fixed = fixed_point_ratio(info.tsc_hz, NANOSECONDS_PER_SECOND);
+    boot_tsc = rdtsc_ordered();
+}
+
+struct clocksource_info clocksource_get_info(void) {
+    return info;
+}
+
+static const char* tsc_frequency_source_name(const enum tsc_frequency_source source) {
+    switch(source) {
+        case TSC_FREQUENCY_CPUID_CRYSTAL:
+            return "CPUID leaf 0x15";
+        case TSC_FREQUENCY_CPUID_BASE:
+            return "CPUID leaf 0x16";
+        case TSC_FREQUENCY_PM_TIMER:
+            return "ACPI PM timer calibration";
+        case TSC_FREQUENCY_HPET:
+            return "HPET calibration";
+        case TSC_FREQUENCY_UNKNOWN:
+            break;
+    }
+    return "unknown";
+}
+
+void clocksource_print_info(void) {
+    char str_buf[32];
+
+    serial_writestring("TSC frequency: ");
+    serial_writestring(print_digits(info.tsc_hz / 1000u, str_buf));
+    serial_writestring(" kHz from ");
+    serial_writestring(tsc_frequency_source_name(info.source));
+    serial_writestring(info.invariant_tsc ? ", invariant\n" : ", NOT invariant\n");
+}
+
+uint64_t tsc_ticks_to_ns(const uint64_t ticks) {
+    return (uint64_t)(((unsigned __int128)ticks * ns_per_tick_fixed) >> FIXED_POINT_SHIFT);
+}
+
+uint64_t ns_to_tsc_ticks(const uint64_t ns) {
+    return (uint64_t)(((unsigned __int128)ns * ticks_per_ns_fixed) >> FIXED_POINT_SHIFT);
+}
+
+uint64_t ktime_get(void) {
+    return tsc_ticks_to_ns(rdtsc_ordered() - boot_tsc);
+}
+
+uint64_t ktime_to_tsc(const uint64_t ns) {
+    return boot_tsc + ns_to_tsc_ticks(ns);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <kernel/acpi/acpi_tables.h>
+
+// All kernel time comes from the TSC. Its frequency is read from CPUID leaf 0x15 (or 0x16) if the CPU reports it,
+//  otherwise it is calibrated against the ACPI PM timer or, if that is missing too, the HPET.
+//  Conversions use 32.32 fixed point multipliers, so they never divide.
+
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+enum tsc_frequency_source {
+    TSC_FREQUENCY_UNKNOWN = 0,
+    TSC_FREQUENCY_CPUID_CRYSTAL, // leaf 0x15, exact
+    TSC_FREQUENCY_CPUID_BASE, // leaf 0x16, the nominal base frequency
+    TSC_FREQUENCY_PM_TIMER,
+    TSC_FREQUENCY_HPET,
+};
+
+struct clocksource_info {
+    uint64_t tsc_hz;
+    enum tsc_frequency_source source;
+    // Without an invariant TSC the rate can change with P-states and the TSC can stop in deep C-states, so time is only roughly right.
+    bool invariant_tsc;
+};
+
+// Must be called after `vm_region_init()`, since the HPET and a memory mapped PM timer need an MMIO mapping.
+//  `HPET_virt_addr` may be NULL, since the HPET table is optional.
+void clocksource_init(const struct FADT* FADT_virt_addr, const struct HPET* HPET_virt_addr);
+
+struct clocksource_info clocksource_get_info(void);
+void clocksource_print_info(void);
+
+uint64_t tsc_ticks_to_ns(uint64_t ticks);
+uint64_t ns_to_tsc_ticks(uint64_t ns);
+
+// Nanoseconds since `clocksource_init()`, and 0 before it.
+uint64_t ktime_get(void);
+// the TSC value at which `ktime_get()` reaches `ns`, for programming TSC deadlines
+uint64_t ktime_to_tsc(uint64_t ns);
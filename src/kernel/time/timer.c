@@ -0,0 +1,327 @@
+#include "timer.h"
+
+#include <kernel/cpu/cpu_features.h>
+#include <kernel/cpu/percpu.h>
+#include <kernel/error/error.h>
+#include <kernel/interrupts/idt.h>
+#include <kernel/interrupts/apic/apic.h>
+#include <kernel/sync/spinlock.h>
+#include <kernel/time/clocksource.h>
+#include <kernel/trace/trace.h>
+
+// The wheel counts in units of 2^10ns (about 1us). Level `l` has 64 slots of 8^l units each, so with 10 levels
+//  it reaches about 2.4 hours ahead. A timer further out than that is queued at the end of the wheel and requeued when that slot comes up.
+//  Every timer is put into the finest level whose range covers it, and its expiry is rounded up to that level's granularity.
+//  The levels are never cascaded down into finer ones, which keeps the work per timer O(1), but makes a timer fire up to 1/8 of its delay late.
+#define TIMER_UNIT_SHIFT 10u
+#define WHEEL_LEVELS 10u
+#define WHEEL_LEVEL_BITS 6u
+#define WHEEL_LEVEL_SIZE (1u << WHEEL_LEVEL_BITS)
+#define WHEEL_LEVEL_MASK (WHEEL_LEVEL_SIZE - 1u)
+#define WHEEL_CLOCK_SHIFT 3u
+#define WHEEL_CLOCK_MASK ((1u << WHEEL_CLOCK_SHIFT) - 1u)
+
+#define LEVEL_SHIFT(level) ((level) * WHEEL_CLOCK_SHIFT)
+#define LEVEL_GRANULARITY(level) (1ULL << LEVEL_SHIFT(level))
+// the smallest delay that goes into `level` (for `level >= 1`)
+#define LEVEL_START(level) ((uint64_t)WHEEL_LEVEL_MASK << LEVEL_SHIFT((level) - 1u))
+#define WHEEL_TIMEOUT_CUTOFF LEVEL_START(WHEEL_LEVELS)
+#define WHEEL_TIMEOUT_MAX (WHEEL_TIMEOUT_CUTOFF - LEVEL_GRANULARITY(WHEEL_LEVELS - 1u))
+
+#define NO_EXPIRY UINT64_MAX
+
+struct timer_base {
+    struct spinlock lock;
+    uint64_t clock; // the first unit that has not been processed yet
+    uint64_t next_expiry; // in units, the earliest slot with a timer in it
+    uint64_t programmed_expiry; // what the TSC deadline is set to, in units
+    uint64_t pending_slots[WHEEL_LEVELS]; // bit `i` is set if `slots[level][i]` is not empty
+    struct timer* slots[WHEEL_LEVELS][WHEEL_LEVEL_SIZE];
+    struct timer_stats stats;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct timer_base timer_bases[MAX_CPUS];
+
+static inline uint64_t ns_to_units(const uint64_t ns) {
+    return ns >> TIMER_UNIT_SHIFT;
+}
+
+static inline uint64_t units_to_ns(const uint64_t units) {
+    return units << TIMER_UNIT_SHIFT;
+}
+
+// Returns how far after `start` the first nonempty slot is (wrapping around), or -1 if the level is empty.
+static inline int32_t next_pending_slot(const uint64_t pending_slots, const uint32_t start) {
+    if(pending_slots == 0u) {
+        return -1;
+    }
+    const uint64_t rotated = (start == 0u) ? pending_slots : (pending_slots >> start) | (pending_slots << (WHEEL_LEVEL_SIZE - start));
+    return __builtin_ctzll(rotated);
+}
+
+// NOTE: A level's clock is rounded up if the clock is not aligned to that level, since the current slot of the level was already passed then.
+//  A nonempty slot at the rounded up position can thus only hold timers that are a whole turn of the level ahead.
+static uint64_t compute_next_expiry(const struct timer_base *const base) {
+    uint64_t next_expiry = NO_EXPIRY;
+    uint64_t level_clock = base->clock;
+
+    for(uint32_t level = 0u; level < WHEEL_LEVELS; ++level) {
+        const int32_t offset = next_pending_slot(base->pending_slots[level], level_clock & WHEEL_LEVEL_MASK);
+        if(offset >= 0) {
+            const uint64_t expiry = (level_clock + (uint64_t)offset) << LEVEL_SHIFT(level);
+            next_expiry = (expiry < next_expiry) ? expiry : next_expiry;
+        }
+        const uint64_t round_up = (level_clock & WHEEL_CLOCK_MASK) != 0u;
+        level_clock = (level_clock >> WHEEL_CLOCK_SHIFT) + round_up;
+    }
+
+    return next_expiry;
+}
+
+// Returns true if the timer became the earliest one.
+static bool enqueue_timer(struct timer_base *const base, struct timer *const timer) {
+    uint64_t expires = ns_to_units(timer->expires_ns);
+    expires = (expires < base->clock) ? base->clock : expires;
+    if(expires - base->clock >= WHEEL_TIMEOUT_CUTOFF) {
+        expires = base->clock + WHEEL_TIMEOUT_MAX;
+    }
+
+    const uint64_t delta = expires - base->clock;
+    uint32_t level = 0u;
+    while(level + 1u < WHEEL_LEVELS && delta >= LEVEL_START(level + 1u)) {
+        ++level;
+    }
+
+    // rounding up makes sure that a timer never fires early
+    const uint64_t level_expires = (expires >> LEVEL_SHIFT(level)) + 1u;
+    const uint64_t slot_expiry = level_expires << LEVEL_SHIFT(level);
+    const uint32_t index = level_expires & WHEEL_LEVEL_MASK;
+
+    struct timer **const head = &base->slots[level][index];
+    timer->next = *head;
+    if(timer->next != NULL) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = head;
+    *head = timer;
+    timer->slot = level*WHEEL_LEVEL_SIZE + index;
+    base->pending_slots[level] |= 1ULL << index;
+
+    if(slot_expiry < base->next_expiry) {
+        base->next_expiry = slot_expiry;
+        return true;
+    }
+    return false;
+}
+
+static void dequeue_timer(struct timer_base *const base, struct timer *const timer) {
+    *timer->pprev = timer->next;
+    if(timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->pprev = NULL;
+
+    const uint32_t level = timer->slot / WHEEL_LEVEL_SIZE;
+    const uint32_t index = timer->slot % WHEEL_LEVEL_SIZE;
+    if(base->slots[level][index] == NULL) {
+        base->pending_slots[level] &= ~(1ULL << index);
+    }
+}
+
+// Moves every slot that is due at `base->clock` onto `expired`. A level is only due if the clock is aligned to its granularity.
+static void collect_expired_timers(struct timer_base *const base, struct timer **const expired) {
+    uint64_t level_clock = base->clock;
+
+    for(uint32_t level = 0u; level < WHEEL_LEVELS; ++level) {
+        const uint32_t index = level_clock & WHEEL_LEVEL_MASK;
+        if(base->pending_slots[level] & (1ULL << index)) {
+            base->pending_slots[level] &= ~(1ULL << index);
+            struct timer* timer = base->slots[level][index];
+            base->slots[level][index] = NULL;
+            while(timer != NULL) {
+                struct timer *const next = timer->next;
+                timer->pprev = NULL;
+                timer->next = *expired;
+                *expired = timer;
+                timer = next;
+            }
+        }
+
+        if(level_clock & WHEEL_CLOCK_MASK) {
+            break;
+        }
+        level_clock >>= WHEEL_CLOCK_SHIFT;
+    }
+}
+
+// the deadline is only ever written by the CPU that owns `base`
+static void program_deadline(struct timer_base *const base) {
+    if(base->next_expiry == base->programmed_expiry) {
+        return;
+    }
+    base->programmed_expiry = base->next_expiry;
+    wrmsr(IA32_TSC_DEADLINE_MSR, (base->next_expiry == NO_EXPIRY) ? 0u : ktime_to_tsc(units_to_ns(base->next_expiry)));
+}
+
+static void run_expired_timers(struct timer_base *const base) {
+    struct timer* expired = NULL;
+    const uint64_t now_ns = ktime_get();
+    const uint64_t now = ns_to_units(now_ns);
+
+    spin_lock(&base->lock);
+    ++base->stats.interrupts;
+    while(base->next_expiry <= now) {
+        base->clock = base->next_expiry;
+        collect_expired_timers(base, &expired);
+        ++base->clock;
+        base->next_expiry = compute_next_expiry(base);
+    }
+    // nothing is due before `next_expiry`, so the clock can skip ahead, which lets timers that are added next use finer levels
+    if(base->clock < now) {
+        base->clock = (now < base->next_expiry) ? now : base->next_expiry;
+    }
+
+    // timers beyond the range of the wheel were queued early and go back in for the rest of their delay
+    struct timer* due = NULL;
+    while(expired != NULL) {
+        struct timer *const timer = expired;
+        expired = timer->next;
+        if(timer->expires_ns > now_ns) {
+            enqueue_timer(base, timer);
+        } else {
+            timer->next = due;
+            due = timer;
+        }
+    }
+    if(due == NULL) {
+        ++base->stats.empty_interrupts;
+    }
+    spin_unlock(&base->lock);
+    base->programmed_expiry = NO_EXPIRY; // the deadline that raised this interrupt is used up
+
+    while(due != NULL) {
+        struct timer *const timer = due;
+        due = timer->next; // read first, since the callback can add the timer again
+
+        const uint64_t slack = now_ns - timer->expires_ns;
+        ++base->stats.timers_fired;
+        base->stats.total_slack_ns += slack;
+        base->stats.max_slack_ns = (slack > base->stats.max_slack_ns) ? slack : base->stats.max_slack_ns;
+        TRACE(TRACE_TIMER_FIRED, timer->callback, slack);
+
+        timer->callback(timer, timer->context);
+    }
+
+    program_deadline(base);
+}
+
+static void local_timer_interrupt(struct interrupt_frame *const frame) {
+    (void)frame;
+    struct timer_base *const base = &timer_bases[current_cpu_id()];
+    if(base->programmed_expiry != NO_EXPIRY) {
+        interrupt_record_latency(ktime_to_tsc(units_to_ns(base->programmed_expiry)));
+    }
+    run_expired_timers(base);
+}
+
+void timer_init(void) {
+    if(!cpu_has(X86_FEATURE_TSC_DEADLINE)) {
+        halt_and_die("TSC-deadline mode is unsupported.");
+    }
+
+    struct timer_base *const base = &timer_bases[current_cpu_id()];
+    base->lock = (struct spinlock)SPINLOCK_INIT;
+    base->clock = ns_to_units(ktime_get());
+    base->next_expiry = NO_EXPIRY;
+    base->programmed_expiry = NO_EXPIRY;
+
+    idt_register_handler(LOCAL_TIMER_VECTOR, local_timer_interrupt);
+    wrmsr(X2APIC_LVT_TIMER_MSR, LVT_TIMER_TSC_DEADLINE_MODE | LOCAL_TIMER_VECTOR);
+    wrmsr(IA32_TSC_DEADLINE_MSR, 0u);
+}
+
+void timer_setup(struct timer *const timer, const timer_callback callback, void *const context) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires_ns = 0u;
+    timer->callback = callback;
+    timer->context = context;
+    timer->cpu = 0u;
+    timer->slot = 0u;
+}
+
+void timer_add(struct timer *const timer, const uint64_t expires_ns) {
+    kassert(timer->pprev == NULL, "The timer is already pending.");
+
+    // NOTE: Interrupts go off before the CPU is picked. A caller that is preempted in between could continue on another CPU,
+    //  and would then queue the timer on the old CPU's wheel but program the deadline of the new one.
+    const uint64_t rflags = interrupts_save_and_disable();
+    const uint32_t cpu = current_cpu_id();
+    struct timer_base *const base = &timer_bases[cpu];
+    timer->expires_ns = expires_ns;
+    timer->cpu = cpu;
+
+    spin_lock(&base->lock);
+    // An idle CPU does not process its wheel, so its clock can be far behind. Catching it up (without passing any pending slot)
+    //  puts the timer into a finer level.
+    const uint64_t now = ns_to_units(ktime_get());
+    if(base->clock < now) {
+        base->clock = (now < base->next_expiry) ? now : base->next_expiry;
+    }
+    const bool is_earliest = enqueue_timer(base, timer);
+    ++base->stats.timers_added;
+    spin_unlock(&base->lock);
+
+    // NOTE: A cancelled timer leaves the deadline where it was, and its interrupt just finds nothing to do. That is cheaper than reprogramming on every cancel.
+    if(is_earliest && base->next_expiry < base->programmed_expiry) {
+        program_deadline(base);
+    }
+    interrupts_restore(rflags);
+}
+
+bool timer_cancel(struct timer *const timer) {
+    struct timer_base *const base = &timer_bases[timer->cpu];
+
+    const uint64_t rflags = spin_lock_irqsave(&base->lock);
+    const bool was_pending = timer->pprev != NULL;
+    if(was_pending) {
+        dequeue_timer(base, timer);
+        ++base->stats.timers_cancelled;
+    }
+    spin_unlock_irqrestore(&base->lock, rflags);
+
+    return was_pending;
+}
+
+struct timer_stats timer_get_stats(const uint32_t cpu_id) {
+    kassert(cpu_id < MAX_CPUS, "CPU id is out of bounds.");
+    return timer_bases[cpu_id].stats;
+}
+
+void timer_print_stats(void) {
+    char str_buf[32];
+
+    serial_writestring("Timer stats:\n");
+    for(uint32_t cpu_id = 0u; cpu_id < MAX_CPUS; ++cpu_id) {
+        const struct timer_stats stats = timer_bases[cpu_id].stats;
+        if(!(online_cpus_mask & (1ULL << cpu_id))) continue;
+
+        serial_writestring("cpu ");
+        serial_writestring(print_digits(cpu_id, str_buf));
+        serial_writestring(": added: ");
+        serial_writestring(print_digits(stats.timers_added, str_buf));
+        serial_writestring(", cancelled: ");
+        serial_writestring(print_digits(stats.timers_cancelled, str_buf));
+        serial_writestring(", fired: ");
+        serial_writestring(print_digits(stats.timers_fired, str_buf));
+        serial_writestring(", interrupts: ");
+        serial_writestring(print_digits(stats.interrupts, str_buf));
+        serial_writestring(" (");
+        serial_writestring(print_digits(stats.empty_interrupts, str_buf));
+        serial_writestring(" empty), average slack: ");
+        serial_writestring(print_digits(stats.timers_fired ? stats.total_slack_ns / stats.timers_fired : 0u, str_buf));
+        serial_writestring("ns, max slack: ");
+        serial_writestring(print_digits(stats.max_slack_ns, str_buf));
+        serial_writestring("ns\n");
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// One-shot kernel timers, kept in a hierarchical timer wheel per CPU. There is no periodic tick:
+//  the TSC deadline is only programmed for the earliest pending timer, and disarmed when there is none, so an idle CPU takes no timer interrupts.
+//  Adding and cancelling a timer are O(1). In exchange a timer can fire up to 1/8 of its remaining delay late,
+//  since each level of the wheel is 8 times coarser than the one below it.
+
+struct timer;
+// Runs in interrupt context on the CPU the timer was added on, with no locks held. It may add the timer again.
+typedef void (*timer_callback)(struct timer* timer, void* context);
+
+struct timer {
+    struct timer* next;
+    struct timer** pprev; // NULL while the timer is not pending
+    uint64_t expires_ns; // in `ktime_get()` time
+    timer_callback callback;
+    void* context;
+    uint32_t cpu;
+    uint32_t slot; // level*64 + index in the wheel of `cpu`
+};
+
+struct timer_stats {
+    uint64_t timers_added;
+    uint64_t timers_cancelled;
+    uint64_t timers_fired;
+    uint64_t interrupts;
+    uint64_t empty_interrupts; // woke up but nothing was due, e.g. the earliest timer was cancelled
+    uint64_t total_slack_ns; // how late the timers fired, summed over `timers_fired`
+    uint64_t max_slack_ns;
+};
+
+// Must be called after `clocksource_init()`. Sets up the wheel and the TSC-deadline timer of the current CPU.
+void timer_init(void);
+
+void timer_setup(struct timer* timer, timer_callback callback, void* context);
+// Queues `timer` on the current CPU. The timer must not be pending already.
+void timer_add(struct timer* timer, uint64_t expires_ns);
+// Returns false if the timer was not pending (it already fired, or was never added).
+//  NOTE: The callback can still be running on its CPU when this returns false.
+bool timer_cancel(struct timer* timer);
+
+struct timer_stats timer_get_stats(uint32_t cpu_id);
+void timer_print_stats(void);
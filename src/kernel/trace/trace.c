@@ -0,0 +1,118 @@
+#include "trace.h"
+
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/percpu.h>
+#include <kernel/drivers/serial/serial.h>
+#include <kernel/mem/mem_constants.h>
+#include <kernel/mem/phys/phys_mem_allocator.h>
+#include <kernel/time/clocksource.h>
+
+#define TRACE_BUFFER_CAPACITY ((NORMAL_PAGE_SIZE << TRACE_BUFFER_ORDER) / sizeof(struct trace_record))
+#define TRACE_DUMP_VERSION 1u
+
+// `phase` is the Chrome trace event phase: 'B' and 'E' begin and end a slice on the CPU's track, 'i' is an instant event
+struct trace_event_description {
+    const char* name;
+    char phase;
+};
+
+static const struct trace_event_description trace_event_descriptions[NUMBER_OF_TRACE_EVENTS] = {
+    [TRACE_IRQ_ENTRY] = { "irq", 'B' },
+    [TRACE_IRQ_EXIT] = { "irq", 'E' },
+    [TRACE_PAGES_ALLOCATE] = { "pages_allocate", 'i' },
+    [TRACE_PAGES_FREE] = { "pages_free", 'i' },
+    [TRACE_CONTEXT_SWITCH] = { "context_switch", 'i' },
+    [TRACE_TIMER_FIRED] = { "timer_fired", 'i' },
+    [TRACE_BOOT_PHASE] = { "boot_phase", 'i' },
+};
+
+struct trace_buffer {
+    struct trace_record* records; // NULL until `trace_init_cpu()`
+    uint64_t head; // how many records were ever written, only written by the owning CPU
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct trace_buffer trace_buffers[MAX_CPUS];
+
+void trace_init_cpu(void) {
+    struct trace_buffer *const buffer = &trace_buffers[current_cpu_id()];
+    buffer->head = 0u;
+    __atomic_store_n(&buffer->records, (struct trace_record*) GENERAL_MEM_P2V(phys_mem_allocate_pages(TRACE_BUFFER_ORDER)), __ATOMIC_RELEASE);
+}
+
+void trace_event(const uint16_t event, const uint64_t arg0, const uint64_t arg1) {
+    // the buffer is only ever written by its own CPU, so disabling interrupts is enough
+    const uint64_t rflags = interrupts_save_and_disable();
+    const uint32_t cpu = current_cpu_id();
+    struct trace_buffer *const buffer = &trace_buffers[cpu];
+
+    if(buffer->records != NULL) {
+        struct trace_record *const record = &buffer->records[buffer->head % TRACE_BUFFER_CAPACITY];
+        record->tsc = rdtsc();
+        record->event = event;
+        record->cpu = (uint16_t)cpu;
+        record->reserved = 0u;
+        record->args[0] = arg0;
+        record->args[1] = arg1;
+        ++buffer->head;
+    }
+    interrupts_restore(rflags);
+}
+
+// the record's bytes in memory order as hex, so the host tool doesn't need to know anything but the layout
+static void dump_record(const struct trace_record *const record) {
+    static const char hex_digits[] = "0123456789abcdef";
+    char line[2u*sizeof(struct trace_record) + 2u];
+
+    const uint8_t *const bytes = (const uint8_t*)record;
+    for(uint32_t i = 0u; i < sizeof(struct trace_record); ++i) {
+        line[2u*i] = hex_digits[bytes[i] >> 4];
+        line[2u*i + 1u] = hex_digits[bytes[i] & 0xFu];
+    }
+    line[2u*sizeof(struct trace_record)] = '\n';
+    line[2u*sizeof(struct trace_record) + 1u] = '\0';
+    serial_writestring(line);
+}
+
+void trace_dump(void) {
+    char str_buf[32];
+
+    serial_writestring("TRACE BEGIN ");
+    serial_writestring(print_digits(TRACE_DUMP_VERSION, str_buf));
+    serial_writestring(" ");
+    serial_writestring(print_digits(clocksource_get_info().tsc_hz, str_buf));
+    serial_writestring("\n");
+
+    for(uint32_t event = 0u; event < NUMBER_OF_TRACE_EVENTS; ++event) {
+        const char phase[2] = { trace_event_descriptions[event].phase, '\0' };
+        serial_writestring("TRACE EVENT ");
+        serial_writestring(print_digits(event, str_buf));
+        serial_writestring(" ");
+        serial_writestring(phase);
+        serial_writestring(" ");
+        serial_writestring(trace_event_descriptions[event].name);
+        serial_writestring("\n");
+    }
+
+    for(uint32_t cpu = 0u; cpu < MAX_CPUS; ++cpu) {
+        const struct trace_buffer *const buffer = &trace_buffers[cpu];
+        const struct trace_record *const records = __atomic_load_n(&buffer->records, __ATOMIC_ACQUIRE);
+        if(records == NULL) {
+            continue;
+        }
+
+        const uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+        const uint64_t first = (head > TRACE_BUFFER_CAPACITY) ? head - TRACE_BUFFER_CAPACITY : 0u;
+        serial_writestring("TRACE CPU ");
+        serial_writestring(print_digits(cpu, str_buf));
+        serial_writestring(" ");
+        serial_writestring(print_digits(head - first, str_buf));
+        serial_writestring(" ");
+        serial_writestring(print_digits(first, str_buf)); // records that were overwritten
+        serial_writestring("\n");
+        for(uint64_t i = first; i < head; ++i) {
+            dump_record(&records[i % TRACE_BUFFER_CAPACITY]);
+        }
+    }
+
+    serial_writestring("TRACE END\n");
+}
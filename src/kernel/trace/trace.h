@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+// Binary event tracing into a ring buffer per CPU. A tracepoint only takes the TSC and stores a fixed-size record,
+//  so it costs tens of cycles instead of the microseconds of formatting and sending text over serial.
+//  `trace_dump()` sends the buffers over serial in bulk, and tools/trace_to_json.py turns that into Chrome trace (Perfetto) JSON.
+// NOTE: Tracepoints are only compiled in when building with `make TRACE=1` (which defines `KERNEL_TRACING`),
+//  otherwise `TRACE()` expands to nothing and its arguments are not evaluated.
+
+#define TRACE_BUFFER_ORDER 4u // 64KiB, so 2048 records per CPU before the oldest ones get overwritten
+
+// NOTE: Every event needs an entry in `trace_event_descriptions` in trace.c, which is where the host tool gets the names from.
+enum trace_event {
+    TRACE_IRQ_ENTRY, // arg0: vector
+    TRACE_IRQ_EXIT, // arg0: vector
+    TRACE_PAGES_ALLOCATE, // arg0: physical address, arg1: order
+    TRACE_PAGES_FREE, // arg0: physical address, arg1: order
+    TRACE_CONTEXT_SWITCH, // arg0: previous thread, arg1: next thread
+    TRACE_TIMER_FIRED, // arg0: the callback, arg1: how late it fired in ns
+    TRACE_BOOT_PHASE, // arg0: the name the phase was ended with (see `boot_phase_end()`)
+    NUMBER_OF_TRACE_EVENTS,
+};
+
+struct trace_record {
+    uint64_t tsc;
+    uint16_t event; // `enum trace_event`
+    uint16_t cpu;
+    uint32_t reserved;
+    uint64_t args[2];
+};
+
+// Allocates the buffer of the current CPU, events before that are dropped. Must be called after `phys_mem_buddy_init()`.
+void trace_init_cpu(void);
+
+void trace_event(uint16_t event, uint64_t arg0, uint64_t arg1);
+
+// Sends every CPU's buffer over serial, framed so that the host tool can pick it out of the rest of the log.
+//  NOTE: Tracing keeps running meanwhile, so records written during the dump may or may not be in it.
+void trace_dump(void);
+
+#ifdef KERNEL_TRACING
+#define TRACE(event, arg0, arg1) trace_event((event), (uint64_t)(arg0), (uint64_t)(arg1))
+#else
+// `sizeof` marks the arguments as used without evaluating them
+#define TRACE(event, arg0, arg1) do { (void)sizeof(arg0); (void)sizeof(arg1); } while(0)
+#endif
@@ -1,6 +1,9 @@
 #include "required_libc_functions.h"
 
-void* memcpy(void *const restrict dest, const void *const restrict src, const size_t count) {
+#include <kernel/cpu/alternatives.h>
+
+// The byte loops are the portable reference versions. They are only kept around for benchmarking against.
+void* memcpy_bytewise(void *const restrict dest, const void *const restrict src, const size_t count) {
     byte *const restrict dest_ptr = dest;
     const byte *const restrict src_ptr = src;
 
@@ -11,7 +14,7 @@ void* memcpy(void *const restrict dest, const void *const restrict src, const si
     return dest;
 }
 
-void* memset(void *const dest, const int ch, const size_t count) {
+void* memset_bytewise(void *const dest, const int ch, const size_t count) {
     byte *const dest_ptr = dest;
 
     for(size_t i = 0; i < count; ++i) {
@@ -21,7 +24,7 @@ void* memset(void *const dest, const int ch, const size_t count) {
     return dest;
 }
 
-void* memmove(void *const dest, const void *const src, const size_t count) {
+void* memmove_bytewise(void *const dest, const void *const src, const size_t count) {
     byte *const dest_ptr = dest;
     const byte *const src_ptr = src;
 
@@ -39,7 +42,72 @@ void* memmove(void *const dest, const void *const src, const size_t count) {
     return dest;
 }
 
-int memcmp(const void *const lhs, const void *const rhs, const size_t count) {
+// With ERMS (enhanced rep movsb/stosb) or FSRM (fast short rep movsb) the microcode picks the best chunk size itself, so a plain `rep movsb` wins.
+//  Without them `rep movsb` really moves one byte per iteration, so the bulk goes through `rep movsq` and only the last 0-7 bytes through `rep movsb`.
+//  The qword versions work on every x86_64 CPU, so they are the defaults until `apply_alternatives()` patches in the byte versions.
+void* memcpy(void *const restrict dest, const void *const restrict src, const size_t count) {
+    void* dest_ptr = dest;
+    const void* src_ptr = src;
+    size_t remaining = count;
+    uint64_t tail;
+    asm volatile(ALTERNATIVE("movq %%rcx, %[tail]\n\t"
+                             "shrq $3, %%rcx\n\t"
+                             "rep movsq\n\t"
+                             "movq %[tail], %%rcx\n\t"
+                             "andq $7, %%rcx\n\t"
+                             "rep movsb",
+                             "rep movsb", X86_FEATURE_FAST_STRING)
+                 : "+D" (dest_ptr), "+S" (src_ptr), "+c" (remaining), [tail] "=&r" (tail) :: "memory");
+    return dest;
+}
+
+void* memset(void *const dest, const int ch, const size_t count) {
+    void* dest_ptr = dest;
+    size_t remaining = count;
+    uint64_t tail;
+    const uint64_t pattern = 0x0101010101010101ULL * (byte)ch; // `rep stosb` only uses the low byte
+    asm volatile(ALTERNATIVE("movq %%rcx, %[tail]\n\t"
+                             "shrq $3, %%rcx\n\t"
+                             "rep stosq\n\t"
+                             "movq %[tail], %%rcx\n\t"
+                             "andq $7, %%rcx\n\t"
+                             "rep stosb",
+                             "rep stosb", X86_FEATURE_FAST_STRING)
+                 : "+D" (dest_ptr), "+c" (remaining), [tail] "=&r" (tail) : "a" (pattern) : "memory");
+    return dest;
+}
+
+// NOTE: A backwards `rep movs` (with the direction flag set) never gets the fast string path, so it always copies qwords.
+//  The 0-7 odd bytes at the end are copied first, so that the qwords are read before anything below them gets overwritten.
+static void copy_backwards(byte *const dest, const byte *const src, const size_t count) {
+    size_t bytes = count & 7u;
+    size_t qwords = count >> 3;
+
+    void* dest_ptr = dest + count - 1u;
+    const void* src_ptr = src + count - 1u;
+    asm volatile("std\n\trep movsb\n\tcld" : "+D" (dest_ptr), "+S" (src_ptr), "+c" (bytes) :: "memory");
+
+    dest_ptr = dest + qwords*8u - 8u;
+    src_ptr = src + qwords*8u - 8u;
+    asm volatile("std\n\trep movsq\n\tcld" : "+D" (dest_ptr), "+S" (src_ptr), "+c" (qwords) :: "memory");
+}
+
+const char* libc_string_functions_variant(void) {
+    return cpu_has(X86_FEATURE_FAST_STRING) ? "rep movsb/stosb" : "rep movsq/stosq";
+}
+
+void* memmove(void *const dest, const void *const src, const size_t count) {
+    // a forward copy is safe unless `dest` starts inside of the source
+    if((uintptr_t)dest - (uintptr_t)src >= count) {
+        return memcpy(dest, src, count);
+    }
+    if(dest != src) {
+        copy_backwards(dest, src, count);
+    }
+    return dest;
+}
+
+int memcmp_bytewise(const void *const lhs, const void *const rhs, const size_t count) {
     const byte *const lhs_ptr = lhs;
     const byte *const rhs_ptr = rhs;
 
@@ -52,14 +120,13 @@ int memcmp(const void *const lhs, const void *const rhs, const size_t count) {
     return 0;
 }
 
-
-size_t strlen(const char *const str) {
+size_t strlen_bytewise(const char *const str) {
     size_t len = 0u;
     for(; str[len] != '\0'; ++len);
     return len;
 }
 
-int strncmp(const char* lhs, const char* rhs, size_t count) {
+int strncmp_bytewise(const char* lhs, const char* rhs, size_t count) {
     while(count-- != 0) {
         unsigned char lhs_char = (unsigned char) *lhs++;
         unsigned char rhs_char = (unsigned char) *rhs++;
@@ -70,3 +137,92 @@ int strncmp(const char* lhs, const char* rhs, size_t count) {
     }
     return 0;
 }
+
+// The word-at-a-time versions below load 8 bytes at once through these, since reading a byte array as `uint64_t` would break strict aliasing.
+typedef uint64_t __attribute__ ((may_alias)) aliasing_word;
+typedef uint64_t __attribute__ ((may_alias, aligned(1))) unaligned_aliasing_word;
+
+#define WORD_SIZE sizeof(uint64_t)
+#define STRING_PAGE_SIZE 4096u
+#define LOW_BITS_OF_EACH_BYTE 0x0101010101010101ULL
+#define HIGH_BITS_OF_EACH_BYTE 0x8080808080808080ULL
+
+// Nonzero iff any byte of `word` is 0. Subtracting 1 only borrows into the high bit of a byte that was 0 (or of a byte above a borrowing one,
+//  which never comes before the first zero byte), and `& ~word` drops bytes that already had their high bit set.
+//  The lowest set high bit is always the first zero byte.
+static inline uint64_t has_zero_byte(const uint64_t word) {
+    return (word - LOW_BITS_OF_EACH_BYTE) & ~word & HIGH_BITS_OF_EACH_BYTE;
+}
+
+// the index of the lowest nonzero byte (little endian, so the byte that comes first in memory)
+static inline size_t first_marked_byte(const uint64_t word) {
+    return (size_t)__builtin_ctzll(word)/8u;
+}
+
+// a word load at `ptr` stays inside the page that `ptr` is in
+static inline bool word_fits_in_page(const void *const ptr) {
+    return ((uintptr_t)ptr & (STRING_PAGE_SIZE - 1u)) <= STRING_PAGE_SIZE - WORD_SIZE;
+}
+
+// Only ever reads inside `[lhs, lhs + count)` and `[rhs, rhs + count)`, so unaligned loads are fine.
+int memcmp(const void *const lhs, const void *const rhs, const size_t count) {
+    const byte *const lhs_ptr = lhs;
+    const byte *const rhs_ptr = rhs;
+
+    size_t i = 0u;
+    for(; i + WORD_SIZE <= count; i += WORD_SIZE) {
+        const uint64_t lhs_word = *(const unaligned_aliasing_word*)&lhs_ptr[i];
+        const uint64_t rhs_word = *(const unaligned_aliasing_word*)&rhs_ptr[i];
+        if(lhs_word != rhs_word) {
+            const size_t mismatch = i + first_marked_byte(lhs_word ^ rhs_word);
+            return lhs_ptr[mismatch] < rhs_ptr[mismatch] ? -1 : 1;
+        }
+    }
+    for(; i < count; ++i) {
+        if(lhs_ptr[i] != rhs_ptr[i]) {
+            return lhs_ptr[i] < rhs_ptr[i] ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+// Reads whole aligned words, which can go past the terminator but never past the page it is in.
+size_t strlen(const char *const str) {
+    const uintptr_t misalignment = (uintptr_t)str & (WORD_SIZE - 1u);
+    const aliasing_word* word_ptr = (const aliasing_word*)((uintptr_t)str - misalignment);
+
+    // the bytes in front of `str` are forced to be nonzero
+    uint64_t word = *word_ptr | ((1ULL << (misalignment*8u)) - 1u);
+    while(has_zero_byte(word) == 0u) {
+        word = *++word_ptr;
+    }
+
+    return (size_t)((const char*)word_ptr - str) + first_marked_byte(has_zero_byte(word));
+}
+
+// Compares a word at a time whenever neither load can cross into the next page, which could be unmapped even though the strings end before it.
+//  Otherwise, and around the byte that decides the result, it goes one byte at a time.
+int strncmp(const char* lhs, const char* rhs, size_t count) {
+    while(count != 0u) {
+        if(count >= WORD_SIZE && word_fits_in_page(lhs) && word_fits_in_page(rhs)) {
+            const uint64_t lhs_word = *(const unaligned_aliasing_word*)lhs;
+            const uint64_t rhs_word = *(const unaligned_aliasing_word*)rhs;
+            if(lhs_word == rhs_word && has_zero_byte(lhs_word) == 0u) {
+                lhs += WORD_SIZE;
+                rhs += WORD_SIZE;
+                count -= WORD_SIZE;
+                continue;
+            }
+        }
+
+        unsigned char lhs_char = (unsigned char) *lhs++;
+        unsigned char rhs_char = (unsigned char) *rhs++;
+        if(lhs_char != rhs_char) {
+            return lhs_char - rhs_char; // even though `lhs_char` and `rhs_char` are unsigned, this can be negative because of integer promotion.
+        }
+        if(lhs_char == '\0') return 0; // both strings have ended before `count`
+        --count;
+    }
+    return 0;
+}
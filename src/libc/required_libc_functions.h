@@ -1,18 +1,44 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 typedef unsigned char byte;
 
+// `memcpy`/`memset`/`memmove` are patched by `apply_alternatives()`, before that they use versions that work on every x86_64 CPU
+const char* libc_string_functions_variant(void);
+
 void* memcpy(void *restrict dest, const void *restrict src, size_t count);
 void* memset(void* dest, int ch, size_t count);
 void* memmove(void* dest, const void* src, size_t count);
 int memcmp(const void* lhs, const void* rhs, size_t count);
 
+// the plain byte loops, for benchmarking against
+void* memcpy_bytewise(void *restrict dest, const void *restrict src, size_t count);
+void* memset_bytewise(void* dest, int ch, size_t count);
+void* memmove_bytewise(void* dest, const void* src, size_t count);
+int memcmp_bytewise(const void* lhs, const void* rhs, size_t count);
+size_t strlen_bytewise(const char* str);
+int strncmp_bytewise(const char* lhs, const char* rhs, size_t count);
+
 size_t strlen(const char* str);
 int strncmp(const char* lhs, const char* rhs, size_t count);
 
 static inline uint64_t max(const uint64_t lhs, const uint64_t rhs) {
     return (lhs > rhs) ? lhs : rhs;
 }
+
+static inline uint64_t min(const uint64_t lhs, const uint64_t rhs) {
+    return (lhs < rhs) ? lhs : rhs;
+}
+
+// NOTE: `__builtin_popcountll()` compiles to a libgcc call without `-mpopcnt`, and the kernel is not linked against libgcc.
+static inline uint32_t popcount64(uint64_t value) {
+    uint32_t count = 0u;
+    while(value != 0u) {
+        value &= value - 1u;
+        ++count;
+    }
+    return count;
+}
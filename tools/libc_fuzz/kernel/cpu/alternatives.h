@@ -0,0 +1,25 @@
+#pragma once
+
+// Host stand-in for src/kernel/cpu/alternatives.h, which `make libc_fuzz` puts in front of the real one, so that
+//  src/libc/required_libc_functions.c builds as a normal user space object. There is nothing to patch on the host,
+//  so `ALTERNATIVE()` picks one of its two versions at compile time and the fuzzer is built once for each of them.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define X86_FEATURE_FAST_STRING 0
+
+#ifdef LIBC_FUZZ_FAST_STRING
+#define ALTERNATIVE(old_instructions, new_instructions, feature) new_instructions
+#else
+#define ALTERNATIVE(old_instructions, new_instructions, feature) old_instructions
+#endif
+
+static inline bool cpu_has(const uint32_t feature) {
+    (void)feature;
+#ifdef LIBC_FUZZ_FAST_STRING
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,274 @@
+// Checks the kernel's string functions against the byte loop versions from the same file.
+//  - memcpy/memset/memmove get random sizes, alignments and (for memmove) overlaps. Every call works inside a larger arena,
+//    and the whole arena is compared afterwards, so writes in front of or behind the destination show up as well.
+//  - memcmp/strlen/strncmp get random alignments, lengths and mismatch positions, with bytes from the whole range, since
+//    they have to compare unsigned. Half of the time the inputs end right before a `PROT_NONE` guard page, so a word load
+//    that reads past the end of a page the string does not reach into segfaults.
+//
+// Usage: make libc_fuzz, or bin/libc_fuzz [iterations] [seed]
+//
+// NOTE: src/libc/required_libc_functions.c is built with `memcpy` etc. renamed to `kernel_memcpy` etc. (see the Makefile),
+//  so that it does not replace the host libc's versions, which this file and printf keep using.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void* kernel_memcpy(void *restrict dest, const void *restrict src, size_t count);
+void* kernel_memset(void* dest, int ch, size_t count);
+void* kernel_memmove(void* dest, const void* src, size_t count);
+int kernel_memcmp(const void* lhs, const void* rhs, size_t count);
+size_t kernel_strlen(const char* str);
+int kernel_strncmp(const char* lhs, const char* rhs, size_t count);
+const char* libc_string_functions_variant(void);
+
+void* memcpy_bytewise(void *restrict dest, const void *restrict src, size_t count);
+void* memset_bytewise(void* dest, int ch, size_t count);
+void* memmove_bytewise(void* dest, const void* src, size_t count);
+int memcmp_bytewise(const void* lhs, const void* rhs, size_t count);
+size_t strlen_bytewise(const char* str);
+int strncmp_bytewise(const char* lhs, const char* rhs, size_t count);
+
+#define ARENA_SIZE 8192u
+#define MAX_ALIGNMENT 64u // offsets are picked from [0, MAX_ALIGNMENT) around the 64 byte aligned arena
+#define MAX_COUNT (ARENA_SIZE/2u - 2u*MAX_ALIGNMENT)
+#define DEFAULT_ITERATIONS 200000u
+
+static _Alignas(64) unsigned char arena[ARENA_SIZE];
+static _Alignas(64) unsigned char expected[ARENA_SIZE];
+
+// one readable page each for the left and the right hand side of the comparisons, followed by an inaccessible one
+static size_t page_size;
+static unsigned char* lhs_page;
+static unsigned char* rhs_page;
+
+// xorshift64, so that a failure can be reproduced from the printed seed
+static uint64_t rng_state;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static uint64_t random_below(const uint64_t bound) {
+    return next_random() % bound;
+}
+
+static size_t min_size(const size_t lhs, const size_t rhs) {
+    return lhs < rhs ? lhs : rhs;
+}
+
+// Mostly small counts, where the head and tail handling is, but every so often one that covers many qwords.
+static size_t random_count(void) {
+    switch(random_below(4u)) {
+        case 0u: return random_below(16u);
+        case 1u: return random_below(128u);
+        default: return random_below(MAX_COUNT + 1u);
+    }
+}
+
+static void fill_arena(void) {
+    for(size_t i = 0u; i < ARENA_SIZE; i += sizeof(uint64_t)) {
+        const uint64_t word = next_random();
+        memcpy(&arena[i], &word, sizeof(word));
+    }
+    memcpy(expected, arena, ARENA_SIZE);
+}
+
+static int check(const char *const function, const void *const result, const void *const dest, const size_t dest_offset, const size_t src_offset, const size_t count, const uint64_t iteration) {
+    if(result == dest && memcmp(arena, expected, ARENA_SIZE) == 0) {
+        return 0;
+    }
+
+    fprintf(stderr, "%s failed in iteration %llu: dest offset %zu, src offset %zu, count %zu", function, (unsigned long long)iteration, dest_offset, src_offset, count);
+    if(result != dest) {
+        fprintf(stderr, ", returned %p instead of %p", result, dest);
+    }
+    for(size_t i = 0u; i < ARENA_SIZE; ++i) {
+        if(arena[i] != expected[i]) {
+            fprintf(stderr, ", first wrong byte at arena offset %zu (0x%02x instead of 0x%02x)", i, arena[i], expected[i]);
+            break;
+        }
+    }
+    fputc('\n', stderr);
+    return 1;
+}
+
+// The source is in the upper half of the arena and the destination in the lower half, since memcpy must not overlap.
+static int fuzz_memcpy(const uint64_t iteration) {
+    fill_arena();
+    const size_t count = random_count();
+    const size_t dest_offset = MAX_ALIGNMENT + random_below(MAX_ALIGNMENT);
+    const size_t src_offset = ARENA_SIZE/2u + MAX_ALIGNMENT + random_below(MAX_ALIGNMENT);
+
+    memcpy_bytewise(&expected[dest_offset], &expected[src_offset], count);
+    void *const result = kernel_memcpy(&arena[dest_offset], &arena[src_offset], count);
+    return check("memcpy", result, &arena[dest_offset], dest_offset, src_offset, count, iteration);
+}
+
+static int fuzz_memset(const uint64_t iteration) {
+    fill_arena();
+    const size_t count = random_count();
+    const size_t dest_offset = MAX_ALIGNMENT + random_below(MAX_ALIGNMENT);
+    // all of `int`, since only the low byte may be used
+    const int ch = (int)(uint32_t)next_random();
+
+    memset_bytewise(&expected[dest_offset], ch, count);
+    void *const result = kernel_memset(&arena[dest_offset], ch, count);
+    return check("memset", result, &arena[dest_offset], dest_offset, 0u, count, iteration);
+}
+
+// Source and destination are at most `count` bytes apart half of the time, in either direction, so they overlap.
+static int fuzz_memmove(const uint64_t iteration) {
+    fill_arena();
+    const size_t count = random_count();
+    const size_t src_offset = ARENA_SIZE/4u + random_below(MAX_ALIGNMENT);
+    const size_t distance = random_below(2u) == 0u ? random_below(min_size(count, ARENA_SIZE/4u - 1u) + 1u) : random_below(ARENA_SIZE/4u);
+    const size_t dest_offset = random_below(2u) == 0u ? src_offset + distance : src_offset - distance;
+
+    memmove_bytewise(&expected[dest_offset], &expected[src_offset], count);
+    void *const result = kernel_memmove(&arena[dest_offset], &arena[src_offset], count);
+    return check("memmove", result, &arena[dest_offset], dest_offset, src_offset, count, iteration);
+}
+
+static unsigned char* map_guarded_page(void) {
+    unsigned char *const page = mmap(NULL, 2u*page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(page == MAP_FAILED || mprotect(page + page_size, page_size, PROT_NONE) != 0) {
+        perror("libc_fuzz: guard page");
+        exit(EXIT_FAILURE);
+    }
+    return page;
+}
+
+// Lengths like `random_count()`, but short enough that a buffer of `length + 1` bytes fits behind any alignment offset.
+static size_t random_string_length(void) {
+    const size_t max_length = page_size - MAX_ALIGNMENT - 1u;
+    switch(random_below(4u)) {
+        case 0u: return random_below(16u);
+        case 1u: return random_below(128u);
+        default: return random_below(max_length + 1u);
+    }
+}
+
+// Either right in front of the guard page, or at a random alignment at the start of the page.
+static unsigned char* place_in_page(unsigned char *const page, const size_t size) {
+    return random_below(2u) == 0u ? page + page_size - size : page + random_below(MAX_ALIGNMENT);
+}
+
+static unsigned char random_nonzero_byte(void) {
+    return (unsigned char)(1u + random_below(255u));
+}
+
+// a byte that is guaranteed to be different from `value`
+static unsigned char other_byte(const unsigned char value) {
+    return (unsigned char)(value + 1u + random_below(255u));
+}
+
+// a nonzero byte that is guaranteed to be different from the nonzero `value`
+static unsigned char other_nonzero_byte(const unsigned char value) {
+    return (unsigned char)((value + random_below(254u)) % 255u + 1u);
+}
+
+static int sign(const long value) {
+    return (value > 0) - (value < 0);
+}
+
+static int check_result(const char *const function, const long expected_result, const long result, const unsigned char *const lhs, const unsigned char *const rhs, const size_t length, const uint64_t iteration) {
+    if(expected_result == result) {
+        return 0;
+    }
+    fprintf(stderr, "%s failed in iteration %llu: lhs page offset %zu, rhs page offset %zu, length %zu, returned %ld instead of %ld\n", function, (unsigned long long)iteration,
+            (size_t)(lhs - lhs_page), rhs != NULL ? (size_t)(rhs - rhs_page) : 0u, length, result, expected_result);
+    return 1;
+}
+
+// Equal inputs a quarter of the time, otherwise with one differing byte. Whatever comes after it must not matter.
+static int fuzz_memcmp(const uint64_t iteration) {
+    const size_t count = random_string_length();
+    unsigned char *const lhs = place_in_page(lhs_page, count);
+    unsigned char *const rhs = place_in_page(rhs_page, count);
+    for(size_t i = 0u; i < count; ++i) {
+        lhs[i] = (unsigned char)next_random();
+        rhs[i] = lhs[i];
+    }
+    if(count != 0u && random_below(4u) != 0u) {
+        const size_t mismatch = random_below(count);
+        rhs[mismatch] = other_byte(lhs[mismatch]);
+        if(mismatch + 1u < count) {
+            const size_t later = mismatch + 1u + random_below(count - mismatch - 1u);
+            rhs[later] = other_byte(lhs[later]);
+        }
+    }
+
+    return check_result("memcmp", sign(memcmp_bytewise(lhs, rhs, count)), sign(kernel_memcmp(lhs, rhs, count)), lhs, rhs, count, iteration);
+}
+
+static int fuzz_strlen(const uint64_t iteration) {
+    const size_t length = random_string_length();
+    unsigned char *const str = place_in_page(lhs_page, length + 1u);
+    for(size_t i = 0u; i < length; ++i) {
+        str[i] = random_nonzero_byte();
+    }
+    str[length] = '\0';
+
+    return check_result("strlen", (long)strlen_bytewise((const char*)str), (long)kernel_strlen((const char*)str), str, NULL, length, iteration);
+}
+
+// The right hand side is a copy of the left one that differs in a byte, ends early, or not at all. The count ends before,
+//  at or after the terminator, or is unbounded.
+static int fuzz_strncmp(const uint64_t iteration) {
+    const size_t length = random_string_length();
+    unsigned char *const lhs = place_in_page(lhs_page, length + 1u);
+    unsigned char *const rhs = place_in_page(rhs_page, length + 1u);
+    for(size_t i = 0u; i < length; ++i) {
+        lhs[i] = random_nonzero_byte();
+        rhs[i] = lhs[i];
+    }
+    lhs[length] = '\0';
+    rhs[length] = '\0';
+    if(length != 0u) {
+        const size_t mismatch = random_below(length);
+        switch(random_below(3u)) {
+            case 0u: rhs[mismatch] = '\0'; break;
+            case 1u: rhs[mismatch] = other_nonzero_byte(lhs[mismatch]); break;
+            default: break;
+        }
+    }
+
+    size_t count;
+    switch(random_below(3u)) {
+        case 0u: count = random_below(length + 2u); break;
+        case 1u: count = length + 1u + random_below(MAX_ALIGNMENT); break;
+        default: count = SIZE_MAX; break;
+    }
+
+    return check_result("strncmp", sign(strncmp_bytewise((const char*)lhs, (const char*)rhs, count)), sign(kernel_strncmp((const char*)lhs, (const char*)rhs, count)), lhs, rhs, length, iteration);
+}
+
+int main(const int argc, char **const argv) {
+    const uint64_t iterations = argc > 1 ? strtoull(argv[1], NULL, 0) : DEFAULT_ITERATIONS;
+    const uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 0) : 0x9E3779B97F4A7C15ULL;
+    rng_state = seed != 0u ? seed : 1u; // xorshift gets stuck at 0
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+    lhs_page = map_guarded_page();
+    rhs_page = map_guarded_page();
+
+    int failures = 0;
+    for(uint64_t i = 0u; i < iterations && failures < 10; ++i) {
+        failures += fuzz_memcpy(i);
+        failures += fuzz_memset(i);
+        failures += fuzz_memmove(i);
+        failures += fuzz_memcmp(i);
+        failures += fuzz_strlen(i);
+        failures += fuzz_strncmp(i);
+    }
+
+    printf("libc_fuzz (%s): %llu iterations with seed 0x%llx, %s\n", libc_string_functions_variant(), (unsigned long long)iterations, (unsigned long long)seed, failures == 0 ? "all passed" : "FAILED");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
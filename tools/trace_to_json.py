@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Turns a trace dump from the kernel's serial log into Chrome trace JSON, which chrome://tracing and Perfetto can open.
+
+Usage: tools/trace_to_json.py serial.log > trace.json
+
+The kernel writes the dump with `trace_dump()` (see src/kernel/trace/trace.h) when it is built with `make TRACE=1`.
+Everything outside of the TRACE BEGIN/END lines is ignored, and if the log has several dumps, the last one is used.
+"""
+
+import json
+import struct
+import sys
+
+# NOTE: This has to match `struct trace_record` in trace.h.
+RECORD_FORMAT = "<QHHIQQ"
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+SUPPORTED_VERSION = 1
+HEX_DIGITS = frozenset("0123456789abcdef")  # what `dump_record()` in trace.c writes
+
+
+def parse_dump(lines):
+    dump = None
+    for line in lines:
+        line = line.strip()
+        if line.startswith("TRACE BEGIN "):
+            _, _, version, tsc_hz = line.split()
+            if int(version) != SUPPORTED_VERSION:
+                sys.exit(f"unsupported trace dump version {version}")
+            dump = {"tsc_hz": int(tsc_hz), "events": {}, "records": [], "overwritten": {}, "complete": False}
+        elif dump is None or dump["complete"]:
+            continue
+        elif line.startswith("TRACE EVENT "):
+            _, _, event, phase, name = line.split(maxsplit=4)
+            dump["events"][int(event)] = (name, phase)
+        elif line.startswith("TRACE CPU "):
+            _, _, cpu, _count, overwritten = line.split()
+            dump["overwritten"][int(cpu)] = int(overwritten)
+        elif line == "TRACE END":
+            dump["complete"] = True
+        elif len(line) == 2 * RECORD_SIZE and all(c in HEX_DIGITS for c in line):
+            # other CPUs can still write to serial during the dump, so a line of the right length is not always a record
+            dump["records"].append(struct.unpack(RECORD_FORMAT, bytes.fromhex(line)))
+
+    if dump is None:
+        sys.exit("no trace dump in the log")
+    if not dump["complete"]:
+        print("warning: the last trace dump is cut off", file=sys.stderr)
+    return dump
+
+
+def to_chrome_trace(dump):
+    records = dump["records"]
+    first_tsc = min((record[0] for record in records), default=0)
+    ticks_per_us = dump["tsc_hz"] / 1e6 if dump["tsc_hz"] else 1.0
+
+    trace_events = []
+    for cpu, overwritten in sorted(dump["overwritten"].items()):
+        trace_events.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": cpu, "args": {"name": f"cpu {cpu}"}})
+        if overwritten:
+            print(f"note: cpu {cpu} overwrote its {overwritten} oldest records", file=sys.stderr)
+
+    for tsc, event, cpu, _reserved, arg0, arg1 in records:
+        name, phase = dump["events"].get(event, (f"event {event}", "i"))
+        trace_event = {
+            "name": name,
+            "ph": phase,
+            "ts": (tsc - first_tsc) / ticks_per_us,
+            "pid": 0,
+            "tid": cpu,
+            "args": {"arg0": hex(arg0), "arg1": hex(arg1)},
+        }
+        if phase == "i":
+            trace_event["s"] = "t"  # the instant belongs to the CPU's track
+        trace_events.append(trace_event)
+
+    return {"traceEvents": trace_events, "displayTimeUnit": "ns"}
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    with open(sys.argv[1], errors="replace") as log:
+        dump = parse_dump(log)
+    json.dump(to_chrome_trace(dump), sys.stdout)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()